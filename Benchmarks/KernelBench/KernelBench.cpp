@@ -0,0 +1,631 @@
+// ==============================================================================
+//
+//  KernelBench.cpp
+//  QTR
+//
+//  Note: Microbenchmarks of the truncated-grid kernels of KleinKramers2d
+//        on synthetic TA masks, so kernel changes can be judged without a
+//        scenario run. The kernels are copies of the solver loops (KEP
+//        coefficients, double-well force):
+//          rk4-stage    one RK4 stage, KK and FF        full / mask / span
+//          moments      row moments and Feq_loc         mask / span
+//          ta-rebuild   TA box and size                 interior / box
+//          tb-detect    TA cells with an inactive nbr   mask / span
+//          extrapolate  ExFF targets of TB and values   (one variant)
+//        Masks keep the lowest-scoring fraction of the interior, so the
+//        fill is exact:
+//          band    thin curved band, KEP grid 600 x 800
+//          blob    compact blob, SL grid 400 x 240
+//          strip   full-width strip in x1, GaAs grid 202 x 150
+//          random  uniform random cells, KEP grid
+//        Each kernel is run once to warm up, then the best of reps calls is
+//        reported. Cells are those the kernel updates or inspects; GB/s is
+//        the compulsory traffic of the loop (8 B per double, 1 B per mask
+//        cell, 4 B per index) over the best time, neighbours counted as
+//        cache hits.
+//
+//          g++ -std=c++11 -O3 -fopenmp KernelBench.cpp -o kernelbench
+//          OMP_NUM_THREADS=8 ./kernelbench [reps] [shape]
+//
+// ==============================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+typedef std::vector<int> MeshIndex;
+
+#pragma omp declare reduction (merge : MeshIndex : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
+
+#define EDGE        2
+#define BIG_NUMBER  1000000000
+
+namespace QTR_NS {
+
+    enum { SHAPE_BAND, SHAPE_BLOB, SHAPE_STRIP, SHAPE_RANDOM, SHAPES };
+
+    struct Shape {
+        const char      *name;
+        int             n1;
+        int             n2;
+    };
+
+    const Shape Shapes[SHAPES] = { { "band", 600, 800 }, { "blob", 400, 240 },
+                                   { "strip", 202, 150 }, { "random", 600, 800 } };
+
+    const double Fills[] = { 0.02, 0.05, 0.1, 0.2, 0.4 };
+
+    class KernelBench {
+
+    public:
+        KernelBench(int n1, int n2);
+        ~KernelBench();
+
+        void            Mask(int shape, double fill);
+        void            Run(const char *shape, double fill, int reps);
+
+    private:
+        typedef double  (KernelBench::*Kernel)();   // returns bytes moved
+
+        void            Report(const char *shape, double fill, const char *kernel, const char *variant,
+                               Kernel k, double cells, int reps);
+        void            BuildSpans();
+        bool            Check();
+
+        double          StageFull();
+        double          StageMask();
+        double          StageSpan();
+        double          MomentsMask();
+        double          MomentsSpan();
+        double          RebuildInterior();
+        double          RebuildBox();
+        double          DetectMask();
+        double          DetectSpan();
+        double          Extrapolate();
+
+        inline double   Force(double x1)
+        {
+            return 0.028 * x1 * x1 * x1 - 0.02 * x1;
+        }
+
+        int             N1;
+        int             N2;
+        int             W1;
+        int             x1_min, x1_max, x2_min, x2_max;
+        int             ta_size;
+        double          Box[4];
+        double          H[2];
+        double          k2h0m, k2h1, kgamma, m, kb, ExReduce;
+
+        bool            *TAMask;
+        double          *F;
+        double          *FF;
+        double          *KK;
+        double          *Feq_loc;
+        double          *Density;
+        double          *Velocity;
+        double          *Temperature;
+        MeshIndex       TB;
+        MeshIndex       ExFF;
+        std::vector<double> ExTBL;
+        std::vector<int> SpanPtr;
+        std::vector<int> SpanLo;
+        std::vector<int> SpanHi;
+    };
+}
+
+using namespace QTR_NS;
+
+/* ------------------------------------------------------------------------------- */
+
+KernelBench::KernelBench(int n1, int n2)
+{
+    const double kk = 0.01;
+    const double gamma = 0.0032;
+
+    N1 = n1;
+    N2 = n2;
+    W1 = n2;
+    Box[0] = -3.0;  Box[1] = 3.0;
+    Box[2] = -40.0; Box[3] = 40.0;
+    H[0] = (Box[1] - Box[0]) / (N1 - 1);
+    H[1] = (Box[3] - Box[2]) / (N2 - 1);
+    m = 2000.0;
+    kb = 1.0;
+    ExReduce = 1.0;
+    k2h0m = kk / (2.0 * H[0] * m);
+    k2h1 = kk / (2.0 * H[1]);
+    kgamma = kk * gamma;
+
+    TAMask = new bool[N1 * N2];
+    F = new double[N1 * N2];
+    FF = new double[N1 * N2];
+    KK = new double[N1 * N2];
+    Feq_loc = new double[N1 * N2];
+    Density = new double[N1];
+    Velocity = new double[N1];
+    Temperature = new double[N1];
+}
+/* ------------------------------------------------------------------------------- */
+
+KernelBench::~KernelBench()
+{
+    delete[] TAMask;
+    delete[] F;
+    delete[] FF;
+    delete[] KK;
+    delete[] Feq_loc;
+    delete[] Density;
+    delete[] Velocity;
+    delete[] Temperature;
+}
+/* ------------------------------------------------------------------------------- */
+
+void KernelBench::Mask(int shape, double fill)
+{
+    // Score the cells the TA may hold (one cell in from EDGE, as the
+    // truncation keeps them) and activate the lowest fill fraction
+    std::vector<std::pair<double, int> > S;
+    double u, v, s;
+    unsigned int h;
+
+    for (int i1 = EDGE + 1; i1 < N1 - EDGE - 1; i1 ++)  {
+        for (int i2 = EDGE + 1; i2 < N2 - EDGE - 1; i2 ++)  {
+
+            u = 2.0 * i1 / (N1 - 1) - 1.0;
+            v = 2.0 * i2 / (N2 - 1) - 1.0;
+
+            switch ( shape )  {
+                case SHAPE_BAND:
+                    s = std::abs(v - 0.5 * sin(1.5 * M_PI * u)) * (1.0 + 0.5 * u * u);
+                    break;
+                case SHAPE_BLOB:
+                    s = (u + 0.2) * (u + 0.2) + 2.0 * v * v;
+                    break;
+                case SHAPE_STRIP:
+                    s = std::abs(v + 0.2 - 0.1 * u);
+                    break;
+                default:
+                    h = (unsigned int) (i1 * 73856093) ^ (unsigned int) (i2 * 19349663);
+                    h ^= h >> 13;  h *= 0x5bd1e995;  h ^= h >> 15;
+                    s = h / 4294967296.0;
+                    break;
+            }
+            S.push_back(std::make_pair(s, i1 * W1 + i2));
+        }
+    }
+    size_t n = std::max((size_t) 1, (size_t) (fill * S.size()));
+    std::nth_element(S.begin(), S.begin() + (n - 1), S.end());
+
+    memset(TAMask, 0, N1 * N2 * sizeof(bool));
+
+    for (int i = 0; i < N1 * N2; i ++)  {
+        F[i] = 0.0;
+        FF[i] = 0.0;
+        KK[i] = 0.0;
+        Feq_loc[i] = 0.0;
+    }
+    for (size_t i = 0; i < n; i ++)  {
+        int g = S[i].second;
+        TAMask[g] = 1;
+        F[g] = 1.0e-3 * exp(-S[i].first) * (1.0 + 0.25 * cos(0.1 * g));
+        Feq_loc[g] = 0.9 * F[g];
+    }
+
+    RebuildInterior();
+    BuildSpans();
+    DetectMask();
+}
+/* ------------------------------------------------------------------------------- */
+
+void KernelBench::BuildSpans()
+{
+    SpanPtr.assign(N1 + 1, 0);
+    SpanLo.clear();
+    SpanHi.clear();
+
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+            if ( TAMask[i1*W1+i2] && (i2 == x2_min || !TAMask[i1*W1+i2-1]) )
+                SpanLo.push_back(i2);
+            if ( TAMask[i1*W1+i2] && (i2 == x2_max || !TAMask[i1*W1+i2+1]) )
+                SpanHi.push_back(i2);
+        }
+        SpanPtr[i1+1] = (int) SpanLo.size();
+    }
+    for (int i1 = x1_max + 1; i1 < N1; i1 ++)
+        SpanPtr[i1+1] = SpanPtr[i1];
+}
+/* ------------------------------------------------------------------------------- */
+
+void KernelBench::Run(const char *shape, double fill, int reps)
+{
+    const double box = (double) (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+    const double interior = (double) (N1 - 2 * EDGE) * (N2 - 2 * EDGE);
+
+    Report(shape, fill, "rk4-stage", "full", &KernelBench::StageFull, interior, reps);
+    Report(shape, fill, "rk4-stage", "mask", &KernelBench::StageMask, ta_size, reps);
+    Report(shape, fill, "rk4-stage", "span", &KernelBench::StageSpan, ta_size, reps);
+    Report(shape, fill, "moments", "mask", &KernelBench::MomentsMask, ta_size, reps);
+    Report(shape, fill, "moments", "span", &KernelBench::MomentsSpan, ta_size, reps);
+    Report(shape, fill, "ta-rebuild", "interior", &KernelBench::RebuildInterior, interior, reps);
+    Report(shape, fill, "ta-rebuild", "box", &KernelBench::RebuildBox, box, reps);
+    Report(shape, fill, "tb-detect", "mask", &KernelBench::DetectMask, ta_size, reps);
+    Report(shape, fill, "tb-detect", "span", &KernelBench::DetectSpan, ta_size, reps);
+
+    Extrapolate();
+    Report(shape, fill, "extrapolate", "-", &KernelBench::Extrapolate, ExFF.size(), reps);
+
+    if ( !Check() )
+        printf("%-7s %5.3f  variants disagree\n", shape, fill);
+}
+/* ------------------------------------------------------------------------------- */
+
+void KernelBench::Report(const char *shape, double fill, const char *kernel, const char *variant,
+                         Kernel k, double cells, int reps)
+{
+    double t_best = 1.0e30, t_0, bytes = 0.0;
+
+    (this->*k)();
+
+    for (int r = 0; r < reps; r ++)  {
+        t_0 = omp_get_wtime();
+        bytes = (this->*k)();
+        t_best = std::min(t_best, omp_get_wtime() - t_0);
+    }
+    printf("%-7s %4dx%-4d %5.3f  %-11s %-8s %9.0f %10.4f %10.2f %8.2f\n",
+           shape, N1, N2, fill, kernel, variant, cells, t_best * 1.0e3,
+           cells / t_best * 1.0e-6, bytes / t_best * 1.0e-9);
+}
+/* ------------------------------------------------------------------------------- */
+
+bool KernelBench::Check()
+{
+    // The variants of a kernel must agree on the active cells
+    std::vector<double> kk_mask(N1 * N2), rho_mask(N1);
+    MeshIndex tb_mask;
+    bool ok = true;
+
+    StageMask();
+    std::copy(KK, KK + N1 * N2, kk_mask.begin());
+    StageSpan();
+    for (int i = 0; i < N1 * N2; i ++)
+        if ( TAMask[i] && KK[i] != kk_mask[i] )
+            ok = false;
+
+    MomentsMask();
+    std::copy(Density, Density + N1, rho_mask.begin());
+    MomentsSpan();
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)
+        if ( std::abs(Density[i1] - rho_mask[i1]) > 1.0e-12 * std::abs(rho_mask[i1]) )
+            ok = false;
+
+    DetectMask();
+    tb_mask = TB;
+    DetectSpan();
+    std::sort(tb_mask.begin(), tb_mask.end());
+    std::sort(TB.begin(), TB.end());
+    if ( tb_mask != TB )
+        ok = false;
+
+    return ok;
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::StageFull()
+{
+    // CASE 3: every interior cell
+    #pragma omp parallel for
+    for (int i1 = EDGE; i1 < N1 - EDGE; i1 ++)  {
+        for (int i2 = EDGE; i2 < N2 - EDGE; i2 ++)  {
+            double xx1 = Box[0] + i1 * H[0];
+            double xx2 = Box[2] + i2 * H[1];
+            double f0 = F[i1*W1+i2];
+            KK[i1*W1+i2] = -k2h0m * xx2 * (F[(i1+1)*W1+i2] - F[(i1-1)*W1+i2]) +
+                           k2h1 * Force(xx1) * (F[i1*W1+(i2+1)] - F[i1*W1+(i2-1)]) +
+                           kgamma * (Feq_loc[i1*W1+i2] - f0);
+            FF[i1*W1+i2] = f0 + KK[i1*W1+i2] / 6.0;
+        }
+    }
+    return 32.0 * (N1 - 2 * EDGE) * (N2 - 2 * EDGE);
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::StageMask()
+{
+    // TA box with a mask test per cell
+    #pragma omp parallel for
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+            if ( TAMask[i1*W1+i2] )  {
+                double xx1 = Box[0] + i1 * H[0];
+                double xx2 = Box[2] + i2 * H[1];
+                double f0 = F[i1*W1+i2];
+                KK[i1*W1+i2] = -k2h0m * xx2 * (F[(i1+1)*W1+i2] - F[(i1-1)*W1+i2]) +
+                               k2h1 * Force(xx1) * (F[i1*W1+(i2+1)] - F[i1*W1+(i2-1)]) +
+                               kgamma * (Feq_loc[i1*W1+i2] - f0);
+                FF[i1*W1+i2] = f0 + KK[i1*W1+i2] / 6.0;
+            }
+        }
+    }
+    return 32.0 * ta_size + 1.0 * (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::StageSpan()
+{
+    // CASE 2: runs of active cells
+    #pragma omp parallel for
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
+                double xx1 = Box[0] + i1 * H[0];
+                double xx2 = Box[2] + i2 * H[1];
+                double f0 = F[i1*W1+i2];
+                KK[i1*W1+i2] = -k2h0m * xx2 * (F[(i1+1)*W1+i2] - F[(i1-1)*W1+i2]) +
+                               k2h1 * Force(xx1) * (F[i1*W1+(i2+1)] - F[i1*W1+(i2-1)]) +
+                               kgamma * (Feq_loc[i1*W1+i2] - f0);
+                FF[i1*W1+i2] = f0 + KK[i1*W1+i2] / 6.0;
+            }
+        }
+    }
+    return 32.0 * ta_size + 8.0 * SpanLo.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::MomentsMask()
+{
+    // Three masked passes over the TA box, then Feq. Feq goes to FF so the
+    // Feq_loc read by the stages stays fixed
+    #pragma omp parallel for schedule(dynamic,4)
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+
+        double density = 0.0, velocity = 0.0, temp_loc = 0.0, p, feq;
+
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)
+            if ( TAMask[i1*W1+i2] )
+                density += F[i1*W1+i2] * H[1];
+
+        if ( density > 0.0 )  {
+            for (int i2 = x2_min; i2 <= x2_max; i2 ++)
+                if ( TAMask[i1*W1+i2] )
+                    velocity += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+            velocity = velocity / (m * density);
+            for (int i2 = x2_min; i2 <= x2_max; i2 ++)
+                if ( TAMask[i1*W1+i2] )
+                    temp_loc += pow((Box[2] + i2 * H[1] - m * velocity), 2) * F[i1*W1+i2] * H[1];
+            temp_loc = temp_loc / (m * kb * density);
+
+            for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+                if ( TAMask[i1*W1+i2] )  {
+                    p = Box[2] + i2 * H[1];
+                    feq = density * sqrt(1 / (2 * M_PI * m * kb * temp_loc)) * exp(-pow(p - m * velocity, 2) / (2 * m * kb * temp_loc));
+                    FF[i1*W1+i2] = (feq > 1 / (H[0] * H[1]) || !std::isfinite(feq)) ? 0 : feq;
+                }
+            }
+        }
+        Density[i1] = density;
+        Velocity[i1] = velocity;
+        Temperature[i1] = temp_loc;
+    }
+    return 4.0 * (x1_max - x1_min + 1) * (x2_max - x2_min + 1) + 40.0 * ta_size;
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::MomentsSpan()
+{
+    // One fused pass for the three sums, one for Feq_loc
+    #pragma omp parallel for schedule(dynamic,4)
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+
+        double s0 = 0.0, s1 = 0.0, s2 = 0.0, density, velocity = 0.0, temp_loc = 0.0, p, feq;
+
+        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
+                p = Box[2] + i2 * H[1];
+                s0 += F[i1*W1+i2];
+                s1 += p * F[i1*W1+i2];
+                s2 += p * p * F[i1*W1+i2];
+            }
+        }
+        density = s0 * H[1];
+
+        if ( density > 0.0 )  {
+            velocity = s1 / (m * s0);
+            temp_loc = (s2 - s1 * s1 / s0) / (m * kb * s0);
+
+            for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
+                    p = Box[2] + i2 * H[1];
+                    feq = density * sqrt(1 / (2 * M_PI * m * kb * temp_loc)) * exp(-pow(p - m * velocity, 2) / (2 * m * kb * temp_loc));
+                    FF[i1*W1+i2] = (feq > 1 / (H[0] * H[1]) || !std::isfinite(feq)) ? 0 : feq;
+                }
+            }
+        }
+        Density[i1] = density;
+        Velocity[i1] = velocity;
+        Temperature[i1] = temp_loc;
+    }
+    return 16.0 * ta_size + 8.0 * SpanLo.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::RebuildInterior()
+{
+    // As the solver: scan the whole interior
+    int a1 = BIG_NUMBER, b1 = -BIG_NUMBER, a2 = BIG_NUMBER, b2 = -BIG_NUMBER, n = 0;
+
+    #pragma omp parallel for reduction(min: a1, a2) reduction(max: b1, b2) reduction(+: n)
+    for (int i1 = EDGE; i1 < N1 - EDGE; i1 ++)  {
+        for (int i2 = EDGE; i2 < N2 - EDGE; i2 ++)  {
+            if ( TAMask[i1*W1+i2] )  {
+                if (i1 < a1)  a1 = i1;
+                if (i1 > b1)  b1 = i1;
+                if (i2 < a2)  a2 = i2;
+                if (i2 > b2)  b2 = i2;
+                n += 1;
+            }
+        }
+    }
+    x1_min = a1;  x1_max = b1;
+    x2_min = a2;  x2_max = b2;
+    ta_size = n;
+    return 1.0 * (N1 - 2 * EDGE) * (N2 - 2 * EDGE);
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::RebuildBox()
+{
+    // Only the previous box grown by one cell, which bounds the TA after
+    // one step of expansion
+    const int c1 = std::max(EDGE, x1_min - 1), d1 = std::min(N1 - EDGE - 1, x1_max + 1);
+    const int c2 = std::max(EDGE, x2_min - 1), d2 = std::min(N2 - EDGE - 1, x2_max + 1);
+    int a1 = BIG_NUMBER, b1 = -BIG_NUMBER, a2 = BIG_NUMBER, b2 = -BIG_NUMBER, n = 0;
+
+    #pragma omp parallel for reduction(min: a1, a2) reduction(max: b1, b2) reduction(+: n)
+    for (int i1 = c1; i1 <= d1; i1 ++)  {
+        for (int i2 = c2; i2 <= d2; i2 ++)  {
+            if ( TAMask[i1*W1+i2] )  {
+                if (i1 < a1)  a1 = i1;
+                if (i1 > b1)  b1 = i1;
+                if (i2 < a2)  a2 = i2;
+                if (i2 > b2)  b2 = i2;
+                n += 1;
+            }
+        }
+    }
+    x1_min = a1;  x1_max = b1;
+    x2_min = a2;  x2_max = b2;
+    ta_size = n;
+    return 1.0 * (d1 - c1 + 1) * (d2 - c2 + 1);
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::DetectMask()
+{
+    MeshIndex tmpVec;
+
+    #pragma omp parallel for reduction(merge: tmpVec)
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+            if ( TAMask[i1*W1+i2] )  {
+                if ( !TAMask[(i1-1)*W1+i2] || !TAMask[(i1+1)*W1+i2] ||
+                     !TAMask[i1*W1+(i2-1)] || !TAMask[i1*W1+(i2+1)] )
+                    tmpVec.push_back(i1*W1+i2);
+            }
+        }
+    }
+    tmpVec.swap(TB);
+    return 1.0 * (x1_max - x1_min + 1) * (x2_max - x2_min + 1) + 4.0 * TB.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::DetectSpan()
+{
+    // Run ends are TB by construction; inside a run only the x1
+    // neighbours need a look
+    MeshIndex tmpVec;
+
+    #pragma omp parallel for reduction(merge: tmpVec)
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
+                if ( i2 == SpanLo[sp] || i2 == SpanHi[sp] ||
+                     !TAMask[(i1-1)*W1+i2] || !TAMask[(i1+1)*W1+i2] )
+                    tmpVec.push_back(i1*W1+i2);
+            }
+        }
+    }
+    tmpVec.swap(TB);
+    return 2.0 * ta_size + 8.0 * SpanLo.size() + 4.0 * TB.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+double KernelBench::Extrapolate()
+{
+    // Targets: empty neighbours of TB, sorted and unique; values: the
+    // log-linear extrapolation of the solver, into ExTBL only so F is kept
+    MeshIndex tmpVec;
+
+    #pragma omp parallel for reduction(merge: tmpVec)
+    for (int i = 0; i < (int) TB.size(); i ++)  {
+        int g1 = TB[i] / W1;
+        int g2 = TB[i] % W1;
+        if ( g1-1 > EDGE && F[(g1-1)*W1+g2] == 0 )
+            tmpVec.push_back((g1-1)*W1+g2);
+        if ( g1+1 < N1-EDGE-1 && F[(g1+1)*W1+g2] == 0 )
+            tmpVec.push_back((g1+1)*W1+g2);
+        if ( g2-1 > EDGE && F[g1*W1+(g2-1)] == 0 )
+            tmpVec.push_back(g1*W1+(g2-1));
+        if ( g2+1 < N2-EDGE-1 && F[g1*W1+(g2+1)] == 0 )
+            tmpVec.push_back(g1*W1+(g2+1));
+    }
+    std::sort(tmpVec.begin(), tmpVec.end());
+    tmpVec.erase(std::unique(tmpVec.begin(), tmpVec.end()), tmpVec.end());
+    tmpVec.swap(ExFF);
+    ExTBL.resize(ExFF.size());
+
+    #pragma omp parallel for
+    for (int i = 0; i < (int) ExFF.size(); i ++)  {
+
+        const int step[4] = { -W1, W1, -1, 1 };
+        const int dir[4] = { 0, 0, 1, 1 };
+        double sum = 0.0, val, val_min_abs = BIG_NUMBER, val_min = BIG_NUMBER;
+        int count = 0, min_dir = -1;
+
+        for (int d = 0; d < 4; d ++)  {
+            double f1 = F[ExFF[i]+step[d]];
+            double f2 = F[ExFF[i]+2*step[d]];
+            if ( f1 != 0.0 && f2 != 0.0 )  {
+                if ( std::abs(f1) < val_min_abs )  {
+                    val_min_abs = std::abs(f1);
+                    val_min = f1;
+                    min_dir = dir[d];
+                }
+                val = exp(2.0 * std::log(f1) - std::log(f2));
+                if ( std::isfinite(val) )  {
+                    sum += val;
+                    count += 1;
+                }
+            }
+        }
+        if ( count == 0 )
+            ExTBL[i] = 0.0;
+        else if ( std::abs(sum / count) > val_min_abs )
+            ExTBL[i] = val_min * exp(-ExReduce * H[min_dir]);
+        else
+            ExTBL[i] = sum / count;
+    }
+    return 4.0 * TB.size() + (4.0 + 8.0 * 8 + 8.0) * ExFF.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    const int reps = ( argc > 1 ) ? std::max(1, atoi(argv[1])) : 20;
+    const std::string only = ( argc > 2 ) ? argv[2] : "";
+
+    printf("[KernelBench] Threads = %d, reps = %d\n", omp_get_max_threads(), reps);
+    printf("%-7s %-9s %5s  %-11s %-8s %9s %10s %10s %8s\n",
+           "shape", "grid", "fill", "kernel", "variant", "cells", "ms", "Mcells/s", "GB/s");
+
+    for (int s = 0; s < SHAPES; s ++)  {
+
+        if ( only.length() > 0 && only != Shapes[s].name )
+            continue;
+
+        KernelBench bench(Shapes[s].n1, Shapes[s].n2);
+
+        for (unsigned int f = 0; f < sizeof(Fills) / sizeof(Fills[0]); f ++)  {
+            bench.Mask(s, Fills[f]);
+            bench.Run(Shapes[s].name, Fills[f], reps);
+        }
+    }
+    return 0;
+}
+/* ------------------------------------------------------------------------------- */
@@ -24,9 +24,13 @@
 
 #include "Constants.h"
 #include "Containers.h"
+#include "EnergyMeter.h"
 #include "Error.h"
 #include "Log.h"
+#include "OutOfCore.h"
 #include "Parameters.h"
+#include "SpectralShift.h"
+#include "TimingLog.h"
 #include "Diosi2d.h"
 
 using namespace QTR_NS;
@@ -136,10 +140,13 @@ void Diosi2d::init()
     PERIOD = parameters->scxd_period;
     SORT_PERIOD = parameters->scxd_sortperiod;
     PRINT_PERIOD = parameters->scxd_printperiod;
+    TELEMETRY_PERIOD = parameters->scxd_telemetryperiod;
     PRINT_WAVEFUNC_PERIOD = parameters->scxd_printwavefuncperiod;
     TIME = parameters->scxd_Tf;
     QUIET = parameters->quiet;
     TIMING = parameters->timing;
+    TIMING_LOG = parameters->scxd_timinglog;
+    ENERGY = parameters->scxd_energy;
     isTrans = parameters->scxd_isTrans;
     isCorr = parameters->scxd_isAcf;
     isModCL = parameters->scxd_isModCL;
@@ -151,49 +158,34 @@ void Diosi2d::init()
     isPrintLocalTemperature = parameters->scxd_isPrintLocalTemperature;
     isPrintWavefunc = parameters->scxd_isPrintWavefunc;
     isDensityMatrix = parameters->scxd_isDensityMatrix;
+    isDMEngine = parameters->scxd_isDMEngine;
 
     // Condition for Local Maxwellian
     isIsothermal = parameters->scxd_isIsothermal;
     isLinearizedCollision = parameters->scxd_isLinearizedCollision;
+    isConservative = parameters->scxd_isConservative;
 
-    // Grid size
-    H.resize(DIMENSIONS);
-    Hi.resize(DIMENSIONS);
-    Hisq.resize(DIMENSIONS);
-    S.resize(DIMENSIONS);  
-    kk = parameters->scxd_k;
-    H[0] = parameters->scxd_h1;
-    H[1] = parameters->scxd_h2;
-
-    for (int i = 0; i < DIMENSIONS; i ++)  {
-        Hi[i] = 1 / H[i];
-        Hisq[i] = 1 / pow(H[i],2);
-        S[i] = kk * Hisq[i];
-    }
+    if ( isConservative && ( isDampX1 || isDampX2 ) )
+        log->log("[Diosi2d] Conservative full grid: renormalized only on absorbing-layer steps\n");
+    else if ( isConservative )
+        log->log("[Diosi2d] Conservative full grid: no per-step renormalization\n");
 
-    // Domain size and # grids
+    // Domain size
     Box.resize(DIMENSIONS * 2);
     Box[0] = parameters->scxd_xi1;
     Box[1] = parameters->scxd_xf1;
     Box[2] = parameters->scxd_xi2;
     Box[3] = parameters->scxd_xf2; 
-    BoxShape.resize(DIMENSIONS);
-    GRIDS_TOT = 1;
-    log->log("[Diosi2d] Number of grids = (");
-
-    for (int i = 0; i < DIMENSIONS; i ++)  {
 
-        BoxShape[i] = (int)std::round((Box[2 * i + 1] - Box[2 * i]) / H[i]) + 1;
-        GRIDS_TOT *= BoxShape[i];
+    // Grid sequencing
+    ML_LEVELS = parameters->scxd_mlevels;
+    ML_PERIOD = parameters->scxd_mlperiod;
+    ML_TOL = parameters->scxd_mltol;
+    ML_LEVEL = 0;
+    ML_T = 0.0;
 
-        if ( i < DIMENSIONS - 1 )
-            log->log("%d, ", BoxShape[i]);
-        else
-            log->log("%d)\n", BoxShape[i]);
-    }
-    M1 = BoxShape[1];
-    W1 = BoxShape[1];
-    O1 = BoxShape[0] * BoxShape[1];
+    // Grid size and # grids
+    SetGrid(0);
 
     // Parameters
     hb = parameters->scxd_hb;
@@ -219,6 +211,15 @@ void Diosi2d::init()
 
     // Truncate parameters
     isFullGrid = parameters->scxd_isFullGrid;
+    isAutoGrid = parameters->scxd_isAutoGrid;
+    AUTO_GRID_PERIOD = parameters->scxd_autogridperiod;
+    OOC_DIR = parameters->scxd_oocdir;
+    OOC_SLAB = parameters->scxd_oocslab;
+    isSpectralX = parameters->scxd_isSpectralX && isFullGrid && !isAutoGrid;
+    MR_RATIO = parameters->scxd_mrratio;
+    MR_CFL = parameters->scxd_mrcfl;
+    isMultirate = MR_RATIO > 1 && isFullGrid && !isAutoGrid && !isSpectralX && !isConservative && ML_LEVELS <= 0;
+    AutoGridThreshold = parameters->scxd_AutoGridThreshold; // Relative predicted gain required to switch
     TolH = parameters->scxd_TolH;    // Tolerance of probability density for Zero point Cutoff
     TolL = parameters->scxd_TolL;    // Tolerance of probability density for Edge point
     TolHd = parameters->scxd_TolHd;  // Tolerance of probability first diff for Zero point Cutoff
@@ -228,18 +229,283 @@ void Diosi2d::init()
 
     // Transition position
     trans_x0 = parameters->scxd_trans_x0;
-    idx_x0 = (int) std::round( ( trans_x0 - Box[0] ) / H[0] );
+
+    if ( ML_LEVELS > 0 )
+        log->log("[Diosi2d] Grid sequencing: %d coarse level(s), check period %d, tol %.2e\n", ML_LEVELS, ML_PERIOD, ML_TOL);
+
+
+    if ( isDMEngine )
+        log->log("[Diosi2d] Density-matrix engine: split-operator rho(x1,x1')\n");
+
+    if ( isSpectralX )
+        log->log("[Diosi2d] Spectral x1 streaming (Strang split)\n");
+    else if ( parameters->scxd_isSpectralX )
+        log->log("[Diosi2d] Spectral x1 streaming needs a fixed full grid, using finite differences\n");
+
+    // Between window ends the slow rows still sit at the window start, so
+    // every report that fires before the last step has to fall on a window end
+    int mr_nsteps = (int)(TIME / parameters->scxd_k);
+    int mr_report[4] = {PERIOD, PRINT_PERIOD, TELEMETRY_PERIOD, isPrintWavefunc ? PRINT_WAVEFUNC_PERIOD : 0};
+    bool isMultirateAligned = true;
+
+    for (int n = 0; n < 4 && MR_RATIO > 1; n ++)
+        if ( mr_report[n] > 0 && mr_report[n] < mr_nsteps && mr_report[n] % MR_RATIO != 0 )
+            isMultirateAligned = false;
+
+    if ( isMultirate && !isMultirateAligned )  {
+        isMultirate = false;
+        log->log("[Diosi2d] Multirate needs period, printperiod, telemetryperiod and printwavefuncperiod in multiples of mrratio (%d)\n", MR_RATIO);
+    }
+    else if ( isMultirate )
+        log->log("[Diosi2d] Multirate x1 rows: ratio %d, slow rows at k * rate <= %.3lf\n", MR_RATIO, MR_CFL);
+    else if ( MR_RATIO > 1 )
+        log->log("[Diosi2d] Multirate needs a fixed full grid without spectral streaming, conservative form or grid sequencing\n");
+
+    if ( OOC_DIR.length() > 0 && ( !isFullGrid || isAutoGrid || isSpectralX || isMultirate || isDMEngine ) )  {
+        log->log("[Diosi2d] Out-of-core streaming needs a fixed finite-difference full grid without multirate rows, arrays stay in memory\n");
+        OOC_DIR = "";
+    }
+    else if ( OOC_DIR.length() > 0 )
+        log->log("[Diosi2d] Out-of-core directory: %s, slab = %d rows\n", OOC_DIR.c_str(), OOC_SLAB);
 
     log->log("[Diosi2d] INIT done.\n\n");
 }
 /* ------------------------------------------------------------------------------- */
 
+void Diosi2d::SetGrid(int level)
+{
+    // Level L coarsens h1, h2 and k by 2^L
+    double scale = (double)(1 << level);
+
+    ML_LEVEL = level;
+
+    // Grid size
+    H.resize(DIMENSIONS);
+    Hi.resize(DIMENSIONS);
+    Hisq.resize(DIMENSIONS);
+    S.resize(DIMENSIONS);  
+    kk = parameters->scxd_k * scale;
+    H[0] = parameters->scxd_h1 * scale;
+    H[1] = parameters->scxd_h2 * scale;
+
+    for (int i = 0; i < DIMENSIONS; i ++)  {
+        Hi[i] = 1 / H[i];
+        Hisq[i] = 1 / pow(H[i],2);
+        S[i] = kk * Hisq[i];
+    }
+
+    // # grids
+    BoxShape.resize(DIMENSIONS);
+    GRIDS_TOT = 1;
+    log->log("[Diosi2d] Number of grids = (");
+
+    for (int i = 0; i < DIMENSIONS; i ++)  {
+
+        BoxShape[i] = (int)std::round((Box[2 * i + 1] - Box[2 * i]) / H[i]) + 1;
+        GRIDS_TOT *= BoxShape[i];
+
+        if ( i < DIMENSIONS - 1 )
+            log->log("%d, ", BoxShape[i]);
+        else
+            log->log("%d)\n", BoxShape[i]);
+    }
+    M1 = BoxShape[1];
+    W1 = BoxShape[1];
+    O1 = BoxShape[0] * BoxShape[1];
+
+    // Transition position
+    idx_x0 = (int) std::round( ( parameters->scxd_trans_x0 - Box[0] ) / H[0] );
+
+    // Domains of the previous level
+    TA.clear();
+    TB.clear();
+    TBL.clear();
+    TBL_P.clear();
+    ExFF.clear();
+    ExFF2.clear();
+}
+/* ------------------------------------------------------------------------------- */
+
 void Diosi2d::Evolve()
+{
+    int n0c, n1c;
+    double h1c;
+    double t_left;
+    double t_level;
+
+    if ( isDMEngine )  {
+        EvolveDM();
+        return;
+    }
+
+    if ( ML_LEVELS <= 0 )  {
+        EvolveGrid(0.0);
+        return;
+    }
+
+    // Coarse levels only report to the log
+    bool isPrintEdge_0 = isPrintEdge;
+    bool isPrintLocalDensity_0 = isPrintLocalDensity;
+    bool isPrintDriftVelocity_0 = isPrintDriftVelocity;
+    bool isPrintLocalTemperature_0 = isPrintLocalTemperature;
+    bool isPrintWavefunc_0 = isPrintWavefunc;
+    bool isFullGrid_0 = isFullGrid;
+    double TIME_0 = TIME;
+
+    t_left = TIME_0;
+    ML_F.clear();
+
+    for (int level = ML_LEVELS; level >= 0; level --)  {
+
+        n0c = BoxShape[0];
+        n1c = BoxShape[1];
+        h1c = H[1];
+
+        SetGrid(level);
+
+        if ( !ML_F.empty() )
+            Prolong(n0c, n1c, h1c);
+
+        // Each coarse level gets at most half of the remaining time
+        t_level = ( level > 0 ) ? 0.5 * t_left : t_left;
+        TIME = t_level;
+        isFullGrid = isFullGrid_0;
+        isPrintEdge = ( level == 0 ) && isPrintEdge_0;
+        isPrintLocalDensity = ( level == 0 ) && isPrintLocalDensity_0;
+        isPrintDriftVelocity = ( level == 0 ) && isPrintDriftVelocity_0;
+        isPrintLocalTemperature = ( level == 0 ) && isPrintLocalTemperature_0;
+        isPrintWavefunc = ( level == 0 ) && isPrintWavefunc_0;
+
+        log->log("[Diosi2d] Level %d: h1 = %.6e, h2 = %.6e, k = %.6e, start time = %lf\n", level, H[0], H[1], kk, TIME_0 - t_left);
+
+        EvolveGrid(TIME_0 - t_left);
+
+        t_left -= ML_T;
+        log->log("[Diosi2d] Level %d done at time %lf\n", level, TIME_0 - t_left);
+    }
+    TIME = TIME_0;
+    ML_F.clear();
+    ML_Moments.clear();
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::Prolong(int n0c, int n1c, double h1c)
+{
+    // Separable 4-point Lagrange interpolation from the previous level.
+    // x1 is periodic and mapped by period fraction; x2 beyond the grid is 0.
+    // Negative overshoots are clipped and the result rescaled to the coarse mass.
+    std::vector<double> Fc;
+    double mass_c = 0.0;
+    double mass_f = 0.0;
+    double h0c = H[0] * BoxShape[0] / n0c;
+
+    Fc.swap(ML_F);
+    ML_F.assign(O1, 0.0);
+
+    for (int i = 0; i < n0c * n1c; i ++)
+        mass_c += Fc[i];
+    mass_c *= h0c * h1c;
+
+    #pragma omp parallel for reduction(+: mass_f)
+    for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+
+        double s1 = (double) i1 * n0c / BoxShape[0];
+        int j1 = (int) floor(s1);
+        double t1 = s1 - j1;
+        double w1[4] = { -t1 * (t1 - 1) * (t1 - 2) / 6.0,  (t1 + 1) * (t1 - 1) * (t1 - 2) / 2.0,
+                         -(t1 + 1) * t1 * (t1 - 2) / 2.0,  (t1 + 1) * t1 * (t1 - 1) / 6.0 };
+
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+
+            double s2 = i2 * H[1] / h1c;
+            int j2 = (int) floor(s2);
+            double t2 = s2 - j2;
+            double w2[4] = { -t2 * (t2 - 1) * (t2 - 2) / 6.0,  (t2 + 1) * (t2 - 1) * (t2 - 2) / 2.0,
+                             -(t2 + 1) * t2 * (t2 - 2) / 2.0,  (t2 + 1) * t2 * (t2 - 1) / 6.0 };
+            double val = 0.0;
+
+            for (int a = 0; a < 4; a ++)  {
+                int c1 = ( ( j1 - 1 + a ) % n0c + n0c ) % n0c;
+                for (int b = 0; b < 4; b ++)  {
+                    int c2 = j2 - 1 + b;
+                    if ( c2 >= 0 && c2 < n1c )
+                        val += w1[a] * w2[b] * Fc[c1*n1c+c2];
+                }
+            }
+            val = ( val > 0.0 ) ? val : 0.0;
+            ML_F[i1*W1+i2] = val;
+            mass_f += val;
+        }
+    }
+    mass_f *= H[0] * H[1];
+
+    if ( mass_f > 0.0 )  {
+        #pragma omp parallel for
+        for (int i = 0; i < O1; i ++)
+            ML_F[i] *= mass_c / mass_f;
+    }
+    log->log("[Diosi2d] Prolongation (%d, %d) -> (%d, %d), mass %.16e -> %.16e\n", n0c, n1c, BoxShape[0], BoxShape[1], mass_c, mass_f);
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::BuildSpans(const bool *TAMask, int x1_min, int x1_max, int x2_min, int x2_max)
+{
+    // Runs of active x2 cells of each row in the TA box. Row i1 owns runs
+    // SpanPtr[i1] <= sp < SpanPtr[i1+1], each covering SpanLo[sp]..SpanHi[sp].
+    // Rows outside [x1_min, x1_max] own none.
+    int nspans;
+
+    SpanPtr.assign(BoxShape[0] + 1, 0);
+
+    #pragma omp parallel for
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        const bool *mask = TAMask + i1 * W1;
+        int count = 0;
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)
+            count += mask[i2] && (i2 == x2_min || !mask[i2-1]);
+        SpanPtr[i1+1] = count;
+    }
+    for (int i1 = 0; i1 < BoxShape[0]; i1 ++)
+        SpanPtr[i1+1] += SpanPtr[i1];
+
+    nspans = SpanPtr[BoxShape[0]];
+    SpanLo.resize(nspans);
+    SpanHi.resize(nspans);
+
+    #pragma omp parallel for
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        const bool *mask = TAMask + i1 * W1;
+        int sp = SpanPtr[i1];
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+            if ( mask[i2] && (i2 == x2_min || !mask[i2-1]) )
+                SpanLo[sp] = i2;
+            if ( mask[i2] && (i2 == x2_max || !mask[i2+1]) )
+                SpanHi[sp++] = i2;
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::EvolveGrid(double t0)
 {
     #pragma omp declare reduction (merge : MeshIndex : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
 
     log->log("[Diosi2d] Evolve starts ...\n");
 
+    // RAPL package and DRAM energy, read around the initialization, the
+    // time iteration and each PERIOD
+    EnergyMeter meter;
+    double energy_iter = 0.0;
+    double energy_period = 0.0;
+    double cell_updates = 0.0;
+
+    if ( ENERGY )  {
+        if ( meter.open() > 0 )
+            log->log("[Diosi2d] Energy counters: %s\n", meter.zones().c_str());
+        else
+            log->log("[Diosi2d] Energy counters unavailable, no energy report\n");
+    }
+
     // Files
     FILE *pfile;
     FILE *pfile_density;
@@ -272,6 +538,9 @@ void Diosi2d::Evolve()
     // Knudsen number for position-dependent collision frequency
     double knudsen;
 
+    // Conservative form: Feq scale of the current stage, row sum of the stage
+    double fscale, ksum;
+
     // Timing variables
     double t_0_begin, t_0_end;
     double t_1_begin, t_1_end;
@@ -285,6 +554,21 @@ void Diosi2d::Evolve()
     // Overhead time (truncate)
     double t_overhead = 0.0;
 
+    // Automatic grid switching (accumulated over AUTO_GRID_PERIOD steps)
+    // TG loops sweep the whole TA box, so the box area is the work measure.
+    int auto_steps = 0;
+    int ta_est;
+    int n_interior = BoxShape[0] * (BoxShape[1] - 2 * EDGE);
+    double auto_points = 0.0;  // sum of active grid points per step
+    double core_points = 0.0;  // sum of active grid points per moment and RK4 update
+    double norm_points = 0.0;  // sum of active grid points per normalization
+    double t_auto_begin;
+    double t_auto_step = 0.0;
+    double t_auto_core = 0.0;
+    double t_auto_norm = 0.0;
+    double t_auto_ovh = -1.0;  // TG overhead per TA point, < 0 if not measured yet
+    double c_core, c_norm, cost_tg, cost_fg;
+
     // Constants
     double kh0m = kk / (H[0] * m);
     double k2h1 = kk / H[1];
@@ -305,6 +589,9 @@ void Diosi2d::Evolve()
     log->log("[Diosi2d] Dqq = %.8lf\n",Dqq);
     log->log("[Diosi2d] Dpq = %.8lf\n",Dpq);
 
+    if ( isMultirate )
+        MultirateSetup();
+
     // temporary index container
     MeshIndex tmpVec; 
 
@@ -337,6 +624,11 @@ void Diosi2d::Evolve()
     //VectorXi Check;
     //VectorXd ExTBL;
     int Excount;
+    int tbl_points, ex_points;     // TBL and extrapolated points handled this step
+    double mass_step = 0.0;        // mass before renormalization
+    bool isDampStep = false;       // absorbing layers applied on the full grid this step
+    double mass_cut, mass_ex;      // mass dropped by truncation, added by extrapolation
+    FILE *pfile_telemetry = NULL;
 
     // Neighborlist
     int nneigh = 0;
@@ -356,21 +648,37 @@ void Diosi2d::Evolve()
 
     bool *TAMask;
 
-    if ( !isFullGrid ) 
+    if ( !isFullGrid || isAutoGrid ) 
         TAMask = new bool[O1];
     
-    double *F = new double[O1];
-    double *Feq_loc = new double[O1];
-    double *FF = new double[O1];
-    double *PF = new double[O1];
-    double *KK1 = new double[O1];
-    double *KK2 = new double[O1];
-    double *KK3 = new double[O1];
-    double *KK4 = new double[O1];
+    // Grid arrays, memory-mapped when out of core
+    OutOfCore ooc;
+    ooc.open(OOC_DIR, BoxShape[0], W1, OOC_SLAB, 2);
+
+    double *F = ooc.alloc(O1);
+    double *Feq_loc = ooc.alloc(O1);
+    double *FF = ooc.alloc(O1);
+    double *PF = ooc.alloc(O1);
+    double *KK1 = ooc.alloc(O1);
+    double *KK2 = ooc.alloc(O1);
+    double *KK3 = ooc.alloc(O1);
+    double *KK4 = ooc.alloc(O1);
+
+    if ( ooc.isEnabled() )
+        log->log("[Diosi2d] Out-of-core: %d arrays mapped\n", ooc.mapped());
+
+    // x1 streaming operator of the current grid
+    SpectralShift spectral;
+
+    if ( isSpectralX )
+        spectral.init(BoxShape[0], H[0]);
 
     double *Density = new double[BoxShape[0]];
     double *Velocity = new double[BoxShape[0]];
     double *Temperature = new double[BoxShape[0]];
+    double *RowF = new double[BoxShape[0]];       // row sums of F
+    double *RowFeqInv = new double[BoxShape[0]];  // inverse row sums of Feq
+    double *RowK = new double[BoxShape[0]];       // row sums of the last RK4 stage
 
     double *F0;
     double *Ft;
@@ -408,7 +716,7 @@ void Diosi2d::Evolve()
         Temperature[i1] = 0.0;
     }
 
-    if ( !isFullGrid )  {
+    if ( !isFullGrid || isAutoGrid )  {
 
         t_1_begin = omp_get_wtime();
         
@@ -460,11 +768,21 @@ void Diosi2d::Evolve()
 
     t_1_begin = omp_get_wtime();
 
-    // Initialize wavefunction
-    #pragma omp parallel for
-    for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE ; i2 ++)  {
-            F[i1*W1+i2] = WAVEFUNCTION(Box[0]+i1*H[0], Box[2]+i2*H[1]);
+    // Initialize wavefunction, or continue from the previous grid level
+    if ( !ML_F.empty() )  {
+        #pragma omp parallel for
+        for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE ; i2 ++)  {
+                F[i1*W1+i2] = ML_F[i1*W1+i2];
+            }
+        }
+    }
+    else  {
+        #pragma omp parallel for
+        for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE ; i2 ++)  {
+                F[i1*W1+i2] = WAVEFUNCTION(Box[0]+i1*H[0], Box[2]+i2*H[1]);
+            }
         }
     }
 
@@ -490,13 +808,14 @@ void Diosi2d::Evolve()
         }
     }
 
-    // Initial density
+    // Initial density, taken from the t = 0 state on this grid also when a
+    // coarser level has handed down a later one
     if ( isCorr )   {
         #pragma omp parallel for private(density)
         for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
             density = 0.0;
             for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                density += PF[i1*W1+i2]; 
+                density += ( ML_F.empty() ) ? PF[i1*W1+i2] : WAVEFUNCTION(Box[0]+i1*H[0], Box[2]+i2*H[1]);
             }
             F0[i1] = density * H[1];
         }
@@ -509,7 +828,9 @@ void Diosi2d::Evolve()
         corr_0 = corr_0 * H[0];
 
         log->log("[Diosi2d] corr_0 = %.16e\n",corr_0);
-        log->log("[Diosi2d] Time %lf, Corr = %.16e\n",0.0,1.0);
+
+        if ( ML_F.empty() )
+            log->log("[Diosi2d] Time %lf, Corr = %.16e\n",0.0,1.0);
     }
 
     t_1_end = omp_get_wtime();
@@ -840,6 +1161,21 @@ void Diosi2d::Evolve()
     }
     // .........................................................................................
 
+    // Per-region timing lines go through a buffer, off the timed regions
+    TimingLog tlog;
+
+    if ( !QUIET && TIMING )  {
+        tlog.open(log, TIMING_LOG, omp_get_max_threads(), 4096);
+        if ( TIMING_LOG.length() > 0 )
+            log->log("[Diosi2d] Timing lines go to %s\n", TIMING_LOG.c_str());
+    }
+
+    if ( meter.isEnabled() )  {
+        meter.update();
+        energy_iter = meter.total();
+        energy_period = energy_iter;
+    }
+
     // Time iteration 
 
     log->log("=======================================================\n\n"); 
@@ -847,10 +1183,27 @@ void Diosi2d::Evolve()
     log->log("[Diosi2d] Number of steps = %d\n\n", (int)(TIME / kk)); 
     log->log("=======================================================\n\n"); 
 
+    ML_T = (int)(TIME / kk) * kk;
+    ML_Moments.clear();
+
+    if ( TELEMETRY_PERIOD > 0 )  {
+        pfile_telemetry = fopen("telemetry.csv", "w");
+        if ( pfile_telemetry == NULL )
+            log->log("[Diosi2d] Cannot open telemetry.csv\n");
+        else
+            fprintf(pfile_telemetry, "step,time,fullgrid,ta_size,tb_size,tbl_points,ex_points,"
+                                     "x1_min,x1_max,x2_min,x2_max,excount,mass,mass_cut,mass_ex,"
+                                     "t_core,t_overhead,t_step\n");
+    }
+
     for (int tt = 0; tt < (int)(TIME / kk); tt ++)
     {
         t_0_begin = omp_get_wtime(); 
         Excount = 0;
+        tbl_points = 0;
+        ex_points = 0;
+        mass_cut = 0.0;
+        mass_ex = 0.0;
 
         if ( isPrintWavefunc && tt % PRINT_WAVEFUNC_PERIOD == 0 )
         {
@@ -867,9 +1220,13 @@ void Diosi2d::Evolve()
             }
             else  {
                 fprintf(pfile, "%d %d\n", tt, GRIDS_TOT);
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        fprintf(pfile, "%d %d %.8e\n", i1, i2, F[i1*W1+i2]);
+                for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0]);
+                    ooc.Stream(s1, BoxShape[0], {F});
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            fprintf(pfile, "%d %d %.8e\n", i1, i2, F[i1*W1+i2]);
+                        }
                     }
                 }
             }
@@ -881,7 +1238,7 @@ void Diosi2d::Evolve()
             if ( isPrintEdge  && !isFullGrid )  {
 
                 pfile = fopen ("edge.dat","a");
-                fprintf(pfile, "%d %lf %lu\n", tt, tt * kk, TB.size());
+                fprintf(pfile, "%d %lf %lu\n", tt, t0 + tt * kk, TB.size());
 
                 for (int i = 0; i < TB.size(); i++)
                 {
@@ -898,7 +1255,7 @@ void Diosi2d::Evolve()
                 // Print Local Density.
                 if (isPrintLocalDensity)  {
                     pfile_density = fopen ("density.dat","a");
-                    fprintf(pfile_density, "%d %lf %lu\n", tt, tt * kk, (unsigned long int)((x1_max-x1_min+1)));
+                    fprintf(pfile_density, "%d %lf %lu\n", tt, t0 + tt * kk, (unsigned long int)((x1_max-x1_min+1)));
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                         xx1 = Box[0] + i1 * H[0];
                         fprintf(pfile_density, "%.4f %.16e\n", xx1, Density[i1]);
@@ -908,7 +1265,7 @@ void Diosi2d::Evolve()
                 // Print Drift Velocity.
                 if (isPrintDriftVelocity)  {
                     pfile_velocity = fopen ("driftvelocity.dat","a");
-                    fprintf(pfile_velocity, "%d %lf %lu\n", tt, tt * kk, (unsigned long int)((x1_max-x1_min+1)));
+                    fprintf(pfile_velocity, "%d %lf %lu\n", tt, t0 + tt * kk, (unsigned long int)((x1_max-x1_min+1)));
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                         xx1 = Box[0] + i1 * H[0];
                         fprintf(pfile_velocity, "%.4f %.16e\n", xx1, Velocity[i1]);
@@ -918,7 +1275,7 @@ void Diosi2d::Evolve()
                 // Print Local Temperature.
                 if (isPrintLocalTemperature)  {
                     pfile_temperature = fopen ("localtemperature.dat","a");
-                    fprintf(pfile_temperature, "%d %lf %lu\n", tt, tt * kk, (unsigned long int)((x1_max-x1_min+1)));
+                    fprintf(pfile_temperature, "%d %lf %lu\n", tt, t0 + tt * kk, (unsigned long int)((x1_max-x1_min+1)));
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                         xx1 = Box[0] + i1 * H[0];
                         fprintf(pfile_temperature, "%.4f %.16e\n", xx1, Temperature[i1]);
@@ -931,7 +1288,7 @@ void Diosi2d::Evolve()
                 // Print Local Density.
                 if (isPrintLocalDensity)  {
                     pfile_density = fopen ("density.dat","a");
-                    fprintf(pfile_density, "%d %lf %d\n", tt, tt * kk, BoxShape[0]);
+                    fprintf(pfile_density, "%d %lf %d\n", tt, t0 + tt * kk, BoxShape[0]);
                     for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
                         xx1 = Box[0] + i1 * H[0];
                         fprintf(pfile_density, "%.4f %.16e\n", xx1, Density[i1]);
@@ -941,7 +1298,7 @@ void Diosi2d::Evolve()
                 // Print Drift Velocity.
                 if (isPrintDriftVelocity)  {
                     pfile_velocity = fopen ("driftvelocity.dat","a");
-                    fprintf(pfile_velocity, "%d %lf %d\n", tt, tt * kk, BoxShape[0]);
+                    fprintf(pfile_velocity, "%d %lf %d\n", tt, t0 + tt * kk, BoxShape[0]);
                     for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
                         xx1 = Box[0] + i1 * H[0];
                         fprintf(pfile_velocity, "%.4f %.16e\n", xx1, Velocity[i1]);
@@ -951,7 +1308,7 @@ void Diosi2d::Evolve()
                 // Print Local Temperature.
                 if (isPrintLocalTemperature)  {
                     pfile_temperature = fopen ("localtemperature.dat","a");
-                    fprintf(pfile_temperature, "%d %lf %d\n", tt, tt * kk, BoxShape[0]);
+                    fprintf(pfile_temperature, "%d %lf %d\n", tt, t0 + tt * kk, BoxShape[0]);
                     for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
                         xx1 = Box[0] + i1 * H[0];
                         fprintf(pfile_temperature, "%.4f %.16e\n", xx1, Temperature[i1]);
@@ -963,7 +1320,7 @@ void Diosi2d::Evolve()
             /*if ( isPrintDensity && !isFullGrid )  {
 
                 pfile = fopen ("density.dat","a");
-                fprintf(pfile, "%d %lf %d\n", tt, tt * kk, ta_size);
+                fprintf(pfile, "%d %lf %d\n", tt, t0 + tt * kk, ta_size);
 
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
@@ -979,7 +1336,7 @@ void Diosi2d::Evolve()
             if ( isPrintDensity && isFullGrid )  {
 
                 pfile = fopen ("density.dat","a");
-                fprintf(pfile, "%d %lf %d\n", tt, tt * kk, BoxShape[0] * BoxShape[1] );
+                fprintf(pfile, "%d %lf %d\n", tt, t0 + tt * kk, BoxShape[0] * BoxShape[1] );
 
                 for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
@@ -996,7 +1353,7 @@ void Diosi2d::Evolve()
             if ( isDensityMatrix )  {
 
                 pfile = fopen ("dmatrix.dat","a");
-                fprintf(pfile, "%d %lf %d\n", tt, tt * kk, BoxShape[0] * BoxShape[0] );
+                fprintf(pfile, "%d %lf %d\n", tt, t0 + tt * kk, BoxShape[0] * BoxShape[0] );
 
                 for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
                     for (int i2 = 0; i2 < BoxShape[0]; i2 ++)  {
@@ -1040,7 +1397,84 @@ void Diosi2d::Evolve()
                     sum += F[i1*W1+i2] * (0.5 * xx2 * xx2 / m + POTENTIAL(xx1,xx2));
                 }
             }
-            log->log("[Diosi2d] Time %lf, <E> = %.16e cm^-1\n", tt * kk, sum * H[0] * H[1] / WN_TO_HARTREE );
+            log->log("[Diosi2d] Time %lf, <E> = %.16e cm^-1\n", t0 + tt * kk, sum * H[0] * H[1] / WN_TO_HARTREE );
+        }
+
+        // Automatic grid switching: compare the measured cost per step of the
+        // current mode with the cost predicted for the other one
+
+        if ( isAutoGrid && auto_steps >= AUTO_GRID_PERIOD && core_points > 0.0 )
+        {
+            c_core = t_auto_core / core_points;  // moment and RK4 cost per active grid point
+            c_norm = ( norm_points > 0.0 ) ? t_auto_norm / norm_points : 0.0;
+
+            if ( !isFullGrid )  {
+
+                cost_tg = t_auto_step / auto_steps;
+                cost_fg = ( c_core + c_norm ) * n_interior;
+                t_auto_ovh = std::max(cost_tg * auto_steps / auto_points - c_core, 0.0);
+
+                if ( cost_tg > (1.0 + AutoGridThreshold) * cost_fg )  {
+
+                    // F is already zero outside TA
+                    isFullGrid = true;
+                    TB.clear();
+                    log->log("[Diosi2d] Step: %d, switching to full grid (TG %.4e sec/step, FG predicted %.4e sec/step)\n", tt, cost_tg, cost_fg);
+                }
+            }
+            else  {
+
+                x1_min = BoxShape[0];
+                x2_min = BoxShape[1];
+                x1_max = -1;
+                x2_max = -1;
+
+                #pragma omp parallel for reduction(min: x1_min, x2_min) reduction(max: x1_max, x2_max) schedule(runtime)
+                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                        if (std::abs(PF[i1*W1+i2]) >= TolH)  {
+                            if (i1 < x1_min)  x1_min = i1;
+                            if (i1 > x1_max)  x1_max = i1;
+                            if (i2 < x2_min)  x2_min = i2;
+                            if (i2 > x2_max)  x2_max = i2;
+                        }
+                    }
+                }
+                ta_est = (x1_max < 0) ? 0 : (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+                cost_fg = t_auto_step / auto_steps;
+                cost_tg = ta_est * (c_core + ((t_auto_ovh < 0.0) ? c_core : t_auto_ovh));
+
+                if ( cost_fg > (1.0 + AutoGridThreshold) * cost_tg )  {
+
+                    // Start from the whole interior and let the truncation
+                    // at the end of this step prune it.
+                    #pragma omp parallel for schedule(runtime)
+                    for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                            TAMask[i1*W1+i2] = (i2 > EDGE && i2 < BoxShape[1]-EDGE-1);
+                            if (!TAMask[i1*W1+i2])  {
+                                F[i1*W1+i2] = 0.0;
+                                PF[i1*W1+i2] = 0.0;
+                            }
+                        }
+                    }
+                    x1_min = 0;
+                    x2_min = EDGE + 1;
+                    x1_max = BoxShape[0] - 1;
+                    x2_max = BoxShape[1] - EDGE - 2;
+                    ta_size = (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+                    TB.clear();
+                    isFullGrid = false;
+                    log->log("[Diosi2d] Step: %d, switching to truncated grid (FG %.4e sec/step, TG predicted %.4e sec/step)\n", tt, cost_fg, cost_tg);
+                }
+            }
+            auto_steps = 0;
+            auto_points = 0.0;
+            core_points = 0.0;
+            norm_points = 0.0;
+            t_auto_step = 0.0;
+            t_auto_core = 0.0;
+            t_auto_norm = 0.0;
         }
 
         // Check if TB of f is higher than TolL
@@ -1086,7 +1520,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-a-1: TBL) = %lf sec\n", t_1_elapsed);   
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-a-1: TBL) = %lf sec\n", t_1_elapsed);   
             //if (!QUIET) log->log("TBL size = %d TBL_P size = %d\n", TBL.size(), TBL_P.size());
         }
         else  
@@ -1112,6 +1546,7 @@ void Diosi2d::Evolve()
             __gnu_parallel::sort(TBL.begin(),TBL.end());
             it = std::unique (TBL.begin(), TBL.end()); 
             TBL.resize(std::distance(TBL.begin(),it)); 
+            tbl_points += TBL.size();
 
             // Find extrapolation target
             // ExFF: Index of Extrapolated points
@@ -1164,7 +1599,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-b-1: ExFF) = %lf sec\n", t_1_elapsed);   
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-1: ExFF) = %lf sec\n", t_1_elapsed);   
 
             // .....................................................................
 
@@ -1340,11 +1775,13 @@ void Diosi2d::Evolve()
                 g1 = (int)(ExFF[i] / M1);
                 g2 = (int)(ExFF[i] % M1);
                 F[g1*W1+g2] = ExTBL[i];
+                mass_ex += ExTBL[i];
             }
+            ex_points += ExFF.size();
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-b-2: ExFF) = %lf sec\n", t_1_elapsed);  
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-2: ExFF) = %lf sec\n", t_1_elapsed);  
 
             // ............................................................................................. Extrapolation
 
@@ -1401,7 +1838,12 @@ void Diosi2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-c-1: CASE 1 TA) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-c-1: CASE 1 TA) = %lf sec\n", t_1_elapsed); 
+
+                t_auto_begin = omp_get_wtime();
+
+                // Active x2 runs of each row for the sweeps below
+                BuildSpans(TAMask, x1_min, x1_max, x2_min, x2_max);
 
                 #pragma omp parallel for
                 for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
@@ -1413,15 +1855,15 @@ void Diosi2d::Evolve()
                     density = 0.0;
                     velocity_dft = 0.0;
                     temp_loc = 0.0;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             density += F[i1*W1+i2] * H[1];
                         }
                     }
                     if (density <= 0.0) {
                         density = 0.0;
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 Feq_loc[i1*W1+i2] = 0.0;
                             }
                         }
@@ -1430,8 +1872,8 @@ void Diosi2d::Evolve()
                     {
                         velocity_dft = 0.0;
                         temp_loc = temp;
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2]){
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
                                 Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                             }
@@ -1439,15 +1881,15 @@ void Diosi2d::Evolve()
                     }
                     else if (isIsothermal)
                     {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                             }
                         }
                         velocity_dft = velocity_dft / (m * density);
                         temp_loc = temp;
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2]){
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
                                 Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                             }
@@ -1455,20 +1897,20 @@ void Diosi2d::Evolve()
                     }   
                     else
                     {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                             }
                         }
                         velocity_dft = velocity_dft / (m * density);
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                             }
                         }
                         temp_loc = temp_loc / (m * kb * density);
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2]){
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
                                 Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                             }
@@ -1489,8 +1931,8 @@ void Diosi2d::Evolve()
                     }
                     #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,feq,knudsen) schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1548,15 +1990,15 @@ void Diosi2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-2
                     #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1641,15 +2083,15 @@ void Diosi2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-3
                     #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1733,15 +2175,15 @@ void Diosi2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-4
                     #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1825,12 +2267,17 @@ void Diosi2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
                 } // OMP PARALLEL
                 isFirstExtrp = false;
 
+                if ( isAutoGrid )  {
+                    t_auto_core += omp_get_wtime() - t_auto_begin;
+                    core_points += (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+                }
+
             } // if ( isFirstExtrp )
             else if (ExFF.size() == 0)  {
 
@@ -1924,7 +2371,7 @@ void Diosi2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-cx-1: CASE 1 ExBD) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-cx-1: CASE 1 ExBD) = %lf sec\n", t_1_elapsed); 
 
                 // Update the local Maxwellian before time integration.
                 for (int i = 0; i < ExBD.size(); i++)  {
@@ -1975,7 +2422,7 @@ void Diosi2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-2
@@ -2016,7 +2463,7 @@ void Diosi2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-3
@@ -2057,7 +2504,7 @@ void Diosi2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-4
@@ -2098,7 +2545,7 @@ void Diosi2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
             }
 
@@ -2158,29 +2605,33 @@ void Diosi2d::Evolve()
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
                 //if (!QUIET) log->log("TBL size = %d TBL_P size = %d\n", TBL.size(), TBL_P.size()); 
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-c-3 CASE 1 TBL) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-c-3 CASE 1 TBL) = %lf sec\n", t_1_elapsed); 
             }
         }
         // .........................................................................................
 
         // CASE 2: Truncating without extrapolation
 
+        t_auto_begin = omp_get_wtime();
+
         if ( !isExtrapolate && !isFullGrid )
         {
+            BuildSpans(TAMask, x1_min, x1_max, x2_min, x2_max);
+
             // Update the 3 Momentum Moments before time integration.
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 density = 0.0;
                 velocity_dft = 0.0;
                 temp_loc = 0.0;
-                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                    if (TAMask[i1*W1+i2])  {
+                for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                    for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                         density += F[i1*W1+i2] * H[1];
                     }
                 }
                 if (density <= 0.0) {
                     density = 0.0;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             Feq_loc[i1*W1+i2] = 0.0;
                         }
                     }
@@ -2189,8 +2640,8 @@ void Diosi2d::Evolve()
                 {
                     velocity_dft = 0.0;
                     temp_loc = temp;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2]){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
                             Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                         }
@@ -2198,15 +2649,15 @@ void Diosi2d::Evolve()
                 }
                 else if (isIsothermal)
                 {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
                     velocity_dft = velocity_dft / (m * density);
                     temp_loc = temp;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2]){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
                             Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                         }
@@ -2214,20 +2665,20 @@ void Diosi2d::Evolve()
                 }   
                 else
                 {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
                     velocity_dft = velocity_dft / (m * density);
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                         }
                     }
                     temp_loc = temp_loc / (m * kb * density);
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2]){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
                             Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                         }
@@ -2247,8 +2698,8 @@ void Diosi2d::Evolve()
                 }
                 #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,feq,knudsen) schedule(runtime)
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
                             f0 = F[i1*W1+i2];
@@ -2276,15 +2727,15 @@ void Diosi2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-21: CASE 2 KK1) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-21: CASE 2 KK1) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-2
                 #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
                             f0 = F[i1*W1+i2];
@@ -2321,15 +2772,15 @@ void Diosi2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-22: CASE 2 KK2) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-22: CASE 2 KK2) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-3
                 #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
 
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
@@ -2367,15 +2818,15 @@ void Diosi2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-23: CASE 2 KK3) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-23: CASE 2 KK3) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-4
                 #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
 
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
@@ -2414,7 +2865,7 @@ void Diosi2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-24: CASE 2 KK4) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-24: CASE 2 KK4) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
             } // OMP PARALLEL
@@ -2424,243 +2875,346 @@ void Diosi2d::Evolve()
             // .........................................................................................
 
             // CASE 3: Full grid
+            // Every sweep runs slab by slab over the out-of-core arrays, a
+            // single slab when they are in memory.
+            // With spectral streaming the stages carry force and collision only,
+            // between two exact half steps of free flight
+            double kadv = isSpectralX ? 0.0 : kh0m;
+
+            if ( isSpectralX )
+                StreamX(F, 0.5 * kk, spectral);
+
             // Update the 3 Momentum Moments before time integration.
-            for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                density = 0.0;
-                velocity_dft = 0.0;
-                temp_loc = 0.0;
-                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                    density += F[i1*W1+i2] * H[1];
-                }
-                if (density <= 0.0) {
+            for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]);
+                ooc.Stream(s1, BoxShape[0], {F, Feq_loc});
+                for (int i1 = s1; i1 < e1; i1 ++)  {
                     density = 0.0;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        Feq_loc[i1*W1+i2] = 0.0;
-                    }
-                }
-                else if (isLinearizedCollision)
-                {
                     velocity_dft = 0.0;
-                    temp_loc = temp;
+                    temp_loc = 0.0;
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        density += F[i1*W1+i2] * H[1];
                     }
-                }
-                else if (isIsothermal)
-                {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                    if (density <= 0.0) {
+                        density = 0.0;
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            Feq_loc[i1*W1+i2] = 0.0;
+                        }
                     }
-                    velocity_dft = velocity_dft / (m * density);
-                    temp_loc = temp;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                    else if (isLinearizedCollision)
+                    {
+                        velocity_dft = 0.0;
+                        temp_loc = temp;
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
+                            Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        }
                     }
-                }   
-                else
-                {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
-                    }
-                    velocity_dft = velocity_dft / (m * density);
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
+                    else if (isIsothermal)
+                    {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                        }
+                        velocity_dft = velocity_dft / (m * density);
+                        temp_loc = temp;
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
+                            Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        }
+                    }   
+                    else
+                    {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                        }
+                        velocity_dft = velocity_dft / (m * density);
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
+                        }
+                        temp_loc = temp_loc / (m * kb * density);
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
+                            Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        }
                     }
-                    temp_loc = temp_loc / (m * kb * density);
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                    Density[i1] = density;
+                    Velocity[i1] = velocity_dft;
+                    Temperature[i1] = temp_loc;
+                }
+            }
+
+            // Conservative form: per-row sums so Feq can be matched to the
+            // density of every RK4 stage
+            if ( isConservative )  {
+                for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0]);
+                    ooc.Stream(s1, BoxShape[0], {F, Feq_loc});
+                    #pragma omp parallel for
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        double sf = 0.0;
+                        double se = 0.0;
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                            sf += F[i1*W1+i2];
+                            se += Feq_loc[i1*W1+i2];
+                        }
+                        RowF[i1] = sf;
+                        RowFeqInv[i1] = (se > 0.0) ? 1.0 / se : 0.0;
                     }
                 }
-                Density[i1] = density;
-                Velocity[i1] = velocity_dft;
-                Temperature[i1] = temp_loc;
             }
 
-            // RK4-1
-            #pragma omp parallel
-            {
-                #pragma omp single nowait
+            // Multirate rows, KK1 and KK2 as stage input and increment
+            if ( isMultirate )  {
+                t_1_begin = omp_get_wtime();
+                MultirateStep(tt, (int)(TIME / kk), F, FF, Feq_loc, KK1, KK2);
+                t_1_elapsed = omp_get_wtime() - t_1_begin;
+                t_full += t_1_elapsed;
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-3: CASE 3 multirate) = %lf sec\n", t_1_elapsed);
+            }
+            else  {
+                // RK4-1
+                #pragma omp parallel
                 {
-                    t_1_begin = omp_get_wtime();
-                }
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,feq,knudsen) schedule(runtime)
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
-                        f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
-                        f2p1 = F[i1*W1+(i2+1)];
-                        f2m1 = F[i1*W1+(i2-1)];
-                        f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
-                        f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
-                        f2p2 = F[i1*W1+(i2+2)];
-                        f2m2 = F[i1*W1+(i2-2)];
-                        feq = Feq_loc[i1*W1+i2];
-                        knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
+                    #pragma omp single nowait
+                    {
+                        t_1_begin = omp_get_wtime();
+                    }
+                    for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                        e1 = ooc.End(s1, BoxShape[0]);
+                        #pragma omp single nowait
+                        {
+                            ooc.Stream(s1, BoxShape[0], {F, Feq_loc, KK1, FF});
+                        }
+                        #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,feq,knudsen,fscale,ksum) schedule(runtime)
+                        for (int i1 = s1; i1 < e1; i1 ++)  {
+                            fscale = ( isConservative ) ? RowF[i1] * RowFeqInv[i1] : 1.0;
+                            ksum = 0.0;
+                            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                                xx1 = Box[0] + i1 * H[0];
+                                xx2 = Box[2] + i2 * H[1];
+                                f0 = F[i1*W1+i2];
+                                f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
+                                f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
+                                f2p1 = F[i1*W1+(i2+1)];
+                                f2m1 = F[i1*W1+(i2-1)];
+                                f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
+                                f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
+                                f2p2 = F[i1*W1+(i2+2)];
+                                f2m2 = F[i1*W1+(i2-2)];
+                                feq = Feq_loc[i1*W1+i2] * fscale;
+                                knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
 
-                        KK1[i1*W1+i2] = -kh0m * xx2 * (-f1p2/12.0 + 2/3.0*f1p1 - 2/3.0*f1m1 + f1m2/12.0) + 
-                                    k2h1 * POTENTIAL_X(xx1, xx2) * (-f2p2/12.0 + 2/3.0*f2p1 - 2/3.0*f2m1 + f2m2/12.0) +
-                                    kk * (feq - f0) / knudsen;
+                                KK1[i1*W1+i2] = -kadv * xx2 * (-f1p2/12.0 + 2/3.0*f1p1 - 2/3.0*f1m1 + f1m2/12.0) + 
+                                            k2h1 * POTENTIAL_X(xx1, xx2) * (-f2p2/12.0 + 2/3.0*f2p1 - 2/3.0*f2m1 + f2m2/12.0) +
+                                            kk * (feq - f0) / knudsen;
 
-                        FF[i1*W1+i2] = F[i1*W1+i2] + KK1[i1*W1+i2] / 6.0;
+                                FF[i1*W1+i2] = F[i1*W1+i2] + KK1[i1*W1+i2] / 6.0;
+                                ksum += KK1[i1*W1+i2];
+                            }
+                            if ( isConservative )
+                                RowK[i1] = ksum + ForceFluxClosure(i1, 0.0, 6.0, F, KK1, KK1, FF);
+                        }
                     }
-                }
 
-                #pragma omp single nowait
-                {
-                    t_1_end = omp_get_wtime();
-                    t_1_elapsed = t_1_end - t_1_begin;
-                    t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-31: CASE 3 KK1) = %lf sec\n", t_1_elapsed);
-                    t_1_begin = omp_get_wtime();
-                }
+                    #pragma omp single nowait
+                    {
+                        t_1_end = omp_get_wtime();
+                        t_1_elapsed = t_1_end - t_1_begin;
+                        t_full += t_1_elapsed;
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-31: CASE 3 KK1) = %lf sec\n", t_1_elapsed);
+                        t_1_begin = omp_get_wtime();
+                    }
 
-                // RK4-2
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
-                        f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
-                        f2p1 = F[i1*W1+(i2+1)];
-                        f2m1 = F[i1*W1+(i2-1)];
-                        f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
-                        f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
-                        f2p2 = F[i1*W1+(i2+2)];
-                        f2m2 = F[i1*W1+(i2-2)];
-                        kk0 = KK1[i1*W1+i2];
-                        kk1p1 = (i1+1 >= BoxShape[0]) ? KK1[(i1+1-BoxShape[0])*W1+i2] : KK1[(i1+1)*W1+i2];
-                        kk1m1 = (i1-1 < 0) ? KK1[(i1-1+BoxShape[0])*W1+i2] : KK1[(i1-1)*W1+i2];
-                        kk2p1 = KK1[i1*W1+(i2+1)];
-                        kk2m1 = KK1[i1*W1+(i2-1)];
-                        kk1p2 = (i1+2 >= BoxShape[0]) ? KK1[(i1+2-BoxShape[0])*W1+i2] : KK1[(i1+2)*W1+i2];
-                        kk1m2 = (i1-2 < 0) ? KK1[(i1-2+BoxShape[0])*W1+i2] : KK1[(i1-2)*W1+i2];
-                        kk2p2 = KK1[i1*W1+(i2+2)];
-                        kk2m2 = KK1[i1*W1+(i2-2)];
-                        feq = Feq_loc[i1*W1+i2];
-                        knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
-
-                        KK2[i1*W1+i2] = -kh0m * xx2 * (-1/12.0*(f1p2+0.5*kk1p2) + 2/3.0*(f1p1+0.5*kk1p1) - 2/3.0*(f1m1+0.5*kk1m1) + 1/12.0*(f1m2+0.5*kk1m2)) + 
-                                    k2h1 * POTENTIAL_X(xx1, xx2) * (-1/12.0*(f2p2+0.5*kk2p2) + 2/3.0*(f2p1+0.5*kk2p1) - 2/3.0*(f2m1+0.5*kk2m1) + 1/12.0*(f2m2+0.5*kk2m2)) +
-                                    kk * (feq - f0 - 0.5*kk0) / knudsen;
-
-                        FF[i1*W1+i2] += KK2[i1*W1+i2] / 3.0;
+                    // RK4-2
+                    for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                        e1 = ooc.End(s1, BoxShape[0]);
+                        #pragma omp single nowait
+                        {
+                            ooc.Stream(s1, BoxShape[0], {F, Feq_loc, KK1, KK2, FF});
+                        }
+                        #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen,fscale,ksum) schedule(runtime)
+                        for (int i1 = s1; i1 < e1; i1 ++)  {
+                            fscale = ( isConservative ) ? ( RowF[i1] + 0.5 * RowK[i1] ) * RowFeqInv[i1] : 1.0;
+                            ksum = 0.0;
+                            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                                xx1 = Box[0] + i1 * H[0];
+                                xx2 = Box[2] + i2 * H[1];
+                                f0 = F[i1*W1+i2];
+                                f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
+                                f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
+                                f2p1 = F[i1*W1+(i2+1)];
+                                f2m1 = F[i1*W1+(i2-1)];
+                                f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
+                                f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
+                                f2p2 = F[i1*W1+(i2+2)];
+                                f2m2 = F[i1*W1+(i2-2)];
+                                kk0 = KK1[i1*W1+i2];
+                                kk1p1 = (i1+1 >= BoxShape[0]) ? KK1[(i1+1-BoxShape[0])*W1+i2] : KK1[(i1+1)*W1+i2];
+                                kk1m1 = (i1-1 < 0) ? KK1[(i1-1+BoxShape[0])*W1+i2] : KK1[(i1-1)*W1+i2];
+                                kk2p1 = KK1[i1*W1+(i2+1)];
+                                kk2m1 = KK1[i1*W1+(i2-1)];
+                                kk1p2 = (i1+2 >= BoxShape[0]) ? KK1[(i1+2-BoxShape[0])*W1+i2] : KK1[(i1+2)*W1+i2];
+                                kk1m2 = (i1-2 < 0) ? KK1[(i1-2+BoxShape[0])*W1+i2] : KK1[(i1-2)*W1+i2];
+                                kk2p2 = KK1[i1*W1+(i2+2)];
+                                kk2m2 = KK1[i1*W1+(i2-2)];
+                                feq = Feq_loc[i1*W1+i2] * fscale;
+                                knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
+
+                                KK2[i1*W1+i2] = -kadv * xx2 * (-1/12.0*(f1p2+0.5*kk1p2) + 2/3.0*(f1p1+0.5*kk1p1) - 2/3.0*(f1m1+0.5*kk1m1) + 1/12.0*(f1m2+0.5*kk1m2)) + 
+                                            k2h1 * POTENTIAL_X(xx1, xx2) * (-1/12.0*(f2p2+0.5*kk2p2) + 2/3.0*(f2p1+0.5*kk2p1) - 2/3.0*(f2m1+0.5*kk2m1) + 1/12.0*(f2m2+0.5*kk2m2)) +
+                                            kk * (feq - f0 - 0.5*kk0) / knudsen;
+
+                                FF[i1*W1+i2] += KK2[i1*W1+i2] / 3.0;
+                                ksum += KK2[i1*W1+i2];
+                            }
+                            if ( isConservative )
+                                RowK[i1] = ksum + ForceFluxClosure(i1, 0.5, 3.0, F, KK1, KK2, FF);
+                        }
                     }
-                }
 
-                #pragma omp single nowait
-                {
-                    t_1_end = omp_get_wtime();
-                    t_1_elapsed = t_1_end - t_1_begin;
-                    t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-32: CASE 3 KK2) = %lf sec\n", t_1_elapsed);
-                    t_1_begin = omp_get_wtime();
-                }
+                    #pragma omp single nowait
+                    {
+                        t_1_end = omp_get_wtime();
+                        t_1_elapsed = t_1_end - t_1_begin;
+                        t_full += t_1_elapsed;
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-32: CASE 3 KK2) = %lf sec\n", t_1_elapsed);
+                        t_1_begin = omp_get_wtime();
+                    }
 
-                // RK4-3
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
-                        f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
-                        f2p1 = F[i1*W1+(i2+1)];
-                        f2m1 = F[i1*W1+(i2-1)];
-                        f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
-                        f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
-                        f2p2 = F[i1*W1+(i2+2)];
-                        f2m2 = F[i1*W1+(i2-2)];
-                        kk0 = KK2[i1*W1+i2];
-                        kk1p1 = (i1+1 >= BoxShape[0]) ? KK2[(i1+1-BoxShape[0])*W1+i2] : KK2[(i1+1)*W1+i2];
-                        kk1m1 = (i1-1 < 0) ? KK2[(i1-1+BoxShape[0])*W1+i2] : KK2[(i1-1)*W1+i2];
-                        kk2p1 = KK2[i1*W1+(i2+1)];
-                        kk2m1 = KK2[i1*W1+(i2-1)];
-                        kk1p2 = (i1+2 >= BoxShape[0]) ? KK2[(i1+2-BoxShape[0])*W1+i2] : KK2[(i1+2)*W1+i2];
-                        kk1m2 = (i1-2 < 0) ? KK2[(i1-2+BoxShape[0])*W1+i2] : KK2[(i1-2)*W1+i2];
-                        kk2p2 = KK2[i1*W1+(i2+2)];
-                        kk2m2 = KK2[i1*W1+(i2-2)];
-                        feq = Feq_loc[i1*W1+i2];
-                        knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
-
-                        KK3[i1*W1+i2] = -kh0m * xx2 * (-1/12.0*(f1p2+0.5*kk1p2) + 2/3.0*(f1p1+0.5*kk1p1) - 2/3.0*(f1m1+0.5*kk1m1) + 1/12.0*(f1m2+0.5*kk1m2)) + 
-                                    k2h1 * POTENTIAL_X(xx1, xx2) * (-1/12.0*(f2p2+0.5*kk2p2) + 2/3.0*(f2p1+0.5*kk2p1) - 2/3.0*(f2m1+0.5*kk2m1) + 1/12.0*(f2m2+0.5*kk2m2)) +
-                                    kk * (feq - f0 - 0.5*kk0) / knudsen;
-
-                        FF[i1*W1+i2] += KK3[i1*W1+i2] / 3.0;  
+                    // RK4-3
+                    for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                        e1 = ooc.End(s1, BoxShape[0]);
+                        #pragma omp single nowait
+                        {
+                            ooc.Stream(s1, BoxShape[0], {F, Feq_loc, KK2, KK3, FF});
+                        }
+                        #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen,fscale,ksum) schedule(runtime)
+                        for (int i1 = s1; i1 < e1; i1 ++)  {
+                            fscale = ( isConservative ) ? ( RowF[i1] + 0.5 * RowK[i1] ) * RowFeqInv[i1] : 1.0;
+                            ksum = 0.0;
+                            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                                xx1 = Box[0] + i1 * H[0];
+                                xx2 = Box[2] + i2 * H[1];
+                                f0 = F[i1*W1+i2];
+                                f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
+                                f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
+                                f2p1 = F[i1*W1+(i2+1)];
+                                f2m1 = F[i1*W1+(i2-1)];
+                                f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
+                                f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
+                                f2p2 = F[i1*W1+(i2+2)];
+                                f2m2 = F[i1*W1+(i2-2)];
+                                kk0 = KK2[i1*W1+i2];
+                                kk1p1 = (i1+1 >= BoxShape[0]) ? KK2[(i1+1-BoxShape[0])*W1+i2] : KK2[(i1+1)*W1+i2];
+                                kk1m1 = (i1-1 < 0) ? KK2[(i1-1+BoxShape[0])*W1+i2] : KK2[(i1-1)*W1+i2];
+                                kk2p1 = KK2[i1*W1+(i2+1)];
+                                kk2m1 = KK2[i1*W1+(i2-1)];
+                                kk1p2 = (i1+2 >= BoxShape[0]) ? KK2[(i1+2-BoxShape[0])*W1+i2] : KK2[(i1+2)*W1+i2];
+                                kk1m2 = (i1-2 < 0) ? KK2[(i1-2+BoxShape[0])*W1+i2] : KK2[(i1-2)*W1+i2];
+                                kk2p2 = KK2[i1*W1+(i2+2)];
+                                kk2m2 = KK2[i1*W1+(i2-2)];
+                                feq = Feq_loc[i1*W1+i2] * fscale;
+                                knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
+
+                                KK3[i1*W1+i2] = -kadv * xx2 * (-1/12.0*(f1p2+0.5*kk1p2) + 2/3.0*(f1p1+0.5*kk1p1) - 2/3.0*(f1m1+0.5*kk1m1) + 1/12.0*(f1m2+0.5*kk1m2)) + 
+                                            k2h1 * POTENTIAL_X(xx1, xx2) * (-1/12.0*(f2p2+0.5*kk2p2) + 2/3.0*(f2p1+0.5*kk2p1) - 2/3.0*(f2m1+0.5*kk2m1) + 1/12.0*(f2m2+0.5*kk2m2)) +
+                                            kk * (feq - f0 - 0.5*kk0) / knudsen;
+
+                                FF[i1*W1+i2] += KK3[i1*W1+i2] / 3.0;
+                                ksum += KK3[i1*W1+i2];
+                            }
+                            if ( isConservative )
+                                RowK[i1] = ksum + ForceFluxClosure(i1, 0.5, 3.0, F, KK2, KK3, FF);
+                        }
                     }
-                }
 
-                #pragma omp single nowait
-                {
-                    t_1_end = omp_get_wtime();
-                    t_1_elapsed = t_1_end - t_1_begin;
-                    t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-33: CASE 3 KK3) = %lf sec\n", t_1_elapsed);
-                    t_1_begin = omp_get_wtime();
-                }
+                    #pragma omp single nowait
+                    {
+                        t_1_end = omp_get_wtime();
+                        t_1_elapsed = t_1_end - t_1_begin;
+                        t_full += t_1_elapsed;
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-33: CASE 3 KK3) = %lf sec\n", t_1_elapsed);
+                        t_1_begin = omp_get_wtime();
+                    }
 
-                // RK4-4
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen) schedule(runtime)
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
-                        f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
-                        f2p1 = F[i1*W1+(i2+1)];
-                        f2m1 = F[i1*W1+(i2-1)];
-                        f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
-                        f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
-                        f2p2 = F[i1*W1+(i2+2)];
-                        f2m2 = F[i1*W1+(i2-2)];
-                        kk0 = KK3[i1*W1+i2];
-                        kk1p1 = (i1+1 >= BoxShape[0]) ? KK3[(i1+1-BoxShape[0])*W1+i2] : KK3[(i1+1)*W1+i2];
-                        kk1m1 = (i1-1 < 0) ? KK3[(i1-1+BoxShape[0])*W1+i2] : KK3[(i1-1)*W1+i2];
-                        kk2p1 = KK3[i1*W1+(i2+1)];
-                        kk2m1 = KK3[i1*W1+(i2-1)];
-                        kk1p2 = (i1+2 >= BoxShape[0]) ? KK3[(i1+2-BoxShape[0])*W1+i2] : KK3[(i1+2)*W1+i2];
-                        kk1m2 = (i1-2 < 0) ? KK3[(i1-2+BoxShape[0])*W1+i2] : KK3[(i1-2)*W1+i2];
-                        kk2p2 = KK3[i1*W1+(i2+2)];
-                        kk2m2 = KK3[i1*W1+(i2-2)];
-                        feq = Feq_loc[i1*W1+i2];
-                        knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
-
-                        KK4[i1*W1+i2] = -kh0m * xx2 * (-1/12.0*(f1p2+kk1p2) + 2/3.0*(f1p1+kk1p1) - 2/3.0*(f1m1+kk1m1) + 1/12.0*(f1m2+kk1m2)) + 
-                                    k2h1 * POTENTIAL_X(xx1, xx2) * (-1/12.0*(f2p2+kk2p2) + 2/3.0*(f2p1+kk2p1) - 2/3.0*(f2m1+kk2m1) + 1/12.0*(f2m2+kk2m2)) +
-                                    kk * (feq - f0 - kk0) / knudsen;
-
-                        FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0; 
+                    // RK4-4
+                    for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                        e1 = ooc.End(s1, BoxShape[0]);
+                        #pragma omp single nowait
+                        {
+                            ooc.Stream(s1, BoxShape[0], {F, Feq_loc, KK3, KK4, FF});
+                        }
+                        #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,f1p2,f1m2,f2p2,f2m2,kk0,kk1p1,kk1m1,kk2p1,kk2m1,kk1p2,kk1m2,kk2p2,kk2m2,feq,knudsen,fscale,ksum) schedule(runtime)
+                        for (int i1 = s1; i1 < e1; i1 ++)  {
+                            fscale = ( isConservative ) ? ( RowF[i1] + RowK[i1] ) * RowFeqInv[i1] : 1.0;
+                            ksum = 0.0;
+                            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                                xx1 = Box[0] + i1 * H[0];
+                                xx2 = Box[2] + i2 * H[1];
+                                f0 = F[i1*W1+i2];
+                                f1p1 = (i1+1 >= BoxShape[0]) ? F[(i1+1-BoxShape[0])*W1+i2] : F[(i1+1)*W1+i2];
+                                f1m1 = (i1-1 < 0) ? F[(i1-1+BoxShape[0])*W1+i2] : F[(i1-1)*W1+i2];
+                                f2p1 = F[i1*W1+(i2+1)];
+                                f2m1 = F[i1*W1+(i2-1)];
+                                f1p2 = (i1+2 >= BoxShape[0]) ? F[(i1+2-BoxShape[0])*W1+i2] : F[(i1+2)*W1+i2];
+                                f1m2 = (i1-2 < 0) ? F[(i1-2+BoxShape[0])*W1+i2] : F[(i1-2)*W1+i2];
+                                f2p2 = F[i1*W1+(i2+2)];
+                                f2m2 = F[i1*W1+(i2-2)];
+                                kk0 = KK3[i1*W1+i2];
+                                kk1p1 = (i1+1 >= BoxShape[0]) ? KK3[(i1+1-BoxShape[0])*W1+i2] : KK3[(i1+1)*W1+i2];
+                                kk1m1 = (i1-1 < 0) ? KK3[(i1-1+BoxShape[0])*W1+i2] : KK3[(i1-1)*W1+i2];
+                                kk2p1 = KK3[i1*W1+(i2+1)];
+                                kk2m1 = KK3[i1*W1+(i2-1)];
+                                kk1p2 = (i1+2 >= BoxShape[0]) ? KK3[(i1+2-BoxShape[0])*W1+i2] : KK3[(i1+2)*W1+i2];
+                                kk1m2 = (i1-2 < 0) ? KK3[(i1-2+BoxShape[0])*W1+i2] : KK3[(i1-2)*W1+i2];
+                                kk2p2 = KK3[i1*W1+(i2+2)];
+                                kk2m2 = KK3[i1*W1+(i2-2)];
+                                feq = Feq_loc[i1*W1+i2] * fscale;
+                                knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
+
+                                KK4[i1*W1+i2] = -kadv * xx2 * (-1/12.0*(f1p2+kk1p2) + 2/3.0*(f1p1+kk1p1) - 2/3.0*(f1m1+kk1m1) + 1/12.0*(f1m2+kk1m2)) + 
+                                            k2h1 * POTENTIAL_X(xx1, xx2) * (-1/12.0*(f2p2+kk2p2) + 2/3.0*(f2p1+kk2p1) - 2/3.0*(f2m1+kk2m1) + 1/12.0*(f2m2+kk2m2)) +
+                                            kk * (feq - f0 - kk0) / knudsen;
+
+                                FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0;
+                                ksum += KK4[i1*W1+i2];
+                            }
+                            if ( isConservative )
+                                RowK[i1] = ksum + ForceFluxClosure(i1, 1.0, 6.0, F, KK3, KK4, FF);
+                        }
                     }
-                }
 
-                #pragma omp single nowait
-                {
-                    t_1_end = omp_get_wtime();
-                    t_1_elapsed = t_1_end - t_1_begin;
-                    t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-34: CASE 3 KK4) = %lf sec\n", t_1_elapsed);
-                    t_1_begin = omp_get_wtime();
+                    #pragma omp single nowait
+                    {
+                        t_1_end = omp_get_wtime();
+                        t_1_elapsed = t_1_end - t_1_begin;
+                        t_full += t_1_elapsed;
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-34: CASE 3 KK4) = %lf sec\n", t_1_elapsed);
+                        t_1_begin = omp_get_wtime();
+                    }
                 }
             }
+
+            if ( isSpectralX )
+                StreamX(FF, 0.5 * kk, spectral);
+        }
+        if ( isAutoGrid && !isExtrapolate )  {
+            t_auto_core += omp_get_wtime() - t_auto_begin;
+            core_points += isFullGrid ? n_interior : (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
         }
         // .........................................................................................
 
         // FF(t+1) Normailzed & go on
 
         t_1_begin = omp_get_wtime();
+        t_auto_begin = t_1_begin;
         norm = 0.0;
 
         if (!isFullGrid)  {
+            // Later extrapolation rounds may have grown the TA
+            if ( isExtrapolate )
+                BuildSpans(TAMask, x1_min, x1_max, x2_min, x2_max);
+
             if (tt % SORT_PERIOD == 0)  {
                 #pragma omp parallel for schedule(runtime)
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
@@ -2682,51 +3236,72 @@ void Diosi2d::Evolve()
             }
             #pragma omp parallel for reduction (+:norm) schedule(runtime)
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                    if (TAMask[i1*W1+i2])
+                for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                    for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)
                         norm += FF[i1*W1+i2];
                 }
             }
         }  
         else  {
+            isDampStep = ( isDampX1 || isDampX2 ) && tt % SORT_PERIOD == 0;
+
             if (tt % SORT_PERIOD == 0)  {
-                #pragma omp parallel for schedule(runtime)
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
-                        if ( isDampX1 && isDampX2 )  {  
-                            if ( i1 < skin || i1 >= BoxShape[0] - skin || i2 < skin || i2 >= BoxShape[1] - skin )
-                                FF[i1*W1+i2] = FF[i1*W1+i2] * (i1 >= skin ? 1.0 : exp(-lambda*pow(skin-i1,2))) * (i2 >= skin ? 1.0 : exp(-lambda*pow(skin-i2,2))) * (i1 <= BoxShape[0] - skin ? 1.0 : exp(-lambda*pow(i1-BoxShape[0]+skin,2))) * (i2 <= BoxShape[1] - skin ? 1.0 : exp(-lambda*pow(i2-BoxShape[1]+skin,2)));
-                        }
-                        else if ( isDampX1 )  {
-                            if ( i1 < skin || i1 >= BoxShape[0] - skin )
-                                FF[i1*W1+i2] = FF[i1*W1+i2] * (i1 >= skin ? 1.0 : exp(-lambda*pow(skin-i1,2))) * (i1 <= BoxShape[0] - skin ? 1.0 : exp(-lambda*pow(i1-BoxShape[0]+skin,2)));
-                        }
-                        else if (isDampX2)  {
-                            if ( i2 < skin || i2 >= BoxShape[1] - skin )
-                                FF[i1*W1+i2] = FF[i1*W1+i2] * (i2 >= skin ? 1.0 : exp(-lambda*pow(skin-i2,2))) * (i2 <= BoxShape[1] - skin ? 1.0 : exp(-lambda*pow(i2-BoxShape[1]+skin,2)));
+                for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0]);
+                    ooc.Stream(s1, BoxShape[0], {FF});
+                    #pragma omp parallel for schedule(runtime)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
+                            if ( isDampX1 && isDampX2 )  {  
+                                if ( i1 < skin || i1 >= BoxShape[0] - skin || i2 < skin || i2 >= BoxShape[1] - skin )
+                                    FF[i1*W1+i2] = FF[i1*W1+i2] * (i1 >= skin ? 1.0 : exp(-lambda*pow(skin-i1,2))) * (i2 >= skin ? 1.0 : exp(-lambda*pow(skin-i2,2))) * (i1 <= BoxShape[0] - skin ? 1.0 : exp(-lambda*pow(i1-BoxShape[0]+skin,2))) * (i2 <= BoxShape[1] - skin ? 1.0 : exp(-lambda*pow(i2-BoxShape[1]+skin,2)));
+                            }
+                            else if ( isDampX1 )  {
+                                if ( i1 < skin || i1 >= BoxShape[0] - skin )
+                                    FF[i1*W1+i2] = FF[i1*W1+i2] * (i1 >= skin ? 1.0 : exp(-lambda*pow(skin-i1,2))) * (i1 <= BoxShape[0] - skin ? 1.0 : exp(-lambda*pow(i1-BoxShape[0]+skin,2)));
+                            }
+                            else if (isDampX2)  {
+                                if ( i2 < skin || i2 >= BoxShape[1] - skin )
+                                    FF[i1*W1+i2] = FF[i1*W1+i2] * (i2 >= skin ? 1.0 : exp(-lambda*pow(skin-i2,2))) * (i2 <= BoxShape[1] - skin ? 1.0 : exp(-lambda*pow(i2-BoxShape[1]+skin,2)));
+                            }
                         }
                     }
                 }
             }
-            #pragma omp parallel for reduction (+:norm)
-            for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
-                    norm += FF[i1*W1+i2];
+            // The conservative form keeps the mass to round-off; the norm is
+            // only evaluated for the report and the telemetry row, and after
+            // the absorbing layers have taken mass out
+            if ( !isConservative || isDampStep || (tt + 1) % PERIOD == 0 ||
+                 ( pfile_telemetry != NULL && (tt + 1) % TELEMETRY_PERIOD == 0 ) )  {
+                for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0]);
+                    ooc.Stream(s1, BoxShape[0], {FF});
+                    #pragma omp parallel for reduction (+:norm)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
+                            norm += FF[i1*W1+i2];
+                        }
+                    }
                 }
             }
         }
         norm *= H[0] * H[1];
+        mass_step = norm;
 
         if ( (tt + 1) % PERIOD == 0 )
             log->log("[Diosi2d] Normalization factor = %.16e\n",norm);
 
-        norm = norm_initial / norm; 
+        norm = ( isConservative && isFullGrid && !isDampStep ) ? 1.0 : norm_initial / norm; 
+
+        // Slow multirate rows lag until the end of their step
+        if ( isMultirate && (tt + 1) % MR_RATIO != 0 && tt + 1 < (int)(TIME / kk) )
+            norm = 1.0;
 
         t_1_end = omp_get_wtime();
         t_1_elapsed = t_1_end - t_1_begin;
         t_full += t_1_elapsed;
         t_truncate += t_1_elapsed;
-        if (!QUIET && TIMING) log->log("Elapsed time (omp-e-1-1 Norm) = %lf sec\n", t_1_elapsed);
+        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-1-1 Norm) = %lf sec\n", t_1_elapsed);
         t_1_begin = omp_get_wtime();
 
         if (!isFullGrid)  {
@@ -2741,13 +3316,17 @@ void Diosi2d::Evolve()
             }
         }  
         else  {
-            #pragma omp parallel for private(val) schedule(runtime)
-            for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
-                    val = norm * FF[i1*W1+i2];
-                    FF[i1*W1+i2] = val;
-                    F[i1*W1+i2] = val;
-                    PF[i1*W1+i2] = val;
+            for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]);
+                ooc.Stream(s1, BoxShape[0], {FF, F, PF});
+                #pragma omp parallel for private(val) schedule(runtime)
+                for (int i1 = s1; i1 < e1; i1 ++)  {
+                    for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
+                        val = norm * FF[i1*W1+i2];
+                        FF[i1*W1+i2] = val;
+                        F[i1*W1+i2] = val;
+                        PF[i1*W1+i2] = val;
+                    }
                 }
             }
         }
@@ -2755,7 +3334,52 @@ void Diosi2d::Evolve()
         t_1_elapsed = t_1_end - t_1_begin;
         t_full += t_1_elapsed;
         t_truncate += t_1_elapsed;
-        if (!QUIET && TIMING) log->log("Elapsed time (omp-e-1-2 FF) = %lf sec\n", t_1_elapsed); 
+        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-1-2 FF) = %lf sec\n", t_1_elapsed); 
+
+        if ( isAutoGrid )  {
+            t_auto_norm += omp_get_wtime() - t_auto_begin;
+            norm_points += isFullGrid ? n_interior : (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+        }
+
+        // Leave a coarse level once the x-moments of F stop changing
+        if ( ML_LEVEL > 0 && (tt + 1) % ML_PERIOD == 0 )
+        {
+            vector<double> moments(3 * BoxShape[0]);
+            double diff = 0.0;
+            double total = 0.0;
+
+            for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]);
+                ooc.Stream(s1, BoxShape[0], {F});
+                #pragma omp parallel for
+                for (int i1 = s1; i1 < e1; i1 ++)  {
+                    double m0 = 0.0, m1 = 0.0, m2 = 0.0;
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                        double p = Box[2] + i2 * H[1];
+                        m0 += F[i1*W1+i2];
+                        m1 += p * F[i1*W1+i2];
+                        m2 += p * p * F[i1*W1+i2];
+                    }
+                    moments[3*i1] = m0 * H[1];
+                    moments[3*i1+1] = m1 * H[1];
+                    moments[3*i1+2] = m2 * H[1];
+                }
+            }
+
+            if ( ML_Moments.size() == moments.size() )  {
+                for (unsigned int i = 0; i < moments.size(); i ++)  {
+                    diff += std::abs(moments[i] - ML_Moments[i]);
+                    total += std::abs(moments[i]);
+                }
+            }
+            ML_Moments.swap(moments);
+
+            if ( total > 0.0 && diff < ML_TOL * total )  {
+                ML_T = ( tt + 1 ) * kk;
+                log->log("[Diosi2d] Level %d converged at time %lf, relative moment change = %.4e\n", ML_LEVEL, t0 + ML_T, diff / total);
+                break;
+            }
+        }
 
         if ( (tt + 1) % PERIOD == 0 )
         {
@@ -2777,31 +3401,39 @@ void Diosi2d::Evolve()
                     }
                 }
                 else  {
-                    #pragma omp parallel for reduction (+:pftrans)
-                    for (int i1 = idx_x0; i1 < BoxShape[0]; i1 ++)  {
-                        for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
-                            pftrans+=PF[i1*W1+i2];
+                    for (int s1 = idx_x0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                        e1 = ooc.End(s1, BoxShape[0]);
+                        ooc.Stream(s1, BoxShape[0], {PF});
+                        #pragma omp parallel for reduction (+:pftrans)
+                        for (int i1 = s1; i1 < e1; i1 ++)  {
+                            for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                                pftrans+=PF[i1*W1+i2];
+                        }
                     }
                 }
                 pftrans *= H[0] * H[1];
                 PF_trans.push_back(pftrans);
                 log->log("[Diosi2d] idx_x0 = %d\n", idx_x0);
-                log->log("[Diosi2d] Time %lf, Trans = %.16e\n", ( tt + 1 ) * kk, pftrans);
+                log->log("[Diosi2d] Time %lf, Trans = %.16e\n", t0 + ( tt + 1 ) * kk, pftrans);
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin; 
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-x-2 trans) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-x-2 trans) = %lf sec\n", t_1_elapsed); 
             }
 
             if (isCorr)  {
 
                 // Density
-                #pragma omp parallel for private(density)
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    density = 0.0;
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        density += PF[i1*W1+i2]; 
+                for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0]);
+                    ooc.Stream(s1, BoxShape[0], {PF});
+                    #pragma omp parallel for private(density)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        density = 0.0;
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                            density += PF[i1*W1+i2]; 
+                        }
+                        Ft[i1] = density * H[1];
                     }
-                    Ft[i1] = density * H[1];
                 }
 
                 corr = 0.0;
@@ -2809,7 +3441,7 @@ void Diosi2d::Evolve()
                     corr += Ft[i1] * F0[i1];
                 }
                 corr *= H[0];
-                log->log("[Diosi2d] Time %lf, Corr = %.16e\n", ( tt + 1 ) * kk, corr/corr_0);
+                log->log("[Diosi2d] Time %lf, Corr = %.16e\n", t0 + ( tt + 1 ) * kk, corr/corr_0);
             }
         }
 
@@ -2822,7 +3454,7 @@ void Diosi2d::Evolve()
             t_1_begin = omp_get_wtime();
             #pragma omp parallel 
             {
-                #pragma omp for reduction(merge: tmpVec) private(b1,b2,b3,f0,f1p1,f1m1,f2p1,f2m1)
+                #pragma omp for reduction(merge: tmpVec) reduction(+: mass_cut) private(b1,b2,b3,f0,f1p1,f1m1,f2p1,f2m1)
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                         if (TAMask[i1*W1+i2])  {
@@ -2836,6 +3468,7 @@ void Diosi2d::Evolve()
                             b3 = std::abs(f2p1 - f2m1) < TolHdX2;
             
                             if (b1 && b2 && b3) {
+                                mass_cut += f0;
                                 F[i1*W1+i2] = 0.0;
                                 tmpVec.push_back(i1*M1+i2);
                             }
@@ -2856,7 +3489,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-3 TA) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-3 TA) = %lf sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
             // Rebuild TA box
@@ -2882,7 +3515,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-4 TARB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-4 TARB) = %lf sec\n", t_1_elapsed);
             //----------------------Free():Invalid Pointer Had Shown. Solved.----------------------//
             // TB
             t_1_begin = omp_get_wtime();
@@ -2917,7 +3550,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-5 TB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-5 TB) = %lf sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
             // `````````````````````````````````````````````````````````````````
@@ -2956,7 +3589,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-6 TAEX) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-6 TAEX) = %lf sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
             #pragma omp parallel for reduction(min: x1_min, x2_min) reduction(max: x1_max, x2_max) private(g1, g2)
@@ -2977,7 +3610,7 @@ void Diosi2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-7 TARB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-7 TARB) = %lf sec\n", t_1_elapsed);
         }
 
         // Reset
@@ -3014,6 +3647,42 @@ void Diosi2d::Evolve()
         t_truncate += t_1_elapsed;
         if ( !QUIET && TIMING ) log->log("Elapsed time (omp-e-8: reset) = %lf sec\n", t_1_elapsed);  
 
+        if ( isAutoGrid )  {
+            t_auto_step += omp_get_wtime() - t_0_begin;
+            auto_points += isFullGrid ? n_interior : (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+            auto_steps += 1;
+        }
+
+        // Cell updates counted as in the auto-grid cost model
+        if ( meter.isEnabled() )  {
+            meter.update();
+            cell_updates += isFullGrid ? n_interior : (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+        }
+
+        // Truncation telemetry (no TA box in full-grid rows, written as -1)
+
+        if ( pfile_telemetry != NULL && (tt + 1) % TELEMETRY_PERIOD == 0 )  {
+            if ( !isFullGrid )  {
+                ta_size = 0;
+                #pragma omp parallel for reduction(+: ta_size) schedule(runtime)
+                for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+                        if (TAMask[i1*W1+i2])
+                            ta_size += 1;    
+                    }
+                }
+            }
+            fprintf(pfile_telemetry, "%d,%.6e,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.16e,%.6e,%.6e,%.6e,%.6e,%.6e\n",
+                    tt + 1, t0 + ( tt + 1 ) * kk, (int) isFullGrid,
+                    isFullGrid ? GRIDS_TOT : ta_size, isFullGrid ? 0 : (int) TB.size(), tbl_points, ex_points,
+                    isFullGrid ? -1 : x1_min, isFullGrid ? -1 : x1_max, isFullGrid ? -1 : x2_min, isFullGrid ? -1 : x2_max, Excount,
+                    mass_step, mass_cut * H[0] * H[1], mass_ex * H[0] * H[1],
+                    isFullGrid ? t_full : t_truncate, isFullGrid ? 0.0 : t_overhead, omp_get_wtime() - t_0_begin);
+            fflush(pfile_telemetry);
+        }
+
+        tlog.flush();
+
         if ( (tt + 1) % PERIOD == 0 )
         {   
             t_0_end = omp_get_wtime();
@@ -3043,27 +3712,543 @@ void Diosi2d::Evolve()
 
                 log->log("[Diosi2d] Core computation time = %lf\n", t_full);
             }
+            if ( meter.isEnabled() && !QUIET )  {
+                log->log("[Diosi2d] Energy = %lf J, %.4e J/step\n", meter.total() - energy_period, (meter.total() - energy_period) / PERIOD);
+                energy_period = meter.total();
+            }
             if ( !QUIET ) log->log("\n........................................................\n\n");
         }         
     } // Time iteration 
 
-    delete F;
-    delete FF;
-    delete Feq_loc;
-    delete PF;
-    delete KK1;
-    delete KK2;
-    delete KK3;
-    delete KK4;
+    if ( pfile_telemetry != NULL )
+        fclose(pfile_telemetry);
+
+    // Hand the final state to the next grid level
+    if ( ML_LEVEL > 0 )
+        ML_F.assign(F, F + O1);
+
+    ooc.free(F);
+    ooc.free(FF);
+    ooc.free(Feq_loc);
+    ooc.free(PF);
+    ooc.free(KK1);
+    ooc.free(KK2);
+    ooc.free(KK3);
+    ooc.free(KK4);
     delete Density;
     delete Velocity;
     delete Temperature;
+    delete RowF;
+    delete RowFeqInv;
+    delete RowK;
 
-    if ( !isFullGrid )
+    if ( !isFullGrid || isAutoGrid )
         delete TAMask;
 
+    if ( meter.isEnabled() )  {
+        meter.update();
+        const int nsteps_energy = (int)(TIME / kk);
+        const double energy_loop = meter.total() - energy_iter;
+        log->log("[Diosi2d] Energy: initialization %lf J, time iteration %lf J\n", energy_iter, energy_loop);
+        log->log("[Diosi2d] Energy: package %lf J, DRAM %lf J\n", meter.package(), meter.dram());
+        if ( nsteps_energy > 0 && cell_updates > 0.0 )
+            log->log("[Diosi2d] Energy per step = %.4e J, per cell update = %.4e J\n", energy_loop / nsteps_energy, energy_loop / cell_updates);
+    }
+
     log->log("[Diosi2d] Evolve done.\n");
 }
+/* ------------------------------------------------------------------------------- */
+
+inline double Diosi2d::ForceFluxClosure(int i1, double a, double b, double *F, double *Kp, double *Kn, double *FF)
+{
+    // The interior force stencil is a difference of 4th-order face fluxes.
+    // Cancel the fluxes through the outer faces of the p range (ghost values
+    // are 0) so the row total is unchanged. Returns the change of the row sum.
+    int lo = EDGE;
+    int hi = BoxShape[1] - EDGE - 1;
+    double xx1 = Box[0] + i1 * H[0];
+    double glo0 = F[i1*W1+lo] + a * Kp[i1*W1+lo];
+    double glo1 = F[i1*W1+lo+1] + a * Kp[i1*W1+lo+1];
+    double ghi0 = F[i1*W1+hi] + a * Kp[i1*W1+hi];
+    double ghi1 = F[i1*W1+hi-1] + a * Kp[i1*W1+hi-1];
+    double clo = kk / H[1] * POTENTIAL_X(xx1, Box[2] + lo * H[1]) * (7.0 * glo0 - glo1) / 12.0;
+    double chi = -kk / H[1] * POTENTIAL_X(xx1, Box[2] + hi * H[1]) * (7.0 * ghi0 - ghi1) / 12.0;
+
+    Kn[i1*W1+lo] += clo;
+    Kn[i1*W1+hi] += chi;
+    FF[i1*W1+lo] += clo / b;
+    FF[i1*W1+hi] += chi / b;
+
+    return clo + chi;
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::StreamX(double *F, double dt, SpectralShift &spectral)
+{
+    // Free flight f(x1,p) -> f(x1 - p dt / m, p) on the periodic x1 grid,
+    // exact for every p column; two columns per complex FFT
+    #pragma omp parallel
+    {
+        std::vector<std::complex<double>> work(spectral.workSize());
+
+        #pragma omp for schedule(dynamic,4)
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 += 2)  {
+            double sa = (Box[2] + i2 * H[1]) / m * dt;
+            double sb = (Box[2] + (i2 + 1) * H[1]) / m * dt;
+            spectral.Shift2(F + i2, ( i2 + 1 < BoxShape[1] - EDGE ) ? F + i2 + 1 : NULL, W1, sa, sb, work.data());
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::MultirateSetup()
+{
+    // A row joins the slow class when one RK4 step of MR_RATIO * kk is
+    // stable on it: 1/tau plus the spectral radii of the 4th-order x1 and p
+    // differences (1.372/h) stays below MR_CFL / (MR_RATIO * kk)
+    const int N = BoxShape[0];
+    const double pmax = std::max(fabs(Box[2]), fabs(Box[3]));
+    const double dt = MR_RATIO * kk;
+    double xx1, knudsen, vmax, rate;
+    int nslow = 0;
+    int nghost = 0;
+
+    MRSlow.assign(N, 0);
+    MRGhost.assign(N, -1);
+    MRFace.clear();
+
+    for (int i1 = 0; i1 < N; i1 ++)  {
+        xx1 = Box[0] + i1 * H[0];
+        knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
+        vmax = 0.0;
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+            vmax = std::max(vmax, fabs(POTENTIAL_X(xx1, Box[2] + i2 * H[1])));
+        rate = 1.0 / knudsen + 1.372 * (pmax / (m * H[0]) + vmax / H[1]);
+        MRSlow[i1] = ( dt * rate <= MR_CFL ) ? 1 : 0;
+        nslow += MRSlow[i1];
+    }
+
+    // Faces a + 1/2 between the classes, and the rows that the stencil of
+    // the other class reaches
+    for (int i1 = 0; i1 < N; i1 ++)  {
+        if ( MRSlow[i1] != MRSlow[(i1+1)%N] )
+            MRFace.push_back(i1);
+        for (int d = -2; d <= 2; d ++)  {
+            if ( MRSlow[(i1+d+N)%N] != MRSlow[i1] )  {
+                MRGhost[i1] = nghost ++;
+                break;
+            }
+        }
+    }
+    MRHalo.assign((size_t) nghost * W1, 0.0);
+    MRFlux.assign(MRFace.size() * W1, 0.0);
+
+    log->log("[Diosi2d] Multirate: %d of %d rows step with %d k, %d class interfaces\n", nslow, N, MR_RATIO, (int) MRFace.size());
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::MultirateStep(int tt, int nsteps, double *F, double *FF, const double *Feq_loc, double *U, double *K)
+{
+    // Fast rows take one RK4 step of kk per call. Slow rows stay at the
+    // start of their step and take it in one go, with MR_RATIO * kk, on the
+    // last call of the window; the last window is cut at nsteps. The slow
+    // rows next to a class interface then swap their own x1 face flux for
+    // the one summed over the fast steps, so the streaming term conserves
+    // mass across the interface.
+    const int N = BoxShape[0];
+    const int w0 = tt - tt % MR_RATIO;
+    const int nsub = std::min(MR_RATIO, nsteps - w0);
+    const int sub = tt - w0;
+    const int nface = MRFace.size();
+
+    // Fast ghost rows are interpolated over the slow step from its ends
+    if ( sub == 0 )  {
+        #pragma omp parallel for
+        for (int i1 = 0; i1 < N; i1 ++)  {
+            if ( MRSlow[i1] || MRGhost[i1] < 0 )
+                continue;
+            for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                MRHalo[(size_t) MRGhost[i1]*W1+i2] = F[i1*W1+i2];
+        }
+        std::fill(MRFlux.begin(), MRFlux.end(), 0.0);
+    }
+
+    MultiratePass(false, sub, nsub, F, FF, Feq_loc, U, K);
+
+    if ( sub < nsub - 1 )  {
+        #pragma omp parallel for
+        for (int i1 = 0; i1 < N; i1 ++)  {
+            if ( !MRSlow[i1] )
+                continue;
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                FF[i1*W1+i2] = F[i1*W1+i2];
+        }
+        return;
+    }
+
+    MultiratePass(true, sub, nsub, F, FF, Feq_loc, U, K);
+
+    // MRFlux holds the fast minus the slow face increment
+    for (int f = 0; f < nface; f ++)  {
+        int a = MRFace[f];
+        int b = (a + 1) % N;
+        #pragma omp parallel for
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+            if ( MRSlow[a] )
+                FF[a*W1+i2] -= MRFlux[(size_t) f*W1+i2];
+            else
+                FF[b*W1+i2] += MRFlux[(size_t) f*W1+i2];
+        }
+    }
+
+    // Slow ghost rows are extrapolated through the next window with the
+    // increment of this one
+    #pragma omp parallel for
+    for (int i1 = 0; i1 < N; i1 ++)  {
+        if ( !MRSlow[i1] || MRGhost[i1] < 0 )
+            continue;
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+            MRHalo[(size_t) MRGhost[i1]*W1+i2] = (FF[i1*W1+i2] - F[i1*W1+i2]) / nsub;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::MultiratePass(bool isSlow, int sub, int nsub, const double *F, double *FF, const double *Feq_loc, double *U, double *K)
+{
+    // Classical RK4 on the rows of one class, U the stage input. Rows of the
+    // other class inside the stencil are filled in at the stage time: fast
+    // rows from the two ends of the slow step, slow rows extrapolated from
+    // the start of the window. The x1 face increments at the interfaces are
+    // summed into MRFlux with the RK4 weights, fast minus slow.
+    static const double c[4] = { 0.0, 0.5, 0.5, 1.0 };
+    static const double b[4] = { 1/6.0, 1/3.0, 1/3.0, 1/6.0 };
+    const int N = BoxShape[0];
+    const int nface = MRFace.size();
+    const int cls = isSlow ? 1 : 0;
+    const double dt = isSlow ? nsub * kk : kk;
+
+    for (int s = 0; s < 4; s ++)  {
+
+        #pragma omp parallel for schedule(runtime)
+        for (int i1 = 0; i1 < N; i1 ++)  {
+            int g = MRGhost[i1];
+            if ( MRSlow[i1] == cls )  {
+                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                    U[i1*W1+i2] = F[i1*W1+i2];
+                if ( s > 0 )  {
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                        U[i1*W1+i2] += c[s] * K[i1*W1+i2];
+                }
+            }
+            else if ( g >= 0 && isSlow )  {
+                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                    U[i1*W1+i2] = (1.0 - c[s]) * MRHalo[(size_t) g*W1+i2] + c[s] * FF[i1*W1+i2];
+            }
+            else if ( g >= 0 )  {
+                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                    U[i1*W1+i2] = F[i1*W1+i2] + (sub + c[s]) * MRHalo[(size_t) g*W1+i2];
+            }
+        }
+
+        #pragma omp parallel for schedule(runtime)
+        for (int i1 = 0; i1 < N; i1 ++)  {
+            if ( MRSlow[i1] != cls )
+                continue;
+            MultirateRow(i1, dt, U, Feq_loc, K);
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                FF[i1*W1+i2] = ( s == 0 ? F[i1*W1+i2] : FF[i1*W1+i2] ) + b[s] * K[i1*W1+i2];
+        }
+
+        for (int f = 0; f < nface; f ++)  {
+            #pragma omp parallel for
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                MRFlux[(size_t) f*W1+i2] += ( isSlow ? -b[s] : b[s] ) * MultirateFace(MRFace[f], i2, dt, U);
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+inline void Diosi2d::MultirateRow(int i1, double dt, const double *U, const double *Feq_loc, double *K)
+{
+    // dt times the full-grid operator of CASE 3 on row i1. Feq is matched
+    // to the mass of the stage input, otherwise the collision term leaks
+    // O(dt^2) mass on the long slow steps.
+    const int N = BoxShape[0];
+    const double kadv = dt / (H[0] * m);
+    const double k2h1 = dt / H[1];
+    const double xx1 = Box[0] + i1 * H[0];
+    const double knudsen = 1.0/gamma + (tanh(1 - 40*xx1) + tanh(1 + 40*xx1))/2.0;
+    const double *u0 = U + i1 * W1;
+    const double *up1 = U + ((i1 + 1) % N) * W1;
+    const double *um1 = U + ((i1 - 1 + N) % N) * W1;
+    const double *up2 = U + ((i1 + 2) % N) * W1;
+    const double *um2 = U + ((i1 - 2 + N) % N) * W1;
+    double xx2, fscale;
+    double su = 0.0;
+    double se = 0.0;
+
+    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+        su += u0[i2];
+        se += Feq_loc[i1*W1+i2];
+    }
+    fscale = ( se > 0.0 ) ? su / se : 0.0;
+
+    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+        xx2 = Box[2] + i2 * H[1];
+        K[i1*W1+i2] = -kadv * xx2 * (-up2[i2]/12.0 + 2/3.0*up1[i2] - 2/3.0*um1[i2] + um2[i2]/12.0) +
+                      k2h1 * POTENTIAL_X(xx1, xx2) * (-u0[i2+2]/12.0 + 2/3.0*u0[i2+1] - 2/3.0*u0[i2-1] + u0[i2-2]/12.0) +
+                      dt * (Feq_loc[i1*W1+i2] * fscale - u0[i2]) / knudsen;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+inline double Diosi2d::MultirateFace(int a, int i2, double dt, const double *U)
+{
+    // Increment through the x1 face a + 1/2; the streaming term of row a is
+    // the difference of its two faces, G(a-1) - G(a)
+    const int N = BoxShape[0];
+    const double xx2 = Box[2] + i2 * H[1];
+
+    return dt / (H[0] * m) * xx2 * (-U[((a + 2) % N)*W1+i2] + 7.0 * U[((a + 1) % N)*W1+i2] +
+                                    7.0 * U[a*W1+i2] - U[((a - 1 + N) % N)*W1+i2]) / 12.0;
+}
+/* =============================================================================== */
+
+void Diosi2d::EvolveDM()
+{
+    // Caldeira-Leggett / Diosi master equation for rho(x,x') on the x1 box,
+    // with the coefficients of the Wigner kernel. rho is taken to vanish at
+    // the box edges; the kinetic step treats the box as periodic.
+    //
+    //   d rho/dt = -i/hb [H, rho] - gamma u d_u rho - gamma m kT u^2/hb^2 rho
+    //              + Dqq (d_x + d_x')^2 rho,        u = x - x'
+    //
+    // Strang split over one step, A/2 B/2 C B/2 A/2:
+    //   A  potential phase and decoherence, diagonal in (x, x')
+    //   B  friction, rho(X, u) -> rho(X, u exp(-gamma t)) at fixed X
+    //   C  kinetic phase and Dqq damping, diagonal in (k, k')
+    log->log("[Diosi2d] Density-matrix evolve starts ...\n");
+
+    FILE *pfile;
+    const int N = BoxShape[0];
+    const int nsteps = (int)(TIME / kk);
+    const double Dxx = gamma * m * kb * temp / (hb * hb);
+    const double Dqq = (temp == 0.0 || !isModCL ) ? 0.0 : gamma * hb * hb / (12.0 * m * kb * temp);
+    const double cfric = exp(-0.5 * gamma * kk);
+    double xx1, xx2, sum, trace, ekin, epot;
+    double t_0_begin, t_0_end;
+
+    log->log("[Diosi2d] Number of grids = (%d, %d)\n", N, N);
+    log->log("[Diosi2d] Decoherence gamma m kT / hb^2 = %.8lf\n", Dxx);
+    log->log("[Diosi2d] Dqq = %.8lf\n", Dqq);
+
+    if ( isModCL )
+        log->log("[Diosi2d] Dpq cross diffusion is not part of the density-matrix engine\n");
+
+    std::vector<std::complex<double>> Rho((size_t) N * N);
+    std::vector<std::complex<double>> PhaseA((size_t) N * N);  // A over half a step
+    std::vector<std::complex<double>> PhaseC((size_t) N * N);  // C over a full step
+    std::vector<double> V(N);
+    std::vector<double> Density(N);
+
+    SpectralShift spectral;
+    spectral.init(N, H[0]);
+
+    for (int i1 = 0; i1 < N; i1 ++)
+        V[i1] = POTENTIAL(Box[0] + i1 * H[0], 0.0);
+
+    #pragma omp parallel for
+    for (int i1 = 0; i1 < N; i1 ++)  {
+        double kx, kxp, u;
+        for (int j1 = 0; j1 < N; j1 ++)  {
+            u = (i1 - j1) * H[0];
+            PhaseA[(size_t) i1*N+j1] = std::polar(exp(-0.5 * kk * Dxx * u * u), -0.5 * kk * (V[i1] - V[j1]) / hb);
+
+            // Rows carry k of x, columns k' of x'; both are forward DFTs, so
+            // the x' wavenumber enters with the opposite sign
+            kx = spectral.Wavenumber(i1);
+            kxp = spectral.Wavenumber(j1);
+            PhaseC[(size_t) i1*N+j1] = std::polar(exp(-kk * Dqq * (kx + kxp) * (kx + kxp)), -kk * hb * (kx * kx - kxp * kxp) / (2.0 * m));
+        }
+    }
+
+    // Initial rho from the Wigner function, the transform of the dmatrix.dat
+    // post-pass with W taken at the midpoint (x + x')/2
+    log->log("[Diosi2d] Initializing density matrix ...\n");
+
+    #pragma omp parallel for
+    for (int i1 = 0; i1 < N; i1 ++)  {
+        for (int j1 = 0; j1 < N; j1 ++)  {
+            std::complex<double> r = 0.0;
+            double xm = Box[0] + 0.5 * (i1 + j1) * H[0];
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                double xp = Box[2] + i2 * H[1];
+                r += WAVEFUNCTION(xm, xp) * std::polar(1.0, xp * (i1 - j1) * H[0] / hb);
+            }
+            Rho[(size_t) i1*N+j1] = r * H[1];
+        }
+    }
+
+    trace = 0.0;
+
+    for (int i1 = 0; i1 < N; i1 ++)
+        trace += Rho[(size_t) i1*N+i1].real() * H[0];
+
+    log->log("[Diosi2d] Initial trace = %.16e\n", trace);
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < (size_t) N * N; i ++)
+        Rho[i] /= trace;
+
+    log->log("=======================================================\n\n");
+    log->log("[Diosi2d] Time interation starts ...\n");
+    log->log("[Diosi2d] Number of steps = %d\n\n", nsteps);
+    log->log("=======================================================\n\n");
+
+    for (int tt = 0; tt < nsteps; tt ++)
+    {
+        t_0_begin = omp_get_wtime();
+
+        for (int i1 = 0; i1 < N; i1 ++)
+            Density[i1] = Rho[(size_t) i1*N+i1].real();
+
+        if ( tt % PRINT_PERIOD == 0 )
+        {
+            if ( isPrintLocalDensity )  {
+                pfile = fopen ("density.dat","a");
+                fprintf(pfile, "%d %lf %d\n", tt, tt * kk, N);
+                for (int i1 = 0; i1 < N; i1 ++)  {
+                    xx1 = Box[0] + i1 * H[0];
+                    fprintf(pfile, "%.4f %.16e\n", xx1, Density[i1]);
+                }
+                fclose(pfile);
+            }
+
+            if ( isDensityMatrix )  {
+                pfile = fopen ("dmatrix.dat","a");
+                fprintf(pfile, "%d %lf %d\n", tt, tt * kk, N * N );
+                for (int i1 = 0; i1 < N; i1 ++)  {
+                    for (int j1 = 0; j1 < N; j1 ++)  {
+                        xx1 = Box[0] + i1 * H[0];
+                        xx2 = Box[0] + j1 * H[0];
+                        fprintf(pfile, "%lf %lf %.16e\n", xx1, xx2, Rho[(size_t) i1*N+j1].real());
+                    }
+                }
+                fclose(pfile);
+            }
+        }
+
+        if ( tt % PERIOD == 0 )  {
+
+            // <E> = Tr(H rho): 4th-order d^2/dx^2 of rho(x, x_i) at x = x_i,
+            // zero past the box
+            trace = 0.0;
+            ekin = 0.0;
+            epot = 0.0;
+
+            #pragma omp parallel for reduction (+:trace,ekin,epot)
+            for (int i1 = 0; i1 < N; i1 ++)  {
+                double r0 = Rho[(size_t) i1*N+i1].real();
+                double rp1 = (i1+1 < N) ? Rho[(size_t) (i1+1)*N+i1].real() : 0.0;
+                double rm1 = (i1-1 >= 0) ? Rho[(size_t) (i1-1)*N+i1].real() : 0.0;
+                double rp2 = (i1+2 < N) ? Rho[(size_t) (i1+2)*N+i1].real() : 0.0;
+                double rm2 = (i1-2 >= 0) ? Rho[(size_t) (i1-2)*N+i1].real() : 0.0;
+                trace += r0;
+                ekin += -hb * hb / (2.0 * m) * (-rp2 + 16.0 * rp1 - 30.0 * r0 + 16.0 * rm1 - rm2) / (12.0 * H[0] * H[0]);
+                epot += V[i1] * r0;
+            }
+            sum = ekin + epot;
+            log->log("[Diosi2d] Time %lf, <E> = %.16e cm^-1\n", tt * kk, sum * H[0] / WN_TO_HARTREE );
+            log->log("[Diosi2d] Time %lf, Tr rho = %.16e\n", tt * kk, trace * H[0]);
+        }
+
+        // A/2
+        #pragma omp parallel for
+        for (size_t i = 0; i < (size_t) N * N; i ++)
+            Rho[i] *= PhaseA[i];
+
+        // B/2
+        if ( gamma != 0.0 )
+            FrictionDM(Rho.data(), cfric);
+
+        // C: forward along x' (rows) and x (columns), phase, back
+        #pragma omp parallel
+        {
+            std::vector<std::complex<double>> work(spectral.workSize());
+
+            #pragma omp for schedule(dynamic,4)
+            for (int i1 = 0; i1 < N; i1 ++)
+                spectral.Transform(Rho.data() + (size_t) i1 * N, 1, false, work.data());
+
+            #pragma omp for schedule(dynamic,4)
+            for (int j1 = 0; j1 < N; j1 ++)  {
+                spectral.Transform(Rho.data() + j1, N, false, work.data());
+                for (int i1 = 0; i1 < N; i1 ++)
+                    Rho[(size_t) i1*N+j1] *= PhaseC[(size_t) i1*N+j1];
+                spectral.Transform(Rho.data() + j1, N, true, work.data());
+            }
+
+            #pragma omp for schedule(dynamic,4)
+            for (int i1 = 0; i1 < N; i1 ++)
+                spectral.Transform(Rho.data() + (size_t) i1 * N, 1, true, work.data());
+        }
+
+        // B/2
+        if ( gamma != 0.0 )
+            FrictionDM(Rho.data(), cfric);
+
+        // A/2
+        #pragma omp parallel for
+        for (size_t i = 0; i < (size_t) N * N; i ++)
+            Rho[i] *= PhaseA[i];
+
+        t_0_end = omp_get_wtime();
+
+        if (!QUIET && TIMING) log->log("Elapsed time (dm-step) = %lf sec\n", t_0_end - t_0_begin);
+    }
+    log->log("[Diosi2d] Density-matrix evolve done.\n");
+}
+/* ------------------------------------------------------------------------------- */
+
+void Diosi2d::FrictionDM(std::complex<double> *Rho, double c)
+{
+    // rho(X, u) -> rho(X, c u) on each anti-diagonal i + j = s, where the
+    // grid points sit at u = (2i - s) h. Cubic Lagrange in i; points past
+    // the box count as zero. u = 0 is fixed, so the trace is kept.
+    const int N = BoxShape[0];
+
+    #pragma omp parallel
+    {
+        std::vector<std::complex<double>> line(N);
+
+        #pragma omp for schedule(dynamic,8)
+        for (int s = 0; s <= 2 * (N - 1); s ++)  {
+
+            int ilo = std::max(0, s - N + 1);
+            int ihi = std::min(N - 1, s);
+
+            for (int i = ilo; i <= ihi; i ++)
+                line[i-ilo] = Rho[(size_t) i*N+(s-i)];
+
+            for (int i = ilo; i <= ihi; i ++)  {
+                double t = 0.5 * s + (i - 0.5 * s) * c - ilo;
+                int t0 = (int) std::floor(t);
+                double a = t - t0;
+                double w[4] = { -a * (a - 1.0) * (a - 2.0) / 6.0,
+                                (a + 1.0) * (a - 1.0) * (a - 2.0) / 2.0,
+                                -(a + 1.0) * a * (a - 2.0) / 2.0,
+                                (a + 1.0) * a * (a - 1.0) / 6.0 };
+                std::complex<double> r = 0.0;
+                for (int q = 0; q < 4; q ++)  {
+                    int tq = t0 - 1 + q;
+                    if ( tq >= 0 && tq <= ihi - ilo )
+                        r += w[q] * line[tq];
+                }
+                Rho[(size_t) i*N+(s-i)] = r;
+            }
+        }
+    }
+}
 /* =============================================================================== */
 
 /* DS2DPOT_DW1 */
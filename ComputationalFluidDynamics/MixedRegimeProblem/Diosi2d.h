@@ -16,12 +16,16 @@
 #define QTR_DIOSI2D_H
 
 #include <complex>
+#include <string>
+#include <vector>
 
 #include "Containers.h"
 #include "Eigen.h"
 #include "Pointers.h"
 
 namespace QTR_NS {
+
+    class SpectralShift;
     
     class Diosi2d {
         
@@ -61,6 +65,19 @@ namespace QTR_NS {
     private:
 
         void            init();
+        void            BuildSpans(const bool *TAMask, int x1_min, int x1_max, int x2_min, int x2_max);
+        void            EvolveGrid(double t0);
+        void            SetGrid(int level);
+        void            Prolong(int n0c, int n1c, double h1c);
+        inline double   ForceFluxClosure(int i1, double a, double b, double *F, double *Kp, double *Kn, double *FF);
+        void            StreamX(double *F, double dt, SpectralShift &spectral);
+        void            MultirateSetup();
+        void            MultirateStep(int tt, int nsteps, double *F, double *FF, const double *Feq_loc, double *U, double *K);
+        void            MultiratePass(bool isSlow, int sub, int nsub, const double *F, double *FF, const double *Feq_loc, double *U, double *K);
+        inline void     MultirateRow(int i1, double dt, const double *U, const double *Feq_loc, double *K);
+        inline double   MultirateFace(int a, int i2, double dt, const double *U);
+        void            EvolveDM();
+        void            FrictionDM(std::complex<double> *Rho, double c);
         QTR             *qtr;
         Error           *err;
         Log             *log;
@@ -73,10 +90,16 @@ namespace QTR_NS {
         int             PERIOD;
         int             SORT_PERIOD;
         int             PRINT_PERIOD;
+        int             TELEMETRY_PERIOD; // steps between telemetry.csv records, 0 if disabled
         int             PRINT_WAVEFUNC_PERIOD;
+        int             AUTO_GRID_PERIOD;
+        int             OOC_SLAB;       // x1 rows per out-of-core slab
+        std::string     OOC_DIR;        // scratch directory of the mapped arrays, empty if in memory
         int             GRIDS_TOT;
         bool            QUIET;
         bool            TIMING;
+        std::string     TIMING_LOG;  // file of the per-region timing lines, empty for the log
+        bool            ENERGY;      // RAPL energy of the time iteration
         double          TIME;   
         double          PI_INV;  // 1/pi
 
@@ -94,6 +117,11 @@ namespace QTR_NS {
         int             W1;
         int             O1;
 
+        // Active x2 runs of each x1 row of the TA, see BuildSpans
+        std::vector<int> SpanPtr;
+        std::vector<int> SpanLo;
+        std::vector<int> SpanHi;
+
         // Potential parameters
         int             idx_x0;  
         int             skin;     
@@ -120,6 +148,7 @@ namespace QTR_NS {
         // Truncate parameters
         bool            isEmpty;
         bool            isFullGrid; 
+        bool            isAutoGrid;    // switch between TG and FG at runtime
         bool            isExtrapolate; 
         bool            isTouchBoundary;              
         double          TolH;
@@ -127,6 +156,7 @@ namespace QTR_NS {
         double          TolHd;
         double          TolLd;
         double          ExReduce;
+        double          AutoGridThreshold;
         int             ExLimit;
 
         // Domains
@@ -147,10 +177,33 @@ namespace QTR_NS {
         bool            isPrintLocalTemperature;
         bool            isPrintWavefunc;
         bool            isDensityMatrix;
+        bool            isDMEngine;      // split-operator rho(x1,x1') in place of the Wigner solver
 
         // Condition for Local Maxwellian
         bool            isIsothermal;
         bool            isLinearizedCollision;
+        bool            isConservative;  // zero-flux p edges and stage-matched Feq on the full grid
+        bool            isSpectralX;     // exact Fourier x1 streaming split around the full-grid RK4
+
+        // Multirate: x1 rows in a fast class stepping with kk and a slow
+        // class stepping with MR_RATIO * kk, see MultirateStep
+        bool            isMultirate;
+        int             MR_RATIO;
+        double          MR_CFL;        // bound on k * rate of a slow row
+        std::vector<int> MRSlow;       // class of each row, 1 if slow
+        std::vector<int> MRGhost;      // halo slot of rows near the other class, -1 if none
+        std::vector<int> MRFace;       // rows a whose face a + 1/2 is a class interface
+        std::vector<double> MRHalo;    // fast rows: F at the slow step start; slow rows: increment per fast step
+        std::vector<double> MRFlux;    // fast minus slow x1 face increments over the slow step
+
+        // Grid sequencing
+        int             ML_LEVELS;     // number of coarse levels, 0 if disabled
+        int             ML_LEVEL;      // current level, 0 is the target grid
+        int             ML_PERIOD;     // steps between moment convergence checks
+        double          ML_TOL;        // relative change of the x-moments to leave a level
+        double          ML_T;          // time simulated on the last level
+        std::vector<double> ML_F;      // F handed from one level to the next
+        std::vector<double> ML_Moments;
     };
 }
 
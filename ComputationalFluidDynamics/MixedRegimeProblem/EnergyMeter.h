@@ -0,0 +1,61 @@
+// ==============================================================================
+//
+//  EnergyMeter.h
+//  QTR
+//
+//  Note: Package and DRAM energy from the RAPL counters under
+//        /sys/class/powercap. Each intel-rapl:N zone is a package, its
+//        "dram" subzone the memory attached to it. The counters are
+//        microjoule registers that wrap at max_energy_range_uj, so update()
+//        has to be called at least once per wrap period (minutes at full
+//        load) to keep the running totals right. Without readable counters
+//        (no powercap, no permission, not Intel/AMD RAPL) open() returns 0
+//        and every reading is zero.
+//
+// ==============================================================================
+
+#ifndef QTR_ENERGYMETER_H
+#define QTR_ENERGYMETER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using std::string;
+
+namespace QTR_NS {
+
+    class EnergyMeter {
+
+    public:
+        EnergyMeter();
+        ~EnergyMeter();
+
+        int             open();       // number of readable zones
+        bool            isEnabled();
+        void            update();     // fold the counter deltas into the totals
+        double          package();    // J since open()
+        double          dram();       // J since open()
+        double          total();      // package() + dram()
+        string          zones();      // names of the zones read, for the log
+        void            close();
+
+    private:
+        struct Zone {
+            string      name;
+            int         fd;
+            bool        isDram;
+            uint64_t    range;        // counter wraps here (uJ)
+            uint64_t    last;         // last raw reading (uJ)
+            double      joules;
+        };
+
+        void            AddZone(string dir, bool isDram);
+        static bool     ReadU64(int fd, uint64_t &v);
+        static string   ReadLine(string path);
+
+        std::vector<Zone> Zones;
+    };
+}
+
+#endif /* QTR_ENERGYMETER_H */
@@ -57,6 +57,7 @@ namespace QTR_NS   {
         // SCATTERXD //
         int      scxd_dimensions;
         bool     scxd_isFullGrid;
+        bool     scxd_isAutoGrid;
         bool     scxd_isTrans;
         bool     scxd_isAcf;
         bool     scxd_isDensityMatrix;
@@ -69,6 +70,9 @@ namespace QTR_NS   {
         bool     scxd_isPrintWavefunc;
         bool     scxd_isIsothermal;
         bool     scxd_isLinearizedCollision;
+        bool     scxd_isConservative;  // mass-conserving full grid, no renormalization
+        bool     scxd_isSpectralX;     // Fourier x1 streaming on the full grid
+        bool     scxd_isDMEngine;      // evolve rho(x1,x1') instead of the Wigner function
         bool     scxd_isModCL;
         bool     scxd_isDampX1;
         bool     scxd_isDampX2;
@@ -77,8 +81,14 @@ namespace QTR_NS   {
         int      scxd_Vmode_3; 
         int      scxd_Vmode_4;    
         int      scxd_period;
+        int      scxd_autogridperiod;
+        int      scxd_oocslab;
+        int      scxd_mlevels;   // coarse grid levels before the target grid
+        int      scxd_mlperiod;
+        int      scxd_mrratio;   // fast steps per slow-class step, < 2 if disabled
         int      scxd_sortperiod;
         int      scxd_printperiod;
+        int      scxd_telemetryperiod;     // truncation telemetry period, 0 if disabled
         int      scxd_printwavefuncperiod;
         int      scxd_ExLimit;
         int      scxd_cfactor;
@@ -127,6 +137,9 @@ namespace QTR_NS   {
         double     scxd_TolHd;
         double     scxd_TolLd;
         double     scxd_ExReduce;
+        double     scxd_AutoGridThreshold;
+        double     scxd_mltol;
+        double     scxd_mrcfl;  // bound on k * rate of a slow-class row
         double     scxd_w;  // HO specific
         double     scxd_V0; // Eckart potential 
         double     scxd_ek2v;
@@ -157,6 +170,9 @@ namespace QTR_NS   {
         double     scxd_omega;  // phase
         double     scxd_trans_x0;
         double     scxd_quantumness;
+        string     scxd_oocdir;  // out-of-core scratch directory, empty to disable
+        string     scxd_timinglog; // file of the per-region timing lines, empty for the log
+        bool       scxd_energy;    // RAPL energy summary of the time iteration
         
         // RANDOM //
         string     rngType;
@@ -16,12 +16,16 @@
 #define QTR_DIOSI2D_H
 
 #include <complex>
+#include <string>
+#include <vector>
 
 #include "Containers.h"
 #include "Eigen.h"
 #include "Pointers.h"
 
 namespace QTR_NS {
+
+    class SpectralShift;
     
     class Diosi2d {
         
@@ -61,6 +65,14 @@ namespace QTR_NS {
     private:
 
         void            init();
+        void            BuildSpans(const bool *TAMask, int x1_min, int x1_max, int x2_min, int x2_max);
+        void            EvolveGrid(double t0);
+        void            SetGrid(int level);
+        void            Prolong(int n0c, int n1c, double h1c);
+        inline double   ForceFluxClosure(int i1, double a, double b, double *F, double *Kp, double *Kn, double *FF);
+        void            StreamX(double *F, double dt, SpectralShift &spectral);
+        void            EvolveDM();
+        void            FrictionDM(std::complex<double> *Rho, double c);
         QTR             *qtr;
         Error           *err;
         Log             *log;
@@ -73,10 +85,16 @@ namespace QTR_NS {
         int             PERIOD;
         int             SORT_PERIOD;
         int             PRINT_PERIOD;
+        int             TELEMETRY_PERIOD; // steps between telemetry.csv records, 0 if disabled
         int             PRINT_WAVEFUNC_PERIOD;
+        int             AUTO_GRID_PERIOD;
+        int             OOC_SLAB;       // x1 rows per out-of-core slab
+        std::string     OOC_DIR;        // scratch directory of the mapped arrays, empty if in memory
         int             GRIDS_TOT;
         bool            QUIET;
         bool            TIMING;
+        std::string     TIMING_LOG;  // file of the per-region timing lines, empty for the log
+        bool            ENERGY;      // RAPL energy of the time iteration
         double          TIME;   
         double          PI_INV;  // 1/pi
 
@@ -94,6 +112,11 @@ namespace QTR_NS {
         int             W1;
         int             O1;
 
+        // Active x2 runs of each x1 row of the TA, see BuildSpans
+        std::vector<int> SpanPtr;
+        std::vector<int> SpanLo;
+        std::vector<int> SpanHi;
+
         // Potential parameters
         int             idx_x0;  
         int             skin;     
@@ -120,6 +143,7 @@ namespace QTR_NS {
         // Truncate parameters
         bool            isEmpty;
         bool            isFullGrid; 
+        bool            isAutoGrid;    // switch between TG and FG at runtime
         bool            isExtrapolate; 
         bool            isTouchBoundary;              
         double          TolH;
@@ -127,6 +151,7 @@ namespace QTR_NS {
         double          TolHd;
         double          TolLd;
         double          ExReduce;
+        double          AutoGridThreshold;
         int             ExLimit;
 
         // Domains
@@ -147,10 +172,22 @@ namespace QTR_NS {
         bool            isPrintLocalTemperature;
         bool            isPrintWavefunc;
         bool            isDensityMatrix;
+        bool            isDMEngine;      // split-operator rho(x1,x1') in place of the Wigner solver
 
         // Condition for Local Maxwellian
         bool            isIsothermal;
         bool            isLinearizedCollision;
+        bool            isConservative;  // zero-flux p edges and stage-matched Feq on the full grid
+        bool            isSpectralX;     // exact Fourier x1 streaming split around the full-grid RK4
+
+        // Grid sequencing
+        int             ML_LEVELS;     // number of coarse levels, 0 if disabled
+        int             ML_LEVEL;      // current level, 0 is the target grid
+        int             ML_PERIOD;     // steps between moment convergence checks
+        double          ML_TOL;        // relative change of the x-moments to leave a level
+        double          ML_T;          // time simulated on the last level
+        std::vector<double> ML_F;      // F handed from one level to the next
+        std::vector<double> ML_Moments;
     };
 }
 
@@ -0,0 +1,73 @@
+// ==============================================================================
+//
+//  OutOfCore.h
+//  QTR
+//
+//  Note: Grid arrays backed by memory-mapped scratch files, for grids that
+//        do not fit in RAM. A sweep over rows [r0, r1) runs slab by slab,
+//        the parallel loop inside a serial one:
+//
+//            for (int s = r0; s < r1; s = ooc.End(s, r1))  {
+//                ooc.Stream(s, r1, {F, FF});   // one thread
+//                for (int i1 = s; i1 < ooc.End(s, r1); i1 ++) ...
+//            }
+//
+//        Stream prefetches the next slab of the listed arrays asynchronously
+//        (MADV_WILLNEED) and releases the slab behind (MADV_DONTNEED), so each
+//        array keeps a window of about two slabs plus the stencil halo. With
+//        no directory set, alloc() falls back to the heap and End() returns
+//        r1, a single slab.
+//
+// ==============================================================================
+
+#ifndef QTR_OUTOFCORE_H
+#define QTR_OUTOFCORE_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+using std::string;
+
+namespace QTR_NS {
+
+    class OutOfCore {
+
+    public:
+        OutOfCore();
+        ~OutOfCore();
+
+        void            open(string dir, int rows, int width, int slab, int halo);
+        bool            isEnabled();
+        int             mapped();
+
+        double          *alloc(size_t n);
+        void            free(double *p);
+
+        // End of the slab that starts at row s of a sweep ending at r1
+        inline int      End(int s, int r1)
+        {
+            return ( slab > 0 && s + slab < r1 ) ? s + slab : r1;
+        }
+        void            Stream(int s, int r1, std::initializer_list<const double *> arrays);
+
+    private:
+        struct Mapping {
+            double      *ptr;
+            size_t      bytes;
+        };
+
+        void            Advise(const double *p, int r0, int r1, int advice);
+
+        std::vector<Mapping> Maps;
+        string          dir;
+        int             rows;
+        int             width;
+        int             slab;   // rows per slab, 0 if disabled
+        int             halo;   // stencil rows beyond a slab
+        size_t          page;
+    };
+}
+
+#endif /* QTR_OUTOFCORE_H */
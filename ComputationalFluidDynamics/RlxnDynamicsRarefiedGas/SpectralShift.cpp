@@ -0,0 +1,204 @@
+// ==============================================================================
+//
+//  SpectralShift.cpp
+//  QTR
+//
+//  Note: Only the forward transform is implemented; the inverse is taken as
+//        conj(DFT(conj(x))) / n.
+//
+// ==============================================================================
+
+#include <cmath>
+#include <cstddef>
+
+#include "SpectralShift.h"
+
+using namespace QTR_NS;
+
+typedef std::complex<double> cplx;
+
+// Complex product without the C99 NaN/Inf recovery (__muldc3) that
+// operator* goes through unless built with -ffast-math
+static inline cplx Mul(const cplx &a, const cplx &b)
+{
+    return cplx(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+/* ------------------------------------------------------------------------------- */
+
+SpectralShift::SpectralShift()
+{
+    n = 0;
+    M = 0;
+    isPow2 = true;
+}
+/* ------------------------------------------------------------------------------- */
+
+SpectralShift::~SpectralShift()
+{
+    return;
+}
+/* ------------------------------------------------------------------------------- */
+
+void SpectralShift::init(int n_in, double h)
+{
+    n = n_in;
+    isPow2 = ( n & (n - 1) ) == 0;
+    M = 1;
+
+    while ( M < ( isPow2 ? n : 2 * n - 1 ) )
+        M *= 2;
+
+    K.resize(n);
+
+    for (int k = 0; k < n; k ++)
+        K[k] = 2.0 * M_PI / (n * h) * ( k <= n / 2 ? k : k - n );
+
+    Roots.resize(M / 2);
+
+    for (int j = 0; j < M / 2; j ++)
+        Roots[j] = std::polar(1.0, -2.0 * M_PI * j / M);
+
+    if ( isPow2 )
+        return;
+
+    // Bluestein: jk = (j^2 + k^2 - (k-j)^2) / 2 turns the DFT into a convolution
+    // with the chirp exp(-i pi j^2 / n); j^2 is reduced mod 2n to keep the phase exact
+    Chirp.resize(n);
+    ChirpF.assign(M, cplx(0.0, 0.0));
+
+    for (int j = 0; j < n; j ++)
+        Chirp[j] = std::polar(1.0, -M_PI * (double) (((long long) j * j) % (2LL * n)) / n);
+
+    ChirpF[0] = std::conj(Chirp[0]);
+
+    for (int j = 1; j < n; j ++)  {
+        ChirpF[j] = std::conj(Chirp[j]);
+        ChirpF[M-j] = std::conj(Chirp[j]);
+    }
+    Radix2(ChirpF.data(), M);
+}
+/* ------------------------------------------------------------------------------- */
+
+int SpectralShift::workSize()
+{
+    return n + ( isPow2 ? 0 : M );
+}
+/* ------------------------------------------------------------------------------- */
+
+void SpectralShift::Shift2(double *a, double *b, int stride, double sa, double sb, cplx *work)
+{
+    cplx *z = work;
+    cplx za, zb, ea, eb, A, B;
+    int k2;
+
+    for (int j = 0; j < n; j ++)
+        z[j] = cplx(a[(size_t) j * stride], b == NULL ? 0.0 : b[(size_t) j * stride]);
+
+    DFT(z, work + n);
+
+    // Split Z into the spectra of a and b, apply the phase of each shift,
+    // and recombine. Modes k and n-k are conjugate, so they go together.
+    for (int k = 0; k <= n / 2; k ++)  {
+
+        k2 = ( n - k ) % n;
+        za = z[k];
+        zb = std::conj(z[k2]);
+        A = 0.5 * (za + zb);
+        B = cplx(0.0, -0.5) * (za - zb);
+
+        // The mean and the Nyquist mode of an even length are real
+        if ( k == k2 )  {
+            z[k] = A * std::cos(K[k] * sa) + cplx(0.0, 1.0) * B * std::cos(K[k] * sb);
+            continue;
+        }
+        ea = std::polar(1.0, -K[k] * sa);
+        eb = std::polar(1.0, -K[k] * sb);
+        z[k] = A * ea + cplx(0.0, 1.0) * B * eb;
+        z[k2] = std::conj(A * ea) + cplx(0.0, 1.0) * std::conj(B * eb);
+    }
+
+    for (int j = 0; j < n; j ++)
+        z[j] = std::conj(z[j]);
+
+    DFT(z, work + n);
+
+    for (int j = 0; j < n; j ++)  {
+        a[(size_t) j * stride] = z[j].real() / n;
+        if ( b != NULL )
+            b[(size_t) j * stride] = -z[j].imag() / n;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void SpectralShift::Transform(cplx *x, int stride, bool isInverse, cplx *work)
+{
+    cplx *z = work;
+
+    for (int j = 0; j < n; j ++)
+        z[j] = isInverse ? std::conj(x[(size_t) j * stride]) : x[(size_t) j * stride];
+
+    DFT(z, work + n);
+
+    for (int j = 0; j < n; j ++)
+        x[(size_t) j * stride] = isInverse ? std::conj(z[j]) / (double) n : z[j];
+}
+/* ------------------------------------------------------------------------------- */
+
+double SpectralShift::Wavenumber(int k)
+{
+    return K[k];
+}
+/* ------------------------------------------------------------------------------- */
+
+void SpectralShift::DFT(cplx *x, cplx *work)
+{
+    if ( isPow2 )  {
+        Radix2(x, n);
+        return;
+    }
+
+    for (int j = 0; j < n; j ++)
+        work[j] = Mul(x[j], Chirp[j]);
+    for (int j = n; j < M; j ++)
+        work[j] = 0.0;
+
+    Radix2(work, M);
+
+    for (int j = 0; j < M; j ++)
+        work[j] = std::conj(Mul(work[j], ChirpF[j]));
+
+    Radix2(work, M);
+
+    for (int k = 0; k < n; k ++)
+        x[k] = Mul(std::conj(work[k]), Chirp[k]) / (double) M;
+}
+/* ------------------------------------------------------------------------------- */
+
+void SpectralShift::Radix2(cplx *x, int len)
+{
+    // Iterative Cooley-Tukey; Roots holds the M-th roots, len divides M
+    int step = M / len;
+    cplx t;
+
+    for (int i = 1, j = 0; i < len; i ++)  {
+        int bit = len >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if ( i < j )
+            std::swap(x[i], x[j]);
+    }
+
+    for (int half = 1; half < len; half *= 2)  {
+        int rs = step * (len / (2 * half));
+        for (int i = 0; i < len; i += 2 * half)  {
+            for (int j = 0; j < half; j ++)  {
+                t = Mul(x[i+j+half], Roots[j * rs]);
+                x[i+j+half] = x[i+j] - t;
+                x[i+j] += t;
+            }
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
@@ -0,0 +1,558 @@
+// ==============================================================================
+//
+//  EnsembleRunner.cpp
+//  QTR
+//
+//  Note: MPI job farm for parameter sweeps. Each line of the sweep file is
+//        one run:
+//
+//          <command> <template input> [key=value ...]
+//
+//        e.g.  "./qtr_kep {input} 20200"  KEP_TG_6554.test  temp=0.05 gamma=0.0064
+//
+//        A command with arguments is quoted; # starts a comment line.
+//
+//        The template is copied with the key=value settings applied (an
+//        existing key line is rewritten in place, a new key goes under
+//        [SCATTERXD]) into <outdir>/item_NNNN/input.test, and the command
+//        runs there through /bin/sh with {input} replaced by that file
+//        (appended when absent), stdout and stderr in run.log and its own
+//        OMP_NUM_THREADS. The solver binaries stay separate processes, so
+//        one sweep can mix the KEP, SL and GaAs builds.
+//
+//        Rank 0 owns the queue. Ranks pull the next item when they finish
+//        one, sending the result row of the last; rank 0 runs items too and
+//        serves requests while its own child runs. The "Time t, Name =
+//        value" lines of each run.log give the observables, the last value
+//        of each name. The rows are written to <outdir>/ensemble.csv in
+//        sweep order.
+//
+//          mpicxx -std=c++11 -O2 EnsembleRunner.cpp -o ensemble
+//          mpirun -np 4 ./ensemble sweep.ens [outdir] [threads per rank]
+//
+//        Threads per rank default to OMP_NUM_THREADS, else the cores of the
+//        node shared by its ranks. The children are started with fork and
+//        exec right away; MPI calls stay in the parent.
+//
+// ==============================================================================
+
+#include <mpi.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using std::string;
+
+#define TAG_REQUEST  1   // rank -> 0: result row of the last item, empty at start
+#define TAG_ITEM     2   // 0 -> rank: next item, -1 to stop
+
+namespace QTR_NS {
+
+    struct WorkItem {
+        string          command;
+        string          input;
+        std::vector<std::pair<string, string> > Settings;
+    };
+
+    struct WorkResult {
+        int             rank;
+        int             status;     // exit code, -1 if never run
+        double          seconds;
+        std::vector<std::pair<string, string> > Values;
+    };
+
+    class EnsembleRunner {
+
+    public:
+        EnsembleRunner(MPI_Comm comm);
+        ~EnsembleRunner();
+
+        int             load(string filename);   // 0 on success
+        void            Run(string outdir, int threads);
+
+    private:
+        void            Master();
+        void            Worker();
+
+        pid_t           Launch(int item);
+        string          Finish(int item, int status, double seconds);
+        void            Store(const string &row);
+        int             WriteInput(int item, string dir);
+        void            WriteTable();
+        string          ItemDir(int item);
+
+        MPI_Comm        comm;
+        int             me;
+        int             nprocs;
+        int             threads;
+        string          cwd;
+        string          outdir;
+        std::vector<WorkItem> Items;
+        std::vector<WorkResult> Results;
+    };
+}
+
+using namespace QTR_NS;
+
+/* ------------------------------------------------------------------------------- */
+
+EnsembleRunner::EnsembleRunner(MPI_Comm comm_in)
+{
+    char buf[4096];
+
+    comm = comm_in;
+    MPI_Comm_rank(comm, &me);
+    MPI_Comm_size(comm, &nprocs);
+    threads = 1;
+    cwd = ( getcwd(buf, sizeof(buf)) != NULL ) ? buf : ".";
+}
+/* ------------------------------------------------------------------------------- */
+
+EnsembleRunner::~EnsembleRunner()
+{
+    return;
+}
+/* ------------------------------------------------------------------------------- */
+
+int EnsembleRunner::load(string filename)
+{
+    // Every rank reads the sweep file, so only item numbers travel
+    std::ifstream in(filename.c_str());
+    string line, word;
+
+    if ( !in )
+        return 1;
+
+    while ( std::getline(in, line) )  {
+
+        WorkItem item;
+        size_t a = line.find_first_not_of(" \t"), b;
+
+        if ( a == string::npos || line[a] == '#' )
+            continue;
+
+        if ( line[a] == '"' )  {
+            if ( (b = line.find('"', a + 1)) == string::npos )
+                return 1;
+            item.command = line.substr(a + 1, b - a - 1);
+            b ++;
+        }
+        else  {
+            b = line.find_first_of(" \t", a);
+            item.command = line.substr(a, b == string::npos ? string::npos : b - a);
+        }
+
+        std::istringstream ss(b < line.length() ? line.substr(b) : "");
+
+        if ( item.command.length() == 0 || !(ss >> item.input) )
+            return 1;
+
+        // Relative paths are taken from the launch directory, the runs
+        // start in their own
+        b = item.command.find_first_of(" \t");
+        if ( item.command[0] != '/' && item.command.substr(0, b).find('/') != string::npos )
+            item.command = cwd + "/" + item.command;
+        if ( item.input[0] != '/' )
+            item.input = cwd + "/" + item.input;
+
+        while ( ss >> word )  {
+            size_t eq = word.find('=');
+            if ( eq == string::npos || eq == 0 )
+                return 1;
+            item.Settings.push_back(std::make_pair(word.substr(0, eq), word.substr(eq + 1)));
+        }
+
+        if ( item.command.find("{input}") == string::npos )
+            item.command += " {input}";
+
+        Items.push_back(item);
+    }
+    return 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnsembleRunner::Run(string outdir_in, int threads_in)
+{
+    outdir = ( outdir_in[0] == '/' ) ? outdir_in : cwd + "/" + outdir_in;
+    threads = threads_in;
+
+    if ( me == 0 )  {
+        mkdir(outdir.c_str(), 0755);
+        Results.assign(Items.size(), WorkResult());
+        for (unsigned int i = 0; i < Results.size(); i ++)  {
+            Results[i].rank = -1;
+            Results[i].status = -1;
+            Results[i].seconds = 0.0;
+        }
+        printf("[EnsembleRunner] %d items, %d ranks, %d threads per rank\n", (int) Items.size(), nprocs, threads);
+    }
+    MPI_Barrier(comm);
+
+    if ( me == 0 )
+        Master();
+    else
+        Worker();
+
+    if ( me == 0 )  {
+        WriteTable();
+        printf("[EnsembleRunner] Results in %s/ensemble.csv\n", outdir.c_str());
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnsembleRunner::Master()
+{
+    const int n = (int) Items.size();
+    int next = 0;
+    int workers = nprocs - 1;
+    int local = -1;
+    int flag, len, item, status;
+    double t_local = 0.0;
+    pid_t pid = -1;
+    MPI_Status st;
+    std::vector<char> buf;
+
+    while ( workers > 0 || pid > 0 || next < n )  {
+
+        bool isBusy = false;
+
+        // A rank asking for work, with the row of its last item
+        MPI_Iprobe(MPI_ANY_SOURCE, TAG_REQUEST, comm, &flag, &st);
+
+        if ( flag )  {
+            MPI_Get_count(&st, MPI_CHAR, &len);
+            buf.resize(len + 1);
+            MPI_Recv(buf.data(), len, MPI_CHAR, st.MPI_SOURCE, TAG_REQUEST, comm, MPI_STATUS_IGNORE);
+            buf[len] = '\0';
+            if ( len > 0 )
+                Store(buf.data());
+
+            item = ( next < n ) ? next ++ : -1;
+            if ( item < 0 )
+                workers --;
+            MPI_Send(&item, 1, MPI_INT, st.MPI_SOURCE, TAG_ITEM, comm);
+            isBusy = true;
+        }
+
+        // Own run
+        if ( pid > 0 && waitpid(pid, &status, WNOHANG) == pid )  {
+            Store(Finish(local, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status), MPI_Wtime() - t_local));
+            pid = -1;
+            isBusy = true;
+        }
+        if ( pid < 0 && next < n )  {
+            local = next ++;
+            t_local = MPI_Wtime();
+            pid = Launch(local);
+            if ( pid < 0 )
+                Store(Finish(local, 127, 0.0));
+            isBusy = true;
+        }
+
+        if ( !isBusy )
+            usleep(2000);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnsembleRunner::Worker()
+{
+    string row;
+    int item, status;
+    double t_0;
+    pid_t pid;
+
+    for (;;)  {
+
+        MPI_Send(row.c_str(), (int) row.length(), MPI_CHAR, 0, TAG_REQUEST, comm);
+        MPI_Recv(&item, 1, MPI_INT, 0, TAG_ITEM, comm, MPI_STATUS_IGNORE);
+
+        if ( item < 0 )
+            break;
+
+        t_0 = MPI_Wtime();
+        pid = Launch(item);
+
+        if ( pid < 0 )
+            status = 127;
+        else if ( waitpid(pid, &status, 0) == pid )
+            status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        else
+            status = 127;
+
+        row = Finish(item, status, MPI_Wtime() - t_0);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+pid_t EnsembleRunner::Launch(int item)
+{
+    const string dir = ItemDir(item);
+    string cmd = Items[item].command;
+    char nthreads[16];
+    pid_t pid;
+    int fd;
+
+    mkdir(dir.c_str(), 0755);
+
+    if ( WriteInput(item, dir) )  {
+        fprintf(stderr, "[EnsembleRunner] Cannot read %s\n", Items[item].input.c_str());
+        return -1;
+    }
+
+    for (size_t p = cmd.find("{input}"); p != string::npos; p = cmd.find("{input}"))
+        cmd.replace(p, 7, "input.test");
+
+    snprintf(nthreads, sizeof(nthreads), "%d", threads);
+
+    pid = fork();
+
+    if ( pid == 0 )  {
+        if ( chdir(dir.c_str()) != 0 )
+            _exit(127);
+        fd = open("run.log", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ( fd >= 0 )  {
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+        }
+        setenv("OMP_NUM_THREADS", nthreads, 1);
+        execl("/bin/sh", "sh", "-c", cmd.c_str(), (char *) NULL);
+        _exit(127);
+    }
+    return pid;
+}
+/* ------------------------------------------------------------------------------- */
+
+string EnsembleRunner::Finish(int item, int status, double seconds)
+{
+    // Row as tab-separated fields: item, rank, status, seconds, name=value...
+    std::ifstream in((ItemDir(item) + "/run.log").c_str());
+    std::map<string, string> last;
+    std::vector<string> order;
+    std::ostringstream row;
+    string line;
+    size_t a, b, c;
+
+    while ( std::getline(in, line) )  {
+
+        // "[Solver] Time 1.000000, Corr = 9.9e-01"
+        if ( (a = line.find("] Time ")) == string::npos )
+            continue;
+        if ( (b = line.find(", ", a)) == string::npos )
+            continue;
+        if ( (c = line.find(" = ", b)) == string::npos )
+            continue;
+
+        string name = line.substr(b + 2, c - b - 2);
+        string value = line.substr(c + 3);
+        value = value.substr(0, value.find_first_of(" \t\r"));
+
+        if ( last.find(name) == last.end() )
+            order.push_back(name);
+        last[name] = value;
+    }
+
+    row << item << '\t' << me << '\t' << status << '\t' << seconds;
+    for (unsigned int i = 0; i < order.size(); i ++)
+        row << '\t' << order[i] << '=' << last[order[i]];
+
+    return row.str();
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnsembleRunner::Store(const string &row)
+{
+    std::istringstream ss(row);
+    string field;
+    int item;
+    WorkResult r;
+
+    if ( !std::getline(ss, field, '\t') )
+        return;
+    item = atoi(field.c_str());
+    if ( item < 0 || item >= (int) Results.size() )
+        return;
+
+    std::getline(ss, field, '\t');  r.rank = atoi(field.c_str());
+    std::getline(ss, field, '\t');  r.status = atoi(field.c_str());
+    std::getline(ss, field, '\t');  r.seconds = atof(field.c_str());
+
+    while ( std::getline(ss, field, '\t') )  {
+        size_t eq = field.find('=');
+        if ( eq != string::npos )
+            r.Values.push_back(std::make_pair(field.substr(0, eq), field.substr(eq + 1)));
+    }
+    Results[item] = r;
+
+    printf("[EnsembleRunner] Item %d done on rank %d, status %d, %.2lf sec\n", item, r.rank, r.status, r.seconds);
+    fflush(stdout);
+}
+/* ------------------------------------------------------------------------------- */
+
+int EnsembleRunner::WriteInput(int item, string dir)
+{
+    const WorkItem &w = Items[item];
+    std::ifstream in(w.input.c_str());
+    std::vector<string> Lines;
+    std::vector<bool> isSet(w.Settings.size(), false);
+    string line, key;
+    int scatter = -1;
+
+    if ( !in )
+        return 1;
+
+    while ( std::getline(in, line) )  {
+
+        if ( line.compare(0, 11, "[SCATTERXD]") == 0 )
+            scatter = (int) Lines.size();
+
+        key = line.substr(0, line.find('='));
+        key.erase(key.find_last_not_of(" \t") + 1);
+
+        for (unsigned int s = 0; s < w.Settings.size(); s ++)  {
+            if ( !isSet[s] && line.find('=') != string::npos && key == w.Settings[s].first )  {
+                line = key + "=" + w.Settings[s].second;
+                isSet[s] = true;
+            }
+        }
+        Lines.push_back(line);
+    }
+
+    for (int s = (int) w.Settings.size() - 1; s >= 0; s --)  {
+        if ( isSet[s] )
+            continue;
+        line = w.Settings[s].first + "=" + w.Settings[s].second;
+        if ( scatter < 0 )
+            Lines.push_back(line);
+        else
+            Lines.insert(Lines.begin() + scatter + 1, line);
+    }
+
+    std::ofstream out((dir + "/input.test").c_str());
+    for (unsigned int i = 0; i < Lines.size(); i ++)
+        out << Lines[i] << "\n";
+
+    return out.good() ? 0 : 1;
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnsembleRunner::WriteTable()
+{
+    // Columns: the settings and observables of any item, in first-seen order
+    std::vector<string> Keys, Names;
+    std::map<string, bool> seen;
+    FILE *pfile = fopen((outdir + "/ensemble.csv").c_str(), "w");
+
+    if ( pfile == NULL )  {
+        fprintf(stderr, "[EnsembleRunner] Cannot write %s/ensemble.csv\n", outdir.c_str());
+        return;
+    }
+
+    for (unsigned int i = 0; i < Items.size(); i ++)
+        for (unsigned int s = 0; s < Items[i].Settings.size(); s ++)
+            if ( !seen[Items[i].Settings[s].first] )  {
+                seen[Items[i].Settings[s].first] = true;
+                Keys.push_back(Items[i].Settings[s].first);
+            }
+    seen.clear();
+    for (unsigned int i = 0; i < Results.size(); i ++)
+        for (unsigned int v = 0; v < Results[i].Values.size(); v ++)
+            if ( !seen[Results[i].Values[v].first] )  {
+                seen[Results[i].Values[v].first] = true;
+                Names.push_back(Results[i].Values[v].first);
+            }
+
+    fprintf(pfile, "item,rank,status,seconds,input");
+    for (unsigned int k = 0; k < Keys.size(); k ++)
+        fprintf(pfile, ",%s", Keys[k].c_str());
+    for (unsigned int k = 0; k < Names.size(); k ++)
+        fprintf(pfile, ",\"%s\"", Names[k].c_str());
+    fprintf(pfile, "\n");
+
+    for (unsigned int i = 0; i < Items.size(); i ++)  {
+
+        fprintf(pfile, "%d,%d,%d,%.3lf,%s", i, Results[i].rank, Results[i].status, Results[i].seconds,
+                Items[i].input.substr(Items[i].input.rfind('/') + 1).c_str());
+
+        for (unsigned int k = 0; k < Keys.size(); k ++)  {
+            string v;
+            for (unsigned int s = 0; s < Items[i].Settings.size(); s ++)
+                if ( Items[i].Settings[s].first == Keys[k] )
+                    v = Items[i].Settings[s].second;
+            fprintf(pfile, ",%s", v.c_str());
+        }
+        for (unsigned int k = 0; k < Names.size(); k ++)  {
+            string v;
+            for (unsigned int s = 0; s < Results[i].Values.size(); s ++)
+                if ( Results[i].Values[s].first == Names[k] )
+                    v = Results[i].Values[s].second;
+            fprintf(pfile, ",%s", v.c_str());
+        }
+        fprintf(pfile, "\n");
+    }
+    fclose(pfile);
+}
+/* ------------------------------------------------------------------------------- */
+
+string EnsembleRunner::ItemDir(int item)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "/item_%04d", item);
+    return outdir + buf;
+}
+/* ------------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    MPI_Comm node;
+    int me, local_size, threads;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+    if ( argc < 2 )  {
+        if ( me == 0 )
+            fprintf(stderr, "Usage: ensemble <sweep file> [outdir] [threads per rank]\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Default team: the node's cores over the ranks placed on it
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, me, MPI_INFO_NULL, &node);
+    MPI_Comm_size(node, &local_size);
+    MPI_Comm_free(&node);
+
+    if ( argc > 3 )
+        threads = atoi(argv[3]);
+    else if ( getenv("OMP_NUM_THREADS") != NULL )
+        threads = atoi(getenv("OMP_NUM_THREADS"));
+    else
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN) / local_size;
+
+    EnsembleRunner runner(MPI_COMM_WORLD);
+
+    if ( runner.load(argv[1]) )  {
+        if ( me == 0 )
+            fprintf(stderr, "[EnsembleRunner] Cannot parse %s\n", argv[1]);
+        MPI_Finalize();
+        return 1;
+    }
+    runner.Run(argc > 2 ? argv[2] : "ensemble", threads > 0 ? threads : 1);
+
+    MPI_Finalize();
+    return 0;
+}
+/* ------------------------------------------------------------------------------- */
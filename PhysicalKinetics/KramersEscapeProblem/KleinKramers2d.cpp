@@ -24,9 +24,12 @@
 
 #include "Constants.h"
 #include "Containers.h"
+#include "EnergyMeter.h"
 #include "Error.h"
 #include "Log.h"
 #include "Parameters.h"
+#include "ResultCache.h"
+#include "TimingLog.h"
 #include "KleinKramers2d.h"
 
 using namespace QTR_NS;
@@ -37,6 +40,11 @@ using std::nothrow;
 
 #define BIG_NUMBER 2147483647
 
+// Build identity for the result cache, e.g. -DQTR_BUILD_ID=\"$(git rev-parse HEAD)\"
+#ifndef QTR_BUILD_ID
+#define QTR_BUILD_ID __DATE__ " " __TIME__ " " __VERSION__
+#endif
+
 /* ------------------------------------------------------------------------------- */
 
 // DEFINE POTENTIAL TYPE
@@ -102,10 +110,13 @@ void KleinKramers2d::init()
     PERIOD = parameters->scxd_period;
     SORT_PERIOD = parameters->scxd_sortperiod;
     PRINT_PERIOD = parameters->scxd_printperiod;
+    TELEMETRY_PERIOD = parameters->scxd_telemetryperiod;
     PRINT_WAVEFUNC_PERIOD = parameters->scxd_printwavefuncperiod;
     TIME = parameters->scxd_Tf;
     QUIET = parameters->quiet;
     TIMING = parameters->timing;
+    TIMING_LOG = parameters->scxd_timinglog;
+    ENERGY = parameters->scxd_energy;
     isTrans = parameters->scxd_isTrans;
     isCorr = parameters->scxd_isAcf;
     isPrintEdge = parameters->scxd_isPrintEdge;
@@ -144,6 +155,12 @@ void KleinKramers2d::init()
     Box[3] = parameters->scxd_xf2; 
     BoxShape.resize(DIMENSIONS);
 
+    isAutoBox = parameters->scxd_isAutoBox;
+    AutoBoxTol = parameters->scxd_AutoBoxTol;
+
+    if ( isAutoBox )
+        AutoBox();
+
     GRIDS_TOT = 1;
     log->log("[KleinKramers2d] Number of grids = (");
 
@@ -187,8 +204,52 @@ void KleinKramers2d::init()
     log->log("[KleinKramers2d] A[0]: %lf\n", A[0]);
     log->log("[KleinKramers2d] A[1]: %lf\n", A[1]);
 
+    // Initial state: 0 = wavefunction, 1 = local Maxwellian, 2 = basin Boltzmann
+    INIT_MODE = parameters->scxd_initmode;
+    log->log("[KleinKramers2d] INIT_MODE: %d\n", INIT_MODE);
+
+    // Parareal time integration (full grid only)
+    PR_SLICES = parameters->scxd_pslices;
+    PR_ITERS = ( parameters->scxd_piters > 0 ) ? parameters->scxd_piters : PR_SLICES;
+    PR_COARSE = std::max(1, parameters->scxd_pcoarse);
+    PR_TOL = parameters->scxd_ptol;
+
+    if ( PR_SLICES > 1 )  {
+        log->log("[KleinKramers2d] PR_SLICES: %d\n", PR_SLICES);
+        log->log("[KleinKramers2d] PR_ITERS: %d\n", PR_ITERS);
+        log->log("[KleinKramers2d] PR_COARSE: %d\n", PR_COARSE);
+        log->log("[KleinKramers2d] PR_TOL: %e\n", PR_TOL);
+    }
+
+    // Discontinuous Galerkin discretization (full grid only)
+    DG_RATIO = parameters->scxd_dgratio;
+    DG_ORDER = parameters->scxd_dgorder;
+    DG_CFL = parameters->scxd_dgcfl;
+
+    if ( DG_RATIO > 1 )  {
+        log->log("[KleinKramers2d] DG_RATIO: %d\n", DG_RATIO);
+        log->log("[KleinKramers2d] DG_ORDER: %d\n", DG_ORDER);
+        log->log("[KleinKramers2d] DG_CFL: %lf\n", DG_CFL);
+
+        // P2 fits three modes per direction to the element points
+        if ( DG_ORDER > 1 && DG_RATIO < 3 )  {
+            DG_ORDER = 1;
+            log->log("[KleinKramers2d] DG_ORDER lowered to 1, P2 needs DG_RATIO >= 3\n");
+        }
+
+        // The elements tile the interior from its lower corner
+        if ( (BoxShape[0] - 2 * EDGE) % DG_RATIO != 0 || (BoxShape[1] - 2 * EDGE) % DG_RATIO != 0 )
+            log->log("[KleinKramers2d] DG: %d x1 row(s) and %d x2 column(s) past the last element are dropped, "
+                     "%d x %d interior points are not multiples of DG_RATIO\n",
+                     (BoxShape[0] - 2 * EDGE) % DG_RATIO, (BoxShape[1] - 2 * EDGE) % DG_RATIO,
+                     BoxShape[0] - 2 * EDGE, BoxShape[1] - 2 * EDGE);
+    }
+
     // Truncate parameters
     isFullGrid = parameters->scxd_isFullGrid;
+    isAutoGrid = parameters->scxd_isAutoGrid;
+    AUTO_GRID_PERIOD = parameters->scxd_autogridperiod;
+    AutoGridThreshold = parameters->scxd_AutoGridThreshold; // Relative predicted gain required to switch
     TolH = parameters->scxd_TolH;    // Tolerance of probability density for Zero point Cutoff
     TolL = parameters->scxd_TolL;    // Tolerance of probability density for Edge point
     TolHd = parameters->scxd_TolHd;  // Tolerance of probability first diff for Zero point Cutoff
@@ -201,24 +262,208 @@ void KleinKramers2d::init()
     idx_x0 = (int) std::round( ( trans_x0 - Box[0] ) / H[0] );
 
     log->log("[KleinKramers2d] isFullGrid: %d\n", (int)isFullGrid);
+    log->log("[KleinKramers2d] isAutoGrid: %d\n", (int)isAutoGrid);
+    if ( isAutoGrid )  {
+        log->log("[KleinKramers2d] AUTO_GRID_PERIOD: %d\n", AUTO_GRID_PERIOD);
+        log->log("[KleinKramers2d] AutoGridThreshold: %lf\n", AutoGridThreshold);
+    }
     log->log("[KleinKramers2d] TolH: %e\n", TolH);
     log->log("[KleinKramers2d] TolL: %e\n", TolL);
     log->log("[KleinKramers2d] TolHd: %e\n", TolHd);
     log->log("[KleinKramers2d] TolLd: %e\n", TolLd);
     log->log("[KleinKramers2d] ExReduce: %lf\n", ExReduce);
     log->log("[KleinKramers2d] ExLimit: %d\n", ExLimit);
+
+    // Team size of the truncated-grid parallel regions
+    isAdaptiveThreads = parameters->scxd_isAdaptiveThreads;
+    MAX_THREADS = omp_get_max_threads();
+    MIN_WORK_THREAD = 1;
+    log->log("[KleinKramers2d] isAdaptiveThreads: %d\n", (int)isAdaptiveThreads);
+
+    if ( isAdaptiveThreads )
+        CalibrateThreads();
+
+    // Result cache
+    CACHE_DIR = parameters->scxd_cachedir;
+    isCacheState = parameters->scxd_isCacheState;
+
+    if ( CACHE_DIR.length() > 0 )  {
+        log->log("[KleinKramers2d] cachedir: %s\n", CACHE_DIR.c_str());
+        log->log("[KleinKramers2d] isCacheState: %d\n", (int)isCacheState);
+    }
+
     log->log("[KleinKramers2d] trans_x0: %d\n", trans_x0);
     log->log("[KleinKramers2d] idx_x0: %d\n", idx_x0);
+
+    // Parity symmetry f(x,p) = f(-x,-p), full grid only
+    SYM_MODE = parameters->scxd_symmetry;
+    isSymmetric = SYM_MODE > 0 && isFullGrid && !isAutoGrid && PR_SLICES < 2 && DG_RATIO < 2 && CheckParity();
+    SYM_ROWS = isSymmetric ? (BoxShape[0] + 1) / 2 : BoxShape[0] - EDGE;
+
+    if ( SYM_MODE > 0 )  {
+        log->log("[KleinKramers2d] SYM_MODE: %d\n", SYM_MODE);
+        if ( isSymmetric )
+            log->log("[KleinKramers2d] Parity symmetry: solving %d of %d rows\n", SYM_ROWS, BoxShape[0]);
+        else
+            log->log("[KleinKramers2d] Parity symmetry not applicable, solving the full domain\n");
+    }
     log->log("[KleinKramers2d] INIT done.\n\n");
 }
 /* ------------------------------------------------------------------------------- */
 
+void KleinKramers2d::AutoBox()
+{
+    // Reachable energy: the thermal tail down to AutoBoxTol plus the potential
+    // energy of the initial state above the bottom of the landscape. x1 keeps
+    // the points whose potential lies within it, x2 the momenta of that
+    // kinetic energy, both widened to hold the initial wave packet.
+    double lnt = std::log(1.0 / AutoBoxTol);
+    double x0 = parameters->scxd_x01;
+    double hw1 = std::sqrt(lnt / (2.0 * parameters->scxd_a1));
+    double hw2 = parameters->scxd_hb * std::sqrt(2.0 * parameters->scxd_a2 * lnt);
+    double user[4] = {Box[0], Box[1], Box[2], Box[3]};
+    int n1 = (int)std::round((Box[1] - Box[0]) / H[0]) + 1;
+    double vmin = POTENTIAL(x0, 0.0);
+    double eacc, xx1, lo, hi, pmax;
+
+    for (int i1 = 0; i1 < n1; i1 ++)
+        vmin = std::min(vmin, POTENTIAL(Box[0] + i1 * H[0], 0.0));
+
+    eacc = parameters->scxd_kb * parameters->scxd_temp * lnt + POTENTIAL(x0, 0.0) - vmin;
+
+    lo = x0 - hw1;
+    hi = x0 + hw1;
+
+    for (int i1 = 0; i1 < n1; i1 ++)  {
+        xx1 = Box[0] + i1 * H[0];
+        if ( POTENTIAL(xx1, 0.0) - vmin <= eacc )  {
+            lo = std::min(lo, xx1);
+            hi = std::max(hi, xx1);
+        }
+    }
+    SnapBox(0, lo, hi);
+
+    pmax = std::max(std::sqrt(2.0 * parameters->scxd_m * eacc), std::abs(parameters->scxd_x02) + hw2);
+    SnapBox(1, -pmax, pmax);
+
+    log->log("[KleinKramers2d] Auto box: reachable energy %e\n", eacc);
+    log->log("[KleinKramers2d] Auto box: x1 [%lf, %lf] of [%lf, %lf]\n", Box[0], Box[1], user[0], user[1]);
+    log->log("[KleinKramers2d] Auto box: x2 [%lf, %lf] of [%lf, %lf]\n", Box[2], Box[3], user[2], user[3]);
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::SnapBox(int dim, double lo, double hi)
+{
+    // Widen [lo, hi] by the edge cells and round it outward to points of the
+    // user grid, clipped to the user box. A box centred on 0 stays centred,
+    // so a parity-symmetric problem keeps a mirrored grid.
+    double b0 = Box[2 * dim];
+    double h = H[dim];
+    int n = (int)std::round((Box[2 * dim + 1] - b0) / h);
+    bool isCentred = std::abs(Box[2 * dim] + Box[2 * dim + 1]) < 0.5 * h;
+    int j0, j1;
+
+    if ( isCentred )  {
+        hi = std::max(std::abs(lo), std::abs(hi));
+        lo = -hi;
+    }
+    lo -= (EDGE + 1) * h;
+    hi += (EDGE + 1) * h;
+
+    j1 = std::min(n, (int)std::ceil((hi - b0) / h));
+    j0 = isCentred ? n - j1 : std::max(0, (int)std::floor((lo - b0) / h));
+
+    if ( j1 - j0 < 2 * EDGE + 2 )
+        return;
+
+    Box[2 * dim] = b0 + j0 * h;
+    Box[2 * dim + 1] = b0 + j1 * h;
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::BuildSpans(const bool *TAMask, int x1_min, int x1_max, int x2_min, int x2_max)
+{
+    // Runs of active x2 cells of each row in the TA box. Row i1 owns runs
+    // SpanPtr[i1] <= sp < SpanPtr[i1+1], each covering SpanLo[sp]..SpanHi[sp].
+    // Rows outside [x1_min, x1_max] own none.
+    int nspans;
+
+    SpanPtr.assign(BoxShape[0] + 1, 0);
+
+    #pragma omp parallel for num_threads(NumThreads((x1_max - x1_min + 1) * (x2_max - x2_min + 1)))
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        const bool *mask = TAMask + i1 * W1;
+        int count = 0;
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)
+            count += mask[i2] && (i2 == x2_min || !mask[i2-1]);
+        SpanPtr[i1+1] = count;
+    }
+    for (int i1 = 0; i1 < BoxShape[0]; i1 ++)
+        SpanPtr[i1+1] += SpanPtr[i1];
+
+    nspans = SpanPtr[BoxShape[0]];
+    SpanLo.resize(nspans);
+    SpanHi.resize(nspans);
+
+    #pragma omp parallel for num_threads(NumThreads((x1_max - x1_min + 1) * (x2_max - x2_min + 1)))
+    for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+        const bool *mask = TAMask + i1 * W1;
+        int sp = SpanPtr[i1];
+        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+            if ( mask[i2] && (i2 == x2_min || !mask[i2-1]) )
+                SpanLo[sp] = i2;
+            if ( mask[i2] && (i2 == x2_max || !mask[i2+1]) )
+                SpanHi[sp++] = i2;
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
 void KleinKramers2d::Evolve()
 {
     #pragma omp declare reduction (merge : MeshIndex : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
 
     log->log("[KleinKramers2d] Evolve starts ...\n");
 
+    // Result cache: an identical run replays its observables, a run that
+    // differs only in Tf provides a warm start
+    ResultCache cache;
+    int tt0 = 0;
+
+    if ( CACHE_DIR.length() > 0 )  {
+
+        cache.open(CACHE_DIR, ResultCache::Hash(parameters->Fingerprint(true) + QTR_BUILD_ID),
+                              ResultCache::Hash(parameters->Fingerprint(false) + QTR_BUILD_ID));
+
+        if ( cache.load() )  {
+
+            log->log("[KleinKramers2d] Cached result found, skipping time iteration\n");
+
+            for (unsigned int i = 0; i < cache.Records.size(); i ++)  {
+                if ( cache.Records[i].name == "Norm" )
+                    log->log("[KleinKramers2d] Normalization factor = %.16e\n", cache.Records[i].value);
+                else
+                    log->log("[KleinKramers2d] Time %lf, %s = %.16e\n", cache.Records[i].time, cache.Records[i].name.c_str(), cache.Records[i].value);
+            }
+            log->log("[KleinKramers2d] Evolve done.\n");
+            return;
+        }
+    }
+
+    // RAPL package and DRAM energy, read around the initialization, the
+    // time iteration and each PERIOD
+    EnergyMeter meter;
+    double energy_iter = 0.0;
+    double energy_period = 0.0;
+    double cell_updates = 0.0;
+
+    if ( ENERGY )  {
+        if ( meter.open() > 0 )
+            log->log("[KleinKramers2d] Energy counters: %s\n", meter.zones().c_str());
+        else
+            log->log("[KleinKramers2d] Energy counters unavailable, no energy report\n");
+    }
+
     // Files
     FILE *pfile;
     FILE *pfile_density;
@@ -263,6 +508,20 @@ void KleinKramers2d::Evolve()
     // Overhead time (truncate)
     double t_overhead = 0.0;
 
+    // Automatic grid switching (accumulated over AUTO_GRID_PERIOD steps)
+    int auto_steps = 0;
+    int ta_est;
+    int n_interior = (BoxShape[0] - 2 * EDGE) * (BoxShape[1] - 2 * EDGE);
+    double auto_points = 0.0;  // sum of active grid points per step
+    double core_points = 0.0;  // sum of active grid points per moment and RK4 update
+    double norm_points = 0.0;  // sum of active grid points per normalization
+    double t_auto_begin;
+    double t_auto_step = 0.0;
+    double t_auto_core = 0.0;
+    double t_auto_norm = 0.0;
+    double t_auto_ovh = -1.0;  // TG overhead per TA point, < 0 if not measured yet
+    double c_core, c_norm, cost_tg, cost_fg;
+
     // Constants
     double k2h0m = kk / (2.0 * H[0] * m);
     double k2h1 = kk / (2.0 * H[1]);
@@ -299,6 +558,10 @@ void KleinKramers2d::Evolve()
     VectorXi Check;
     VectorXd ExTBL;
     int Excount;
+    int tbl_points, ex_points;     // TBL and extrapolated points handled this step
+    double mass_step = 0.0;        // mass before renormalization
+    double mass_cut, mass_ex;      // mass dropped by truncation, added by extrapolation
+    FILE *pfile_telemetry = NULL;
 
     // Neighborlist
     int nneigh = 0;
@@ -318,17 +581,20 @@ void KleinKramers2d::Evolve()
 
     bool *TAMask;
 
-    if ( !isFullGrid ) 
+    if ( !isFullGrid || isAutoGrid ) 
         TAMask = new bool[O1];
     
+    // Stage arrays cover the solved rows plus the reflected ghost row
+    int R1 = isSymmetric ? SYM_ROWS + 1 : BoxShape[0];
+
     double *F = new double[O1];
-    double *Feq_loc = new double[O1];
+    double *Feq_loc = new double[R1*W1];
     double *FF = new double[O1];
     double *PF = new double[O1];
-    double *KK1 = new double[O1];
-    double *KK2 = new double[O1];
-    double *KK3 = new double[O1];
-    double *KK4 = new double[O1];
+    double *KK1 = new double[R1*W1];
+    double *KK2 = new double[R1*W1];
+    double *KK3 = new double[R1*W1];
+    double *KK4 = new double[R1*W1];
 
     double *Density = new double[BoxShape[0]];
     double *Velocity = new double[BoxShape[0]];
@@ -352,9 +618,15 @@ void KleinKramers2d::Evolve()
     for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
         for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
             F[i1*W1+i2] = 0.0;
-            Feq_loc[i1*W1+i2] = 0.0;
             PF[i1*W1+i2] = 0.0;
             FF[i1*W1+i2] = 0.0;
+        }
+    }
+
+    #pragma omp parallel for
+    for (int i1 = 0; i1 < R1; i1 ++)  {
+        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+            Feq_loc[i1*W1+i2] = 0.0;
             KK1[i1*W1+i2] = 0.0;
             KK2[i1*W1+i2] = 0.0;
             KK3[i1*W1+i2] = 0.0;
@@ -369,7 +641,7 @@ void KleinKramers2d::Evolve()
         Temperature[i1] = 0.0;
     }
 
-    if ( !isFullGrid )  {
+    if ( !isFullGrid || isAutoGrid )  {
 
         t_1_begin = omp_get_wtime();
         
@@ -421,12 +693,16 @@ void KleinKramers2d::Evolve()
     t_1_begin = omp_get_wtime();
     log->log("[KleinKramers2d] Initializing wavefunction ...\n");  
 
-    #pragma omp parallel for 
-    for (int i1 = EDGE; i1 < BoxShape[0] - EDGE ; i1 ++)  {
-        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE ; i2 ++)  {
-            F[i1*W1+i2] = WAVEFUNCTION(Box[0]+i1*H[0], Box[2]+i2*H[1]);
+    if ( INIT_MODE == 0 )  {
+        #pragma omp parallel for 
+        for (int i1 = EDGE; i1 < BoxShape[0] - EDGE ; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE ; i2 ++)  {
+                F[i1*W1+i2] = WAVEFUNCTION(Box[0]+i1*H[0], Box[2]+i2*H[1]);
+            }
         }
     }
+    else
+        InitQuasiEquilibrium(F);
 
     // Normalization
     norm = 0.0;
@@ -471,6 +747,40 @@ void KleinKramers2d::Evolve()
         log->log("[KleinKramers2d] Time %lf, Corr = %.16e\n",0.0,1.0);
     }
 
+    // Warm start. Corr stays relative to the initial wavefunction above.
+    if ( cache.loadState((int)(TIME / kk), BoxShape[0], BoxShape[1], tt0, F) )  {
+
+        log->log("[KleinKramers2d] Warm start from cached state at time %lf, %d earlier records\n", tt0 * kk, (int) cache.Records.size());
+
+        #pragma omp parallel for 
+        for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+            for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                PF[i1*W1+i2] = F[i1*W1+i2];
+            }
+        }
+    }
+
+    // A detected symmetry also needs a symmetric initial state
+    if ( isSymmetric && SYM_MODE == 1 && !IsParityState(F) )  {
+
+        log->log("[KleinKramers2d] Initial state is not parity symmetric, solving the full domain\n");
+
+        isSymmetric = false;
+        SYM_ROWS = BoxShape[0] - EDGE;
+        R1 = BoxShape[0];
+
+        delete[] Feq_loc;
+        delete[] KK1;
+        delete[] KK2;
+        delete[] KK3;
+        delete[] KK4;
+        Feq_loc = new double[O1]();
+        KK1 = new double[O1]();
+        KK2 = new double[O1]();
+        KK3 = new double[O1]();
+        KK4 = new double[O1]();
+    }
+
     t_1_end = omp_get_wtime();
     t_1_elapsed = t_1_end - t_1_begin;
     t_full += t_1_elapsed;
@@ -825,6 +1135,22 @@ void KleinKramers2d::Evolve()
 
     // .........................................................................................
 
+    // Per-region timing lines go through a buffer, off the timed regions
+    TimingLog tlog;
+
+    if ( !QUIET && TIMING )  {
+        tlog.open(log, TIMING_LOG, omp_get_max_threads(), 4096);
+        if ( TIMING_LOG.length() > 0 )
+            log->log("[KleinKramers2d] Timing lines go to %s\n", TIMING_LOG.c_str());
+    }
+
+    if ( meter.isEnabled() )  {
+        meter.update();
+        energy_iter = meter.total();
+        energy_period = energy_iter;
+    }
+    const int tt_energy = tt0;
+
     // Time iteration 
 
     log->log("=======================================================\n\n"); 
@@ -832,10 +1158,37 @@ void KleinKramers2d::Evolve()
     log->log("[KleinKramers2d] Number of steps = %d\n\n", (int)(TIME / kk)); 
     log->log("=======================================================\n\n"); 
 
-    for (int tt = 0; tt < (int)(TIME / kk); tt ++)
+    // The DG engine or Parareal replaces the sequential loop on a static full grid
+    if ( DG_RATIO > 1 && isFullGrid && !isAutoGrid && tt0 < (int)(TIME / kk) )  {
+        cell_updates += (double) n_interior * ((int)(TIME / kk) - tt0);
+        EvolveDG(F, tt0, F0, corr_0, cache);
+        tt0 = (int)(TIME / kk);
+    }
+
+    if ( PR_SLICES > 1 && isFullGrid && !isAutoGrid && tt0 < (int)(TIME / kk) )  {
+        cell_updates += (double) n_interior * ((int)(TIME / kk) - tt0);
+        EvolveParareal(F, tt0, F0, corr_0, cache);
+        tt0 = (int)(TIME / kk);
+    }
+
+    if ( TELEMETRY_PERIOD > 0 )  {
+        pfile_telemetry = fopen("telemetry.csv", "w");
+        if ( pfile_telemetry == NULL )
+            log->log("[KleinKramers2d] Cannot open telemetry.csv\n");
+        else
+            fprintf(pfile_telemetry, "step,time,fullgrid,ta_size,tb_size,tbl_points,ex_points,"
+                                     "x1_min,x1_max,x2_min,x2_max,excount,mass,mass_cut,mass_ex,"
+                                     "t_core,t_overhead,t_step\n");
+    }
+
+    for (int tt = tt0; tt < (int)(TIME / kk); tt ++)
     {
         t_0_begin = omp_get_wtime(); 
         Excount = 0;
+        tbl_points = 0;
+        ex_points = 0;
+        mass_cut = 0.0;
+        mass_ex = 0.0;
 
         if ( isPrintWavefunc && tt % PRINT_WAVEFUNC_PERIOD == 0 )
         {
@@ -942,6 +1295,75 @@ void KleinKramers2d::Evolve()
             }
         }
 
+        // Automatic grid switching: compare the measured cost per step of the
+        // current mode with the cost predicted for the other one
+
+        if ( isAutoGrid && auto_steps >= AUTO_GRID_PERIOD && core_points > 0.0 )
+        {
+            c_core = t_auto_core / core_points;  // moment and RK4 cost per active grid point
+            c_norm = ( norm_points > 0.0 ) ? t_auto_norm / norm_points : 0.0;
+
+            if ( !isFullGrid )  {
+
+                cost_tg = t_auto_step / auto_steps;
+                cost_fg = ( c_core + c_norm ) * n_interior;
+                t_auto_ovh = std::max(cost_tg * auto_steps / auto_points - c_core, 0.0);
+
+                if ( cost_tg > (1.0 + AutoGridThreshold) * cost_fg )  {
+
+                    // F is already zero outside TA
+                    isFullGrid = true;
+                    TB.clear();
+                    log->log("[KleinKramers2d] Step: %d, switching to full grid (TG %.4e sec/step, FG predicted %.4e sec/step)\n", tt, cost_tg, cost_fg);
+                }
+            }
+            else  {
+
+                ta_est = 0;
+
+                #pragma omp parallel for reduction(+: ta_est)
+                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                        if (PF[i1*W1+i2] >= TolH)
+                            ta_est += 1;
+                    }
+                }
+                cost_fg = t_auto_step / auto_steps;
+                cost_tg = ta_est * (c_core + ((t_auto_ovh < 0.0) ? c_core : t_auto_ovh));
+
+                if ( cost_fg > (1.0 + AutoGridThreshold) * cost_tg )  {
+
+                    // Start from the whole interior and let the truncation
+                    // at the end of this step prune it.
+                    #pragma omp parallel for
+                    for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                            TAMask[i1*W1+i2] = (i1 > EDGE && i1 < BoxShape[0]-EDGE-1 && i2 > EDGE && i2 < BoxShape[1]-EDGE-1);
+                            if (!TAMask[i1*W1+i2])  {
+                                F[i1*W1+i2] = 0.0;
+                                PF[i1*W1+i2] = 0.0;
+                            }
+                        }
+                    }
+                    x1_min = EDGE + 1;
+                    x2_min = EDGE + 1;
+                    x1_max = BoxShape[0] - EDGE - 2;
+                    x2_max = BoxShape[1] - EDGE - 2;
+                    ta_size = (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+                    TB.clear();
+                    isFullGrid = false;
+                    log->log("[KleinKramers2d] Step: %d, switching to truncated grid (FG %.4e sec/step, TG predicted %.4e sec/step)\n", tt, cost_fg, cost_tg);
+                }
+            }
+            auto_steps = 0;
+            auto_points = 0.0;
+            core_points = 0.0;
+            norm_points = 0.0;
+            t_auto_step = 0.0;
+            t_auto_core = 0.0;
+            t_auto_norm = 0.0;
+        }
+
         // Check if TB of f is higher than TolL
         
         if ( !isFullGrid )
@@ -957,7 +1379,7 @@ void KleinKramers2d::Evolve()
             tmpVec.clear();
 
             #pragma omp parallel for reduction(merge: tmpVec) private(g1,g2,b1,b2,b3,b4,nx1,nx2,\
-                                                                      f1p,f1m,f2p,f2m) 
+                                                                      f1p,f1m,f2p,f2m) num_threads(NumThreads(TB.size()))
             for (int i = 0; i < TB.size(); i++)
             {
                 g1 = (int)(TB[i] / M1);
@@ -987,7 +1409,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-a-1: TBL) = %lf sec\n", t_1_elapsed);   
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-a-1: TBL) = %lf sec\n", t_1_elapsed);   
             if (!QUIET && TIMING) log->log("TBL size = %d\n", TBL.size()); 
         }
         else  
@@ -1009,13 +1431,14 @@ void KleinKramers2d::Evolve()
             __gnu_parallel::sort(TBL.begin(),TBL.end());
             it = std::unique (TBL.begin(), TBL.end()); 
             TBL.resize(std::distance(TBL.begin(),it)); 
+            tbl_points += TBL.size();
 
             // Find extrapolation target
             // ExFF: Index of Extrapolated points
             ExFF.clear();
             tmpVec.clear();
 
-            #pragma omp parallel for reduction(merge: tmpVec) private(g1,g2) 
+            #pragma omp parallel for reduction(merge: tmpVec) private(g1,g2) num_threads(NumThreads(TBL.size()))
             for (int i = 0; i < TBL.size(); i++)  {
 
                 g1 = (int)(TBL[i] / M1);
@@ -1035,7 +1458,7 @@ void KleinKramers2d::Evolve()
 
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-b-1: ExFF) = %.4e sec\n", t_1_elapsed); 
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-1: ExFF) = %.4e sec\n", t_1_elapsed); 
 
             if ( ExFF.size() > 0 )  {
 
@@ -1058,7 +1481,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-b-2: ExFF) = %lf sec\n", t_1_elapsed);   
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-2: ExFF) = %lf sec\n", t_1_elapsed);   
 
                 // Find the direction of Outer to Edge points
                 t_1_begin = omp_get_wtime();
@@ -1067,7 +1490,7 @@ void KleinKramers2d::Evolve()
                 ExTBL.resize(ExFF.size());
 
                 // disable for off4
-                #pragma omp parallel for private(g1,g2,sum,count,val,val_min_abs,val_min,min_dir) 
+                #pragma omp parallel for private(g1,g2,sum,count,val,val_min_abs,val_min,min_dir) num_threads(NumThreads(ExFF.size()))
                 for (int i = 0; i < ExFF.size(); i ++)
                 {
                     bool isEmpty = true;
@@ -1168,13 +1591,15 @@ void KleinKramers2d::Evolve()
                 }
                 count = 0;
 
-                #pragma omp parallel for reduction (+:count) 
+                #pragma omp parallel for reduction (+:count,mass_ex) num_threads(NumThreads(ExFF.size()))
                 for ( int i = 0; i < ExFF.size(); i++ )  {
                     if (Check[i])  {
                         F[ExFF[i]] = ExTBL[i];
+                        mass_ex += ExTBL[i];
                         count += 1;
                     }
                 }
+                ex_points += count;
 
                 if (count == 0)  {
                     ExFF.clear();
@@ -1184,7 +1609,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-b-3: ExFF) = %.4e sec\n", t_1_elapsed);  
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-3: ExFF) = %.4e sec\n", t_1_elapsed);  
             } // if ExFF.size() > 0 
 
             // ............................................................................................. Extrapolation
@@ -1197,7 +1622,7 @@ void KleinKramers2d::Evolve()
 
                 tmpVec.clear();
 
-                #pragma omp parallel for reduction(merge: tmpVec) private(g1, g2) 
+                #pragma omp parallel for reduction(merge: tmpVec) private(g1, g2) num_threads(NumThreads(ExFF.size()))
                 for (int i = 0; i < ExFF.size(); i++)  {
                     if (Check[i]) {
                         g1 = (int)(ExFF[i] / M1);
@@ -1218,6 +1643,8 @@ void KleinKramers2d::Evolve()
 
                     g1 = (int)(tmpVec[i] / M1);
                     g2 = (int)(tmpVec[i] % M1);
+                    if (!TAMask[tmpVec[i]])
+                        ta_size += 1;
                     TAMask[tmpVec[i]] = 1;
                     
                     // Update TA box
@@ -1231,9 +1658,14 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-c-1: CASE 1 TA) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-c-1: CASE 1 TA) = %lf sec\n", t_1_elapsed); 
+
+                t_auto_begin = omp_get_wtime();
 
-                #pragma omp parallel for
+                // Active x2 runs of each row for the sweeps below
+                BuildSpans(TAMask, x1_min, x1_max, x2_min, x2_max);
+
+                #pragma omp parallel for num_threads(NumThreads(BoxShape[0]))
                 for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
                     Density[i1] = 0.0;
                 }
@@ -1243,15 +1675,15 @@ void KleinKramers2d::Evolve()
                     density = 0.0;
                     velocity_dft = 0.0;
                     temp_loc = 0.0;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             density += F[i1*W1+i2] * H[1];
                         }
                     }
                     if (density <= 0.0) {
                         density = 0.0;
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 Feq_loc[i1*W1+i2] = 0.0;
                             }
                         }
@@ -1260,8 +1692,8 @@ void KleinKramers2d::Evolve()
                     {
                         velocity_dft = 0.0;
                         temp_loc = temp;
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2]){
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
                                 Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                             }
@@ -1269,15 +1701,15 @@ void KleinKramers2d::Evolve()
                     }
                     else if (isIsothermal)
                     {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                             }
                         }
                         velocity_dft = velocity_dft / (m * density);
                         temp_loc = temp;
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2]){
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
                                 Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                             }
@@ -1285,20 +1717,20 @@ void KleinKramers2d::Evolve()
                     }   
                     else
                     {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                             }
                         }
                         velocity_dft = velocity_dft / (m * density);
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                             }
                         }
                         temp_loc = temp_loc / (m * kb * density);
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2]){
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
                                 Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                             }
@@ -1311,8 +1743,8 @@ void KleinKramers2d::Evolve()
                 /*
                 //Remove all radicals by averaging over their nearest neighbors.
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if ( TAMask[i1*W1+i2] ){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = Feq_loc[i1*W1+i2];
                             if ( feq > 1/(H[0]*H[1]) || !isfinite(feq) ) {
                                 num_neigh = TAMask[i1*W1+(i2+1)] + TAMask[i1*W1+(i2-1)] + TAMask[(i1+1)*W1+i2] + TAMask[(i1-1)*W1+i2];
@@ -1327,7 +1759,7 @@ void KleinKramers2d::Evolve()
                 }*/
                 
                 // Runge–Kutta 4
-                #pragma omp parallel 
+                #pragma omp parallel num_threads(NumThreads(ta_size))
                 {
                     // RK4-1
                     #pragma omp single nowait
@@ -1336,8 +1768,8 @@ void KleinKramers2d::Evolve()
                     }
                     #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,feq) 
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if ( TAMask[i1*W1+i2] )  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1360,15 +1792,15 @@ void KleinKramers2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-2
                     #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if ( TAMask[i1*W1+i2] )  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1396,15 +1828,15 @@ void KleinKramers2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-3
                     #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if ( TAMask[i1*W1+i2] )  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1432,15 +1864,15 @@ void KleinKramers2d::Evolve()
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-4
                     #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if ( TAMask[i1*W1+i2] == 1 )  {
+                        for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                            for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                                 xx1 = Box[0] + i1 * H[0];
                                 xx2 = Box[2] + i2 * H[1];
                                 f0 = F[i1*W1+i2];
@@ -1461,20 +1893,25 @@ void KleinKramers2d::Evolve()
 
                                 FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0;
                             }
-                        }
+                        }            
                     }
                     #pragma omp single nowait
                     {
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
                 } // OMP PARALLEL
 
                 isFirstExtrp = false;
 
+                if ( isAutoGrid )  {
+                    t_auto_core += omp_get_wtime() - t_auto_begin;
+                    core_points += ta_size;
+                }
+
             } // if ( isFirstExtrp )
             else if (ExFF.size() == 0)  {
 
@@ -1491,7 +1928,7 @@ void KleinKramers2d::Evolve()
 
                     tmpVec.clear();
 
-                    #pragma omp parallel for reduction(merge: tmpVec) private(g1, g2) 
+                    #pragma omp parallel for reduction(merge: tmpVec) private(g1, g2) num_threads(NumThreads(ExFF.size()))
                     for (int i = 0; i < ExFF.size(); i++)  {
                         if (Check[i])  
                         {
@@ -1515,6 +1952,8 @@ void KleinKramers2d::Evolve()
 
                         g1 = (int)(tmpVec[i] / M1); 
                         g2 = (int)(tmpVec[i] % M1);
+                        if (!TAMask[tmpVec[i]])
+                            ta_size += 1;
                         TAMask[tmpVec[i]] = 1;
 
                         // Update TA box
@@ -1526,7 +1965,7 @@ void KleinKramers2d::Evolve()
                     tmpVec.clear();
                     ExBD.clear();
 
-                    #pragma omp parallel for reduction(merge: ExBD) private(g1, g2, n1, n2) 
+                    #pragma omp parallel for reduction(merge: ExBD) private(g1, g2, n1, n2) num_threads(NumThreads(ExFF.size()))
                     for (int i = 0; i < ExFF.size(); i++)
                     {
                         if (Check[i])  
@@ -1554,7 +1993,7 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-cx-1: CASE 1 ExBD) = %lf sec\n", t_1_elapsed); 
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-cx-1: CASE 1 ExBD) = %lf sec\n", t_1_elapsed); 
                 } // if ExFF.size() > 0
 
                 // Update the local Maxwellian before time integration.
@@ -1593,7 +2032,7 @@ void KleinKramers2d::Evolve()
                 t_1_begin = omp_get_wtime();
 
                 // RK4-1
-                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,feq) 
+                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,feq) num_threads(NumThreads(ExBD.size()))
                 for (int i = 0; i < ExBD.size(); i++)  {
 
                     g1 = (int)(ExBD[i] / M1);
@@ -1616,11 +2055,11 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-2
-                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
+                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) num_threads(NumThreads(ExBD.size()))
                 for (int i = 0; i < ExBD.size(); i++)  {
 
                     g1 = (int)(ExBD[i] / M1);
@@ -1648,11 +2087,11 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-3
-                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
+                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) num_threads(NumThreads(ExBD.size()))
                 for (int i = 0; i < ExBD.size(); i++)  {
 
                     g1 = (int)(ExBD[i] / M1);
@@ -1680,11 +2119,11 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-4
-                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
+                #pragma omp parallel for private(g1,g2,xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) num_threads(NumThreads(ExBD.size()))
                 for (int i = 0; i < ExBD.size(); i++)  {
 
                     g1 = (int)(ExBD[i] / M1);
@@ -1712,7 +2151,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
             } // isFirstExtrp == false and ExFF.size() > 0
 
@@ -1725,7 +2164,7 @@ void KleinKramers2d::Evolve()
                 tmpVec.clear();
 
                 #pragma omp parallel for reduction(merge: tmpVec) private(g1,g2,b1,b2,b3,b4,nx1,nx2,\
-                                                                        f0,f1p,f1m,f2p,f2m) 
+                                                                        f0,f1p,f1m,f2p,f2m) num_threads(NumThreads(ExFF.size()))
                 for (int i = 0; i < ExFF.size(); i++)
                 {
                     if (Check[i])  {
@@ -1782,7 +2221,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-c-3 CASE 1 TBL) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-c-3 CASE 1 TBL) = %lf sec\n", t_1_elapsed); 
             }
         } // TBL.size() != 0 && !isFullGrid && Excount < ExLimit
 
@@ -1790,22 +2229,26 @@ void KleinKramers2d::Evolve()
 
         // CASE 2: Truncating without extrapolation
 
+        t_auto_begin = omp_get_wtime();
+
         if ( !isExtrapolate && !isFullGrid )
         {
+            BuildSpans(TAMask, x1_min, x1_max, x2_min, x2_max);
+
             // Update the 3 Momentum Moments before time integration.
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 density = 0.0;
                 velocity_dft = 0.0;
                 temp_loc = 0.0;
-                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                    if (TAMask[i1*W1+i2])  {
+                for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                    for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                         density += F[i1*W1+i2] * H[1];
                     }
                 }
                 if (density <= 0.0) {
                     density = 0.0;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             Feq_loc[i1*W1+i2] = 0.0;
                         }
                     }
@@ -1814,8 +2257,8 @@ void KleinKramers2d::Evolve()
                 {
                     velocity_dft = 0.0;
                     temp_loc = temp;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2]){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
                             Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                         }
@@ -1823,15 +2266,15 @@ void KleinKramers2d::Evolve()
                 }
                 else if (isIsothermal)
                 {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
                     velocity_dft = velocity_dft / (m * density);
                     temp_loc = temp;
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2]){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
                             Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                         }
@@ -1839,20 +2282,20 @@ void KleinKramers2d::Evolve()
                 }   
                 else
                 {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
                     velocity_dft = velocity_dft / (m * density);
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                         }
                     }
                     temp_loc = temp_loc / (m * kb * density);
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2]){
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
                             Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
                         }
@@ -1865,8 +2308,8 @@ void KleinKramers2d::Evolve()
             /*
             //Remove all radicals by averaging over their nearest neighbors.
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                    if ( TAMask[i1*W1+i2] ){
+                for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                    for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                         feq = Feq_loc[i1*W1+i2];
                         if ( feq > 1/(H[0]*H[1]) || !isfinite(feq) ) {
                             num_neigh = TAMask[i1*W1+(i2+1)] + TAMask[i1*W1+(i2-1)] + TAMask[(i1+1)*W1+i2] + TAMask[(i1-1)*W1+i2];
@@ -1881,7 +2324,7 @@ void KleinKramers2d::Evolve()
             }
             */
             // RK4-1
-            #pragma omp parallel
+            #pragma omp parallel num_threads(NumThreads(ta_size))
             {
                 #pragma omp single nowait
                 {
@@ -1889,8 +2332,8 @@ void KleinKramers2d::Evolve()
                 }
                 #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,feq) 
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
                             f0 = F[i1*W1+i2];
@@ -1913,15 +2356,15 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-21: CASE 2 KK1) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-21: CASE 2 KK1) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-2
                 #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
                             f0 = F[i1*W1+i2];
@@ -1949,15 +2392,15 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-22: CASE 2 KK2) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-22: CASE 2 KK2) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-3
                 #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
                             f0 = F[i1*W1+i2];
@@ -1985,15 +2428,15 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-23: CASE 2 KK3) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-23: CASE 2 KK3) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-4
                 #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
+                    for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                        for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                             xx1 = Box[0] + i1 * H[0];
                             xx2 = Box[2] + i2 * H[1];
                             f0 = F[i1*W1+i2];
@@ -2021,7 +2464,7 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-24: CASE 2 KK4) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-24: CASE 2 KK4) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
             } // OMP PARALLEL
@@ -2031,59 +2474,18 @@ void KleinKramers2d::Evolve()
             // .........................................................................................
 
             // CASE 3: Full grid
+            // With parity symmetry only the lower half and its ghost row are updated
+            int i1_end = isSymmetric ? SYM_ROWS : BoxShape[0] - EDGE;
+
             // Update the 3 Momentum Moments before time integration.
-            for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                density = 0.0;
-                velocity_dft = 0.0;
-                temp_loc = 0.0;
-                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                    density += F[i1*W1+i2] * H[1];
-                }
-                if (density <= 0.0) {
-                    density = 0.0;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        Feq_loc[i1*W1+i2] = 0.0;
-                    }
-                }
-                else if (isLinearizedCollision)
-                {
-                    velocity_dft = 0.0;
-                    temp_loc = temp;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
-                    }
-                }
-                else if (isIsothermal)
-                {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
-                    }
-                    velocity_dft = velocity_dft / (m * density);
-                    temp_loc = temp;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
-                    }
-                }   
-                else
-                {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
-                    }
-                    velocity_dft = velocity_dft / (m * density);
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
-                    }
-                    temp_loc = temp_loc / (m * kb * density);
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
-                    }
+            LocalMaxwellian(F, Feq_loc, isSymmetric ? SYM_ROWS : BoxShape[0], Density, Velocity, Temperature, MAX_THREADS);
+
+            if ( isSymmetric )  {
+                for (int i1 = SYM_ROWS; i1 < BoxShape[0]; i1 ++)  {
+                    Density[i1] = Density[BoxShape[0]-1-i1];
+                    Velocity[i1] = -Velocity[BoxShape[0]-1-i1];
+                    Temperature[i1] = Temperature[BoxShape[0]-1-i1];
                 }
-                Density[i1] = density;
-                Velocity[i1] = velocity_dft;
-                Temperature[i1] = temp_loc;
             }
             /*
             //Remove all radicals by averaging over their nearest neighbors.
@@ -2104,124 +2506,60 @@ void KleinKramers2d::Evolve()
                 {
                     t_1_begin = omp_get_wtime();
                 }
-                #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,feq) 
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p = F[(i1+1)*W1+i2];
-                        f1m = F[(i1-1)*W1+i2];
-                        f2p = F[i1*W1+(i2+1)];
-                        f2m = F[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-
-                        KK1[i1*W1+i2] = -k2h0m * xx2 * (f1p - f1m) + 
-                                        k2h1 * POTENTIAL_X(xx1, xx2) * (f2p - f2m) +
-                                        kgamma * (feq - f0);
-
-                        FF[i1*W1+i2] = F[i1*W1+i2] + KK1[i1*W1+i2] / 6.0;
-                    }
+                FullGridStage(1, F, NULL, KK1, FF, Feq_loc, kk, i1_end);
+                if ( isSymmetric )  {
+                    #pragma omp for
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                        KK1[SYM_ROWS*W1+i2] = KK1[(BoxShape[0]-1-SYM_ROWS)*W1+(BoxShape[1]-1-i2)];
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-31: CASE 3 KK1) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-31: CASE 3 KK1) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
                 // RK4-2
-                #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p = F[(i1+1)*W1+i2];
-                        f1m = F[(i1-1)*W1+i2];
-                        f2p = F[i1*W1+(i2+1)];
-                        f2m = F[i1*W1+(i2-1)];
-                        kk0 = KK1[i1*W1+i2];
-                        kk1p = KK1[(i1+1)*W1+i2];
-                        kk1m = KK1[(i1-1)*W1+i2];
-                        kk2p = KK1[i1*W1+(i2+1)];
-                        kk2m = KK1[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-
-                        KK2[i1*W1+i2] = -k2h0m * xx2 * (f1p + 0.5 * kk1p - f1m - 0.5 * kk1m) + 
-                                        k2h1 * POTENTIAL_X(xx1, xx2) * (f2p + 0.5 * kk2p - f2m - 0.5 * kk2m) +
-                                        kgamma * (feq - f0 - 0.5 * kk0);
-
-                        FF[i1*W1+i2] += KK2[i1*W1+i2] / 3.0;
-                    }
+                FullGridStage(2, F, KK1, KK2, FF, Feq_loc, kk, i1_end);
+                if ( isSymmetric )  {
+                    #pragma omp for
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                        KK2[SYM_ROWS*W1+i2] = KK2[(BoxShape[0]-1-SYM_ROWS)*W1+(BoxShape[1]-1-i2)];
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-32: CASE 3 KK2) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-32: CASE 3 KK2) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-3
-                #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p = F[(i1+1)*W1+i2];
-                        f1m = F[(i1-1)*W1+i2];
-                        f2p = F[i1*W1+(i2+1)];
-                        f2m = F[i1*W1+(i2-1)];
-                        kk0 = KK2[i1*W1+i2];
-                        kk1p = KK2[(i1+1)*W1+i2];
-                        kk1m = KK2[(i1-1)*W1+i2];
-                        kk2p = KK2[i1*W1+(i2+1)];
-                        kk2m = KK2[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-
-                        KK3[i1*W1+i2] = -k2h0m * xx2 * (f1p + 0.5 * kk1p - f1m - 0.5 * kk1m) + 
-                                        k2h1 * POTENTIAL_X(xx1, xx2) * (f2p + 0.5 * kk2p -  f2m - 0.5 * kk2m) +
-                                        kgamma * (feq - f0 - 0.5 * kk0);
-
-                        FF[i1*W1+i2] += KK3[i1*W1+i2] / 3.0;              
-                    }
+                FullGridStage(3, F, KK2, KK3, FF, Feq_loc, kk, i1_end);
+                if ( isSymmetric )  {
+                    #pragma omp for
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                        KK3[SYM_ROWS*W1+i2] = KK3[(BoxShape[0]-1-SYM_ROWS)*W1+(BoxShape[1]-1-i2)];
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-33: CASE 3 KK3) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-33: CASE 3 KK3) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-4
-                #pragma omp for private(xx1,xx2,f0,f1p,f1m,f2p,f2m,kk0,kk1p,kk1m,kk2p,kk2m,feq) 
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p = F[(i1+1)*W1+i2];
-                        f1m = F[(i1-1)*W1+i2];
-                        f2p = F[i1*W1+(i2+1)];
-                        f2m = F[i1*W1+(i2-1)];
-                        kk0 = KK3[i1*W1+i2];
-                        kk1p = KK3[(i1+1)*W1+i2];
-                        kk1m = KK3[(i1-1)*W1+i2];
-                        kk2p = KK3[i1*W1+(i2+1)];
-                        kk2m = KK3[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-
-                        KK4[i1*W1+i2] = -k2h0m * xx2 * (f1p + kk1p - f1m - kk1m) + 
-                                        k2h1 * POTENTIAL_X(xx1, xx2) * (f2p + kk2p -  f2m - kk2m) +
-                                        kgamma * (feq - f0 - kk0);
-
-                        FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0;                             
+                FullGridStage(4, F, KK3, KK4, FF, Feq_loc, kk, i1_end);
+                // Reflect the solved half onto the upper one
+                if ( isSymmetric )  {
+                    #pragma omp for
+                    for (int i1 = SYM_ROWS; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                            FF[i1*W1+i2] = FF[(BoxShape[0]-1-i1)*W1+(BoxShape[1]-1-i2)];
                     }
                 }
                 #pragma omp single nowait
@@ -2229,16 +2567,21 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-34: CASE 3 KK4) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-34: CASE 3 KK4) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
             }
         }
+        if ( isAutoGrid && !isExtrapolate )  {
+            t_auto_core += omp_get_wtime() - t_auto_begin;
+            core_points += isFullGrid ? n_interior : ta_size;
+        }
         // .........................................................................................
 
         // NORMALIZATION AND TRUNCATION
 
         t_1_begin = omp_get_wtime();
+        t_auto_begin = t_1_begin;
 
         // Normalization
 
@@ -2246,10 +2589,15 @@ void KleinKramers2d::Evolve()
 
         if (!isFullGrid)  {
 
-            #pragma omp parallel for reduction (+:norm) 
+            // Later extrapolation rounds may have grown the TA
+            if ( isExtrapolate )
+                BuildSpans(TAMask, x1_min, x1_max, x2_min, x2_max);
+
+
+            #pragma omp parallel for reduction (+:norm) num_threads(NumThreads(ta_size))
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                    if (TAMask[i1*W1+i2])
+                for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                    for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)
                         norm += FF[i1*W1+i2];
                 }
             }
@@ -2264,9 +2612,12 @@ void KleinKramers2d::Evolve()
             }
         }
         norm *= H[0] * H[1];
+        mass_step = norm;
 
-        if ( (tt + 1) % PERIOD == 0 )
+        if ( (tt + 1) % PERIOD == 0 )  {
             log->log("[KleinKramers2d] Normalization factor = %.16e\n",norm);
+            cache.record("Norm", ( tt + 1 ) * kk, norm);
+        }
 
         norm = 1.0 / norm; 
 
@@ -2274,14 +2625,14 @@ void KleinKramers2d::Evolve()
         t_1_elapsed = t_1_end - t_1_begin;
         t_full += t_1_elapsed;
         t_truncate += t_1_elapsed;
-        if (!QUIET && TIMING) log->log("Elapsed time (omp-e-1-1 Norm) = %lf sec\n", t_1_elapsed);
+        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-1-1 Norm) = %lf sec\n", t_1_elapsed);
         t_1_begin = omp_get_wtime();
 
         if (!isFullGrid)  {
-            #pragma omp parallel for private(val) 
+            #pragma omp parallel for private(val) num_threads(NumThreads(ta_size))
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                    if (TAMask[i1*W1+i2])  {
+                for (int sp = SpanPtr[i1]; sp < SpanPtr[i1+1]; sp ++)  {
+                    for (int i2 = SpanLo[sp]; i2 <= SpanHi[sp]; i2 ++)  {
                         val = norm * FF[i1*W1+i2];
                         FF[i1*W1+i2] = val;
                         F[i1*W1+i2] = val;
@@ -2305,7 +2656,12 @@ void KleinKramers2d::Evolve()
         t_1_elapsed = t_1_end - t_1_begin;
         t_full += t_1_elapsed;
         t_truncate += t_1_elapsed;
-        if (!QUIET && TIMING) log->log("Elapsed time (omp-e-1-2 FF) = %lf sec\n", t_1_elapsed); 
+        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-1-2 FF) = %lf sec\n", t_1_elapsed); 
+
+        if ( isAutoGrid )  {
+            t_auto_norm += omp_get_wtime() - t_auto_begin;
+            norm_points += isFullGrid ? n_interior : ta_size;
+        }
 
         if ( (tt + 1) % PERIOD == 0 )
         {
@@ -2320,7 +2676,7 @@ void KleinKramers2d::Evolve()
                 pftrans = 0.0;
 
                 if (!isFullGrid)  {
-                    #pragma omp parallel for reduction (+:pftrans)
+                    #pragma omp parallel for reduction (+:pftrans) num_threads(NumThreads(ta_size))
                     for (int i1 = idx_x0; i1 <= x1_max; i1 ++)  {
                         for (int i2 = x2_min; i2 <= x2_max; i2 ++)
                             pftrans+=PF[i1*W1+i2];
@@ -2337,9 +2693,10 @@ void KleinKramers2d::Evolve()
                 PF_trans.push_back(pftrans);
                 log->log("[KleinKramers2d] idx_x0 = %d\n", idx_x0);
                 log->log("[KleinKramers2d] Time %lf, Trans = %.16e\n", ( tt + 1 ) * kk, pftrans);
+                cache.record("Trans", ( tt + 1 ) * kk, pftrans);
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin; 
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-x-2 trans) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-x-2 trans) = %lf sec\n", t_1_elapsed); 
             }
 
             if (isCorr)  {
@@ -2360,6 +2717,7 @@ void KleinKramers2d::Evolve()
                 }
                 corr *= H[0];
                 log->log("[KleinKramers2d] Time %lf, Corr = %.16e\n", ( tt + 1 ) * kk, corr/corr_0);
+                cache.record("Corr", ( tt + 1 ) * kk, corr/corr_0);
             }
         }
 
@@ -2371,8 +2729,8 @@ void KleinKramers2d::Evolve()
         {
             t_1_begin = omp_get_wtime();
 
-            #pragma omp parallel for private(b1,nx1,nx2,\
-                                            f1p,f1m,f2p,f2m) 
+            #pragma omp parallel for reduction(+: mass_cut) private(b1,nx1,nx2,\
+                                            f1p,f1m,f2p,f2m) num_threads(NumThreads(ta_size))
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                     if (TAMask[i1*W1+i2])  {
@@ -2389,8 +2747,10 @@ void KleinKramers2d::Evolve()
                             b1 = ((nx1 == 0) ? 0.0 : pow(std::abs(f1p - f1m)/(nx1*H[0]),2)) + \
                                  ((nx2 == 0) ? 0.0 : pow(std::abs(f2p - f2m)/(nx2*H[1]),2)) < TolHd_sq;
 
-                            if (b1)
+                            if (b1)  {
+                                mass_cut += PF[i1*W1+i2];
                                 PF[i1*W1+i2] = 0.0;
+                            }
                         }
                     }
                 }
@@ -2398,10 +2758,10 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-3-1 TA) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-3-1 TA) = %.4e sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
-            #pragma omp parallel for 
+            #pragma omp parallel for num_threads(NumThreads(ta_size))
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                     if (PF[i1*W1+i2] == 0.0)  {
@@ -2417,7 +2777,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-3-2 TA) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-3-2 TA) = %.4e sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
 
@@ -2449,7 +2809,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-4 TA rebuild) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-4 TA rebuild) = %.4e sec\n", t_1_elapsed);
 
             // TB
             t_1_begin = omp_get_wtime();
@@ -2458,7 +2818,7 @@ void KleinKramers2d::Evolve()
             if (ta_size == 0)
                 tb_size = 0;
             else  {
-                #pragma omp parallel for reduction(merge: tmpVec) 
+                #pragma omp parallel for reduction(merge: tmpVec) num_threads(NumThreads(ta_size))
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                         if (TAMask[i1*W1+i2])  {
@@ -2476,7 +2836,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-5 TB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-5 TB) = %lf sec\n", t_1_elapsed);
 
             // `````````````````````````````````````````````````````````````````
 
@@ -2484,7 +2844,7 @@ void KleinKramers2d::Evolve()
             t_1_begin = omp_get_wtime();
             tmpVec.clear();
 
-            #pragma omp parallel for reduction(merge: tmpVec) private(g1,g2) 
+            #pragma omp parallel for reduction(merge: tmpVec) private(g1,g2) num_threads(NumThreads(TB.size()))
             for (int i = 0; i < TB.size(); i++)
             {
                 g1 = (int)(TB[i] / M1);
@@ -2502,12 +2862,12 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-6 TAEX-A) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-6 TAEX-A) = %.4e sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
             #pragma omp parallel for reduction(min: x1_min, x2_min) \
                                      reduction(max: x1_max, x2_max) \
-                                     private(g1, g2) 
+                                     private(g1, g2) num_threads(NumThreads(tmpVec.size()))
             for (int i = 0; i < tmpVec.size(); i ++)  {
                 g1 = (int)(tmpVec[i] / M1);
                 g2 = (int)(tmpVec[i] % M1);
@@ -2520,8 +2880,10 @@ void KleinKramers2d::Evolve()
             }
             tmpVec.clear();
 
+            // Team sized from the box: ta_size is reset before the count
             ta_size = 0;
-            #pragma omp parallel for reduction(+: ta_size) 
+            #pragma omp parallel for reduction(+: ta_size) \
+                                     num_threads(NumThreads((x1_max-x1_min+1)*(x2_max-x2_min+1)))
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                     if (TAMask[i1*W1+i2])
@@ -2532,9 +2894,35 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-7 TARB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-7 TARB) = %lf sec\n", t_1_elapsed);
         }
 
+        if ( isAutoGrid )  {
+            t_auto_step += omp_get_wtime() - t_0_begin;
+            auto_points += isFullGrid ? n_interior : ta_size;
+            auto_steps += 1;
+        }
+
+        // Cell updates counted as in the auto-grid cost model
+        if ( meter.isEnabled() )  {
+            meter.update();
+            cell_updates += isFullGrid ? n_interior : ta_size;
+        }
+
+        // Truncation telemetry (no TA box in full-grid rows, written as -1)
+
+        if ( pfile_telemetry != NULL && (tt + 1) % TELEMETRY_PERIOD == 0 )  {
+            fprintf(pfile_telemetry, "%d,%.6e,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.16e,%.6e,%.6e,%.6e,%.6e,%.6e\n",
+                    tt + 1, ( tt + 1 ) * kk, (int) isFullGrid,
+                    isFullGrid ? GRIDS_TOT : ta_size, isFullGrid ? 0 : (int) TB.size(), tbl_points, ex_points,
+                    isFullGrid ? -1 : x1_min, isFullGrid ? -1 : x1_max, isFullGrid ? -1 : x2_min, isFullGrid ? -1 : x2_max, Excount,
+                    mass_step, mass_cut * H[0] * H[1], mass_ex * H[0] * H[1],
+                    isFullGrid ? t_full : t_truncate, isFullGrid ? 0.0 : t_overhead, omp_get_wtime() - t_0_begin);
+            fflush(pfile_telemetry);
+        }
+
+        tlog.flush();
+
         if ( (tt + 1) % PERIOD == 0 )
         {   
             t_0_end = omp_get_wtime();
@@ -2555,10 +2943,24 @@ void KleinKramers2d::Evolve()
 
                 log->log("[KleinKramers2d] Core computation time = %lf\n", t_full);
             }
+            if ( meter.isEnabled() && !QUIET )  {
+                log->log("[KleinKramers2d] Energy = %lf J, %.4e J/step\n", meter.total() - energy_period, (meter.total() - energy_period) / PERIOD);
+                energy_period = meter.total();
+            }
             if ( !QUIET ) log->log("\n........................................................\n\n");
         }         
     } // Time iteration 
 
+    if ( pfile_telemetry != NULL )
+        fclose(pfile_telemetry);
+
+    if ( cache.isEnabled() )  {
+        if ( cache.save() )
+            log->log("[KleinKramers2d] Cannot write the result cache in %s\n", CACHE_DIR.c_str());
+        if ( isCacheState && cache.saveState((int)(TIME / kk), BoxShape[0], BoxShape[1], F) )
+            log->log("[KleinKramers2d] Cannot write the cached state in %s\n", CACHE_DIR.c_str());
+    }
+
     delete F;
     delete Feq_loc;
     delete FF;
@@ -2571,9 +2973,19 @@ void KleinKramers2d::Evolve()
     delete Velocity;
     delete Temperature;
 
-    if ( !isFullGrid )
+    if ( !isFullGrid || isAutoGrid )
         delete TAMask;
 
+    if ( meter.isEnabled() )  {
+        meter.update();
+        const int nsteps_energy = (int)(TIME / kk) - tt_energy;
+        const double energy_loop = meter.total() - energy_iter;
+        log->log("[KleinKramers2d] Energy: initialization %lf J, time iteration %lf J\n", energy_iter, energy_loop);
+        log->log("[KleinKramers2d] Energy: package %lf J, DRAM %lf J\n", meter.package(), meter.dram());
+        if ( nsteps_energy > 0 && cell_updates > 0.0 )
+            log->log("[KleinKramers2d] Energy per step = %.4e J, per cell update = %.4e J\n", energy_loop / nsteps_energy, energy_loop / cell_updates);
+    }
+
     log->log("[KleinKramers2d] Evolve done.\n");
 }
 /* =============================================================================== */
@@ -2656,3 +3068,936 @@ inline int KleinKramers2d::GridToIdx(int x1, int x2)
     return (int)(x1 * M1 + x2);
 }
 /* ------------------------------------------------------------------------------- */
+
+inline int KleinKramers2d::NumThreads(int work)
+{
+    if ( !isAdaptiveThreads )
+        return MAX_THREADS;
+
+    return std::max(1, std::min(MAX_THREADS, work / MIN_WORK_THREAD));
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::CalibrateThreads()
+{
+    // Cost model: a parallel region pays off only if each thread gets at
+    // least as much work as the fork/join of the team costs.
+    // t_fork: empty parallel region with the full team (fork + barrier)
+    // t_cell: serial update of one grid point with the Klein-Kramers stencil
+
+    const int nrep = 200;
+    const int ncell = 1 << 16;
+    double t_begin, t_fork, t_cell;
+    double sum = 0.0;
+    volatile double sink;   // keeps the timed loops alive
+    vector<double> f(ncell + 2);
+
+    for (int i = 0; i < ncell + 2; i ++)
+        f[i] = 1.0 / (i + 1.0);
+
+    t_begin = omp_get_wtime();
+
+    for (int r = 0; r < nrep; r ++)  {
+        #pragma omp parallel for reduction(+: sum)
+        for (int i = 0; i < MAX_THREADS; i ++)
+            sum += f[i];
+    }
+    t_fork = (omp_get_wtime() - t_begin) / nrep;
+
+    t_begin = omp_get_wtime();
+
+    for (int r = 0; r < 4; r ++)  {
+        for (int i = 1; i <= ncell; i ++)  {
+            sum += -kk * i * (f[i+1] - f[i-1]) + kk * POTENTIAL_X(1.0 * i, 0.0) * (f[i+1] - f[i-1]) + kk * (f[i] - 0.5 * f[i]);
+        }
+    }
+    t_cell = (omp_get_wtime() - t_begin) / (4.0 * ncell);
+    sink = sum;
+
+    MIN_WORK_THREAD = std::max(1, (int)std::ceil(t_fork / t_cell));
+
+    log->log("[KleinKramers2d] MAX_THREADS: %d\n", MAX_THREADS);
+    log->log("[KleinKramers2d] Fork/join cost = %.4e sec, cost per grid point = %.4e sec\n", t_fork, t_cell);
+    log->log("[KleinKramers2d] MIN_WORK_THREAD: %d\n", MIN_WORK_THREAD);
+}
+/* ------------------------------------------------------------------------------- */
+
+bool KleinKramers2d::CheckParity()
+{
+    // Row i1 must be the mirror image of row BoxShape[0]-1-i1, and the
+    // force odd under (x,p) -> (-x,-p). A declared symmetry skips the force.
+    double xx1, xx2, vx, vmax = 0.0, dv = 0.0;
+
+    if ( std::abs(2.0 * Box[0] + (BoxShape[0] - 1) * H[0]) > 1e-8 * H[0] ||
+         std::abs(2.0 * Box[2] + (BoxShape[1] - 1) * H[1]) > 1e-8 * H[1] )
+        return false;
+
+    if ( SYM_MODE == 2 )
+        return true;
+
+    for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+            xx1 = Box[0] + i1 * H[0];
+            xx2 = Box[2] + i2 * H[1];
+            vx = POTENTIAL_X(xx1, xx2);
+            vmax = std::max(vmax, std::abs(vx));
+            dv = std::max(dv, std::abs(vx + POTENTIAL_X(Box[0] + (BoxShape[0]-1-i1) * H[0], Box[2] + (BoxShape[1]-1-i2) * H[1])));
+        }
+    }
+    return dv <= 1e-10 * vmax;
+}
+/* ------------------------------------------------------------------------------- */
+
+bool KleinKramers2d::IsParityState(double *F)
+{
+    double fmax = 0.0, df = 0.0;
+
+    #pragma omp parallel for reduction(max: fmax,df)
+    for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+            fmax = std::max(fmax, std::abs(F[i1*W1+i2]));
+            df = std::max(df, std::abs(F[i1*W1+i2] - F[(BoxShape[0]-1-i1)*W1+(BoxShape[1]-1-i2)]));
+        }
+    }
+    return df <= 1e-10 * fmax;
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::InitQuasiEquilibrium(double *F)
+{
+    // INIT_MODE 1: local equilibrium, the x-profile of the initial
+    //              wavefunction times a Maxwellian in p.
+    // INIT_MODE 2: Boltzmann distribution exp(-(p^2/2m + V(x))/kT) confined
+    //              to the potential basin that contains Wave0[0].
+    // The caller normalizes F.
+
+    int i1_lo = EDGE;
+    int i1_hi = BoxShape[0] - EDGE - 1;
+    int i1_min;
+    double xx1, xx2;
+    double mkT = m * kb * temp;
+    double kT = kb * temp;
+    double vmin;
+    vector<double> Rho(BoxShape[0], 0.0);
+    vector<double> Vb(BoxShape[0], 0.0);
+
+    if ( INIT_MODE == 1 )  {
+
+        #pragma omp parallel for private(xx1)
+        for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+            xx1 = Box[0] + i1 * H[0];
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                Rho[i1] += WAVEFUNCTION(xx1, Box[2] + i2 * H[1]) * H[1];
+        }
+        log->log("[KleinKramers2d] Initial state: local Maxwellian at temp = %lf\n", temp);
+    }
+    else  {
+
+        for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)
+            Vb[i1] = POTENTIAL(Box[0] + i1 * H[0], 0.0);
+
+        // Slide from Wave0[0] down to the bottom of its well, then climb to
+        // the barrier tops (or the grid edges) on either side
+        i1_min = (int) std::round( ( Wave0[0] - Box[0] ) / H[0] );
+        i1_min = std::max(EDGE, std::min(BoxShape[0] - EDGE - 1, i1_min));
+
+        while ( i1_min > EDGE && Vb[i1_min-1] < Vb[i1_min] )
+            i1_min --;
+        while ( i1_min < BoxShape[0] - EDGE - 1 && Vb[i1_min+1] < Vb[i1_min] )
+            i1_min ++;
+
+        i1_lo = i1_min;
+        i1_hi = i1_min;
+        while ( i1_lo > EDGE && Vb[i1_lo-1] >= Vb[i1_lo] )
+            i1_lo --;
+        while ( i1_hi < BoxShape[0] - EDGE - 1 && Vb[i1_hi+1] >= Vb[i1_hi] )
+            i1_hi ++;
+
+        // The barrier tops belong to neither side
+        if ( i1_lo > EDGE )
+            i1_lo ++;
+        if ( i1_hi < BoxShape[0] - EDGE - 1 )
+            i1_hi --;
+
+        vmin = Vb[i1_min];
+
+        for (int i1 = i1_lo; i1 <= i1_hi; i1 ++)
+            Rho[i1] = exp(-(Vb[i1] - vmin) / kT);
+
+        log->log("[KleinKramers2d] Initial state: Boltzmann distribution at temp = %lf\n", temp);
+        log->log("[KleinKramers2d] Basin [%lf, %lf], well bottom at %lf\n", Box[0] + i1_lo * H[0], Box[0] + i1_hi * H[0], Box[0] + i1_min * H[0]);
+    }
+
+    #pragma omp parallel for private(xx2)
+    for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+            xx2 = Box[2] + i2 * H[1];
+            F[i1*W1+i2] = Rho[i1] * exp(-xx2 * xx2 / (2.0 * mkT));
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::EvolveParareal(double *F, int tt0, double *F0, double corr_0, ResultCache &cache)
+{
+    // Parareal: a serial sweep of the coarse propagator G (time step PR_COARSE * k)
+    // predicts the slice boundaries, the fine propagator (the full-grid RK4 step)
+    // runs on all slices concurrently, and U[n+1] = Fine(U[n]) + G(U[n]) - G_old(U[n])
+    // corrects the prediction. After j iterations the first j slices are exact.
+    int steps = (int)(TIME / kk) - tt0;
+    int P = std::min(PR_SLICES, steps);
+    int teams = std::min(P, MAX_THREADS);
+    int team_size = std::max(1, MAX_THREADS / teams);
+    int max_levels = omp_get_max_active_levels();
+    int ncoarse;
+    double diff, diff_max;
+    double t_0_begin, t_rec;
+
+    vector<int> T(P + 1);
+    vector<vector<double>> U(P + 1, vector<double>(O1, 0.0));
+    vector<vector<double>> G(P, vector<double>(O1, 0.0));
+    vector<vector<double>> Fine(P, vector<double>(O1, 0.0));
+    vector<vector<double>> Work(teams, vector<double>(6 * O1, 0.0));
+    vector<vector<double>> Obs(P);
+    vector<double> Gnew(O1);
+
+    for (int n = 0; n <= P; n ++)
+        T[n] = tt0 + (int)((long)steps * n / P);
+
+    log->log("[KleinKramers2d] Parareal: %d slices, %d team(s) of %d thread(s), coarse step = %d k\n", P, teams, team_size, PR_COARSE);
+
+    omp_set_max_active_levels(2);
+
+    // Initial coarse prediction
+    t_0_begin = omp_get_wtime();
+    U[0].assign(F, F + O1);
+
+    for (int n = 0; n < P; n ++)  {
+        ncoarse = std::max(1, (T[n+1] - T[n]) / PR_COARSE);
+        G[n] = U[n];
+        PropagateFullGrid(G[n].data(), Work[0].data(), (T[n+1] - T[n]) * kk / ncoarse, ncoarse, MAX_THREADS, T[n], F0, NULL);
+        U[n+1] = G[n];
+    }
+    if ( TIMING ) log->log("[KleinKramers2d] Parareal coarse sweep = %lf sec\n", omp_get_wtime() - t_0_begin);
+
+    for (int it = 1; it <= std::min(PR_ITERS, P); it ++)  {
+
+        t_0_begin = omp_get_wtime();
+
+        // Fine propagation of the slices that are not exact yet
+        #pragma omp parallel for num_threads(teams) schedule(dynamic,1)
+        for (int n = it - 1; n < P; n ++)  {
+            Fine[n] = U[n];
+            Obs[n].clear();
+            PropagateFullGrid(Fine[n].data(), Work[omp_get_thread_num()].data(), kk, T[n+1] - T[n], team_size, T[n], F0, &Obs[n]);
+        }
+
+        // Serial correction sweep
+        diff_max = 0.0;
+
+        for (int n = it - 1; n < P; n ++)  {
+
+            ncoarse = std::max(1, (T[n+1] - T[n]) / PR_COARSE);
+            Gnew = U[n];
+            PropagateFullGrid(Gnew.data(), Work[0].data(), (T[n+1] - T[n]) * kk / ncoarse, ncoarse, MAX_THREADS, T[n], F0, NULL);
+
+            diff = 0.0;
+
+            #pragma omp parallel for reduction(+: diff)
+            for (int i = 0; i < O1; i ++)  {
+                double val = Fine[n][i] + (Gnew[i] - G[n][i]);
+                diff += std::abs(val - U[n+1][i]);
+                U[n+1][i] = val;
+            }
+            diff *= H[0] * H[1];
+            diff_max = std::max(diff_max, diff);
+            G[n].swap(Gnew);
+        }
+        log->log("[KleinKramers2d] Parareal iteration %d, max slice change = %.4e\n", it, diff_max);
+        if ( TIMING ) log->log("[KleinKramers2d] Parareal iteration time = %lf sec\n", omp_get_wtime() - t_0_begin);
+
+        if ( diff_max < PR_TOL )
+            break;
+    }
+    omp_set_max_active_levels(max_levels);
+
+    // Observables of the final fine sweep, every PERIOD steps. A slice is not
+    // propagated again once its start is exact, so its last records hold.
+    for (int n = 0; n < P; n ++)  {
+        for (size_t r = 0; r < Obs[n].size(); r += 4)  {
+
+            t_rec = Obs[n][r] * kk;
+
+            log->log("[KleinKramers2d] Normalization factor = %.16e\n", Obs[n][r+1]);
+            cache.record("Norm", t_rec, Obs[n][r+1]);
+
+            if ( isTrans )  {
+                log->log("[KleinKramers2d] Time %lf, Trans = %.16e\n", t_rec, Obs[n][r+2]);
+                cache.record("Trans", t_rec, Obs[n][r+2]);
+            }
+            if ( isCorr )  {
+                log->log("[KleinKramers2d] Time %lf, Corr = %.16e\n", t_rec, Obs[n][r+3]/corr_0);
+                cache.record("Corr", t_rec, Obs[n][r+3]/corr_0);
+            }
+        }
+    }
+    std::copy(U[P].begin(), U[P].end(), F);
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::PropagateFullGrid(double *F, double *W, double k, int nsteps, int nthreads,
+                                       int tt_first, double *F0, vector<double> *Obs)
+{
+    // Full-grid RK4 steps of size k with the local Maxwellian and the
+    // normalization of the main loop; W holds 6 * O1 doubles of scratch.
+    // With Obs the step number (from tt_first), the mass before normalization,
+    // Trans and the unscaled Corr are appended whenever it is a multiple of PERIOD.
+    double *FF = W;
+    double *Feq_loc = W + O1;
+    double *KK1 = W + 2 * O1;
+    double *KK2 = W + 3 * O1;
+    double *KK3 = W + 4 * O1;
+    double *KK4 = W + 5 * O1;
+    double norm, mass, pftrans, corr;
+
+    for (int tt = 0; tt < nsteps; tt ++)  {
+
+        LocalMaxwellian(F, Feq_loc, BoxShape[0], NULL, NULL, NULL, nthreads);
+
+        #pragma omp parallel num_threads(nthreads) if(nthreads > 1)
+        {
+            FullGridStage(1, F, NULL, KK1, FF, Feq_loc, k, BoxShape[0] - EDGE);
+            FullGridStage(2, F, KK1, KK2, FF, Feq_loc, k, BoxShape[0] - EDGE);
+            FullGridStage(3, F, KK2, KK3, FF, Feq_loc, k, BoxShape[0] - EDGE);
+            FullGridStage(4, F, KK3, KK4, FF, Feq_loc, k, BoxShape[0] - EDGE);
+        }
+
+        // Normalization
+        norm = 0.0;
+
+        #pragma omp parallel for reduction (+:norm) num_threads(nthreads) if(nthreads > 1)
+        for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                norm += FF[i1*W1+i2];
+        }
+        mass = norm * H[0] * H[1];
+        norm = 1.0 / mass;
+
+        #pragma omp parallel for num_threads(nthreads) if(nthreads > 1)
+        for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                F[i1*W1+i2] = norm * FF[i1*W1+i2];
+        }
+
+        if ( Obs == NULL || (tt_first + tt + 1) % PERIOD != 0 )
+            continue;
+
+        pftrans = 0.0;
+        corr = 0.0;
+
+        if ( isTrans )  {
+            #pragma omp parallel for reduction (+:pftrans) num_threads(nthreads) if(nthreads > 1)
+            for (int i1 = idx_x0; i1 < BoxShape[0]-EDGE; i1 ++)  {
+                for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                    pftrans += F[i1*W1+i2];
+            }
+            pftrans *= H[0] * H[1];
+        }
+
+        if ( isCorr )  {
+            #pragma omp parallel for reduction(+: corr) num_threads(nthreads) if(nthreads > 1)
+            for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                double density = 0.0;
+                for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                    density += F[i1*W1+i2];
+                corr += density * H[1] * F0[i1];
+            }
+            corr *= H[0];
+        }
+        Obs->push_back(tt_first + tt + 1);
+        Obs->push_back(mass);
+        Obs->push_back(pftrans);
+        Obs->push_back(corr);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::LocalMaxwellian(const double *F, double *Feq_loc, int n1,
+                                     double *Dens, double *Vel, double *Temp, int nthreads)
+{
+    // Local Maxwellian of rows 0..n1-1 from the density, drift velocity and
+    // temperature moments of F; the moments are kept in Dens/Vel/Temp if given.
+    #pragma omp parallel for num_threads(nthreads) if(nthreads > 1)
+    for (int i1 = 0; i1 < n1; i1 ++)  {
+        double density = 0.0;
+        double velocity_dft = 0.0;
+        double temp_loc = 0.0;
+        double feq;
+
+        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+            density += F[i1*W1+i2] * H[1];
+
+        if (density <= 0.0)  {
+            density = 0.0;
+            for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                Feq_loc[i1*W1+i2] = 0.0;
+        }
+        else  {
+            if ( isLinearizedCollision )
+                temp_loc = temp;
+            else  {
+                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                    velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                velocity_dft = velocity_dft / (m * density);
+
+                if ( isIsothermal )
+                    temp_loc = temp;
+                else  {
+                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)
+                        temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
+                    temp_loc = temp_loc / (m * kb * density);
+                }
+            }
+            for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
+                Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+            }
+        }
+        if ( Dens != NULL )  {
+            Dens[i1] = density;
+            Vel[i1] = velocity_dft;
+            Temp[i1] = temp_loc;
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::FullGridStage(int s, const double *F, const double *Kp, double *Kn, double *FF,
+                                   const double *Feq_loc, double k, int i1_end)
+{
+    // RK4 stage s of the full-grid step on rows EDGE..i1_end-1: Kn from F and
+    // the previous stage Kp (unused for s = 1), accumulated into FF. Work-shared
+    // by the enclosing parallel region.
+    double k2h0m = k / (2.0 * H[0] * m);
+    double k2h1 = k / (2.0 * H[1]);
+    double kgamma = k * gamma;
+    double a = ( s == 4 ) ? 1.0 : 0.5;
+    double b = ( s == 1 || s == 4 ) ? 6.0 : 3.0;
+    double xx1, xx2, f0, f1p, f1m, f2p, f2m, feq;
+
+    if ( s == 1 )  {
+        #pragma omp for
+        for (int i1 = EDGE; i1 < i1_end; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                xx1 = Box[0] + i1 * H[0];
+                xx2 = Box[2] + i2 * H[1];
+                f0 = F[i1*W1+i2];
+                f1p = F[(i1+1)*W1+i2];
+                f1m = F[(i1-1)*W1+i2];
+                f2p = F[i1*W1+(i2+1)];
+                f2m = F[i1*W1+(i2-1)];
+                feq = Feq_loc[i1*W1+i2];
+
+                Kn[i1*W1+i2] = -k2h0m * xx2 * (f1p - f1m) + 
+                               k2h1 * POTENTIAL_X(xx1, xx2) * (f2p - f2m) +
+                               kgamma * (feq - f0);
+
+                FF[i1*W1+i2] = F[i1*W1+i2] + Kn[i1*W1+i2] / b;
+            }
+        }
+        return;
+    }
+
+    #pragma omp for
+    for (int i1 = EDGE; i1 < i1_end; i1 ++)  {
+        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+            xx1 = Box[0] + i1 * H[0];
+            xx2 = Box[2] + i2 * H[1];
+            f0 = F[i1*W1+i2];
+            feq = Feq_loc[i1*W1+i2];
+
+            Kn[i1*W1+i2] = -k2h0m * xx2 * (F[(i1+1)*W1+i2] + a * Kp[(i1+1)*W1+i2] - F[(i1-1)*W1+i2] - a * Kp[(i1-1)*W1+i2]) + 
+                           k2h1 * POTENTIAL_X(xx1, xx2) * (F[i1*W1+(i2+1)] + a * Kp[i1*W1+(i2+1)] - F[i1*W1+(i2-1)] - a * Kp[i1*W1+(i2-1)]) +
+                           kgamma * (feq - f0 - a * Kp[i1*W1+i2]);
+
+            FF[i1*W1+i2] += Kn[i1*W1+i2] / b;
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+void KleinKramers2d::EvolveDG(double *F, int tt0, double *F0, double corr_0, ResultCache &cache)
+{
+    // Modal discontinuous Galerkin on elements of DG_RATIO x DG_RATIO grid
+    // points with the tensor Legendre basis of degree DG_ORDER per direction
+    // ({1, xi, eta, xi*eta} for P1, up to xi^2 eta^2 for P2), upwind fluxes
+    // for streaming and force, the BGK source at the Gauss points, and
+    // SSP-RK3 substeps. F is projected in and out at report times.
+    int steps = (int)(TIME / kk);
+    int np = DG_ORDER + 1;
+    int nm = np * np;
+    int nsub;
+    int NE0 = (BoxShape[0] - 2 * EDGE) / DG_RATIO;
+    int NE1 = (BoxShape[1] - 2 * EDGE) / DG_RATIO;
+    double he0 = DG_RATIO * H[0];
+    double he1 = DG_RATIO * H[1];
+    double gq[3], wq[3];
+    double amax = 0.0, bmax = 0.0;
+    double dt, norm, mass_grid, pftrans, density, corr;
+    double t_0_begin;
+
+    vector<double> U(nm * NE0 * NE1);
+    vector<double> U1(nm * NE0 * NE1);
+    vector<double> R(nm * NE0 * NE1);
+
+    DGBasis(gq, wq);
+
+    // Largest wave speeds at the Gauss points set the substep. DG_CFL is the
+    // Courant number of P1; degree p is stable up to about 3 / (2p + 1) of it.
+    for (int e1 = 0; e1 < NE1; e1 ++)  {
+        double pc = Box[2] + (EDGE + e1 * DG_RATIO + 0.5 * (DG_RATIO - 1)) * H[1];
+        amax = std::max(amax, (std::abs(pc) + 0.5 * he1 * gq[np-1]) / m);
+    }
+    for (int e0 = 0; e0 < NE0; e0 ++)  {
+        double xc = Box[0] + (EDGE + e0 * DG_RATIO + 0.5 * (DG_RATIO - 1)) * H[0];
+        for (int q = 0; q < np; q ++)
+            bmax = std::max(bmax, std::abs(POTENTIAL_X(xc + 0.5 * he0 * gq[q], 0.0)));
+    }
+    nsub = std::max(1, (int) std::ceil(kk * (amax / he0 + bmax / he1 + gamma) * (2 * DG_ORDER + 1) / (3.0 * DG_CFL)));
+    dt = kk / nsub;
+
+    log->log("[KleinKramers2d] DG: %d x %d elements of %d x %d points, P%d, %d dofs (grid %d)\n",
+             NE0, NE1, DG_RATIO, DG_RATIO, DG_ORDER, nm * NE0 * NE1, GRIDS_TOT);
+    log->log("[KleinKramers2d] DG: %d SSP-RK3 substep(s) per step, dt = %e\n", nsub, dt);
+
+    ProjectToDG(F, U.data(), NE0, NE1);
+
+    // Mass on the points past the last element (see init)
+    if ( NE0 * DG_RATIO < BoxShape[0] - 2 * EDGE || NE1 * DG_RATIO < BoxShape[1] - 2 * EDGE )  {
+        mass_grid = 0.0;
+        norm = 0.0;
+
+        #pragma omp parallel for reduction (+:mass_grid)
+        for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                mass_grid += F[i1*W1+i2];
+        }
+        for (int e = 0; e < NE0 * NE1; e ++)
+            norm += U[nm*e];
+
+        log->log("[KleinKramers2d] DG: mass left out of the elements = %.4e\n", mass_grid * H[0] * H[1] - norm * he0 * he1);
+    }
+    t_0_begin = omp_get_wtime();
+
+    for (int tt = tt0; tt < steps; tt ++)  {
+
+        for (int s = 0; s < nsub; s ++)  {
+
+            // SSP-RK3 (Shu-Osher form)
+            DGRhs(U.data(), R.data(), NE0, NE1);
+
+            #pragma omp parallel for
+            for (int i = 0; i < nm * NE0 * NE1; i ++)
+                U1[i] = U[i] + dt * R[i];
+
+            DGRhs(U1.data(), R.data(), NE0, NE1);
+
+            #pragma omp parallel for
+            for (int i = 0; i < nm * NE0 * NE1; i ++)
+                U1[i] = 0.75 * U[i] + 0.25 * (U1[i] + dt * R[i]);
+
+            DGRhs(U1.data(), R.data(), NE0, NE1);
+
+            #pragma omp parallel for
+            for (int i = 0; i < nm * NE0 * NE1; i ++)
+                U[i] = (U[i] + 2.0 * (U1[i] + dt * R[i])) / 3.0;
+        }
+
+        // Normalization, the mass is carried by the cell means
+        norm = 0.0;
+
+        #pragma omp parallel for reduction (+:norm)
+        for (int e = 0; e < NE0 * NE1; e ++)
+            norm += U[nm*e];
+
+        norm *= he0 * he1;
+
+        #pragma omp parallel for
+        for (int i = 0; i < nm * NE0 * NE1; i ++)
+            U[i] /= norm;
+
+        if ( (tt + 1) % PERIOD != 0 )
+            continue;
+
+        log->log("[KleinKramers2d] Normalization factor = %.16e\n", norm);
+        cache.record("Norm", ( tt + 1 ) * kk, norm);
+
+        ProjectFromDG(U.data(), F, NE0, NE1);
+
+        if ( isTrans )  {
+            pftrans = 0.0;
+
+            #pragma omp parallel for reduction (+:pftrans)
+            for (int i1 = idx_x0; i1 < BoxShape[0]-EDGE; i1 ++)  {
+                for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                    pftrans += F[i1*W1+i2];
+            }
+            pftrans *= H[0] * H[1];
+            log->log("[KleinKramers2d] Time %lf, Trans = %.16e\n", ( tt + 1 ) * kk, pftrans);
+            cache.record("Trans", ( tt + 1 ) * kk, pftrans);
+        }
+
+        if ( isCorr )  {
+            corr = 0.0;
+
+            #pragma omp parallel for private(density) reduction(+: corr)
+            for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                density = 0.0;
+                for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)
+                    density += F[i1*W1+i2];
+                corr += density * H[1] * F0[i1];
+            }
+            corr *= H[0];
+            log->log("[KleinKramers2d] Time %lf, Corr = %.16e\n", ( tt + 1 ) * kk, corr/corr_0);
+            cache.record("Corr", ( tt + 1 ) * kk, corr/corr_0);
+        }
+
+        if ( !QUIET )  {
+            log->log("[KleinKramers2d] Step: %d, Elapsed time: %lf sec\n", tt + 1, omp_get_wtime() - t_0_begin);
+            log->log("\n........................................................\n\n");
+        }
+        t_0_begin = omp_get_wtime();
+    }
+    ProjectFromDG(U.data(), F, NE0, NE1);
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::DGRhs(const double *U, double *R, int NE0, int NE1)
+{
+    // dU/dt of the DG semi-discretization of
+    //     f_t + (p/m f)_x + (-V'(x) f)_p = gamma (feq - f)
+    // with zero inflow through the box boundary. Each element evaluates its
+    // modes at the np x np Gauss points and on its four faces, so elements
+    // are independent and the kernel is a batch of small fixed products.
+    int np = DG_ORDER + 1;
+    int nm = np * np;
+    double he0 = DG_RATIO * H[0];
+    double he1 = DG_RATIO * H[1];
+    double jac = 0.25 * he0 * he1;
+    double gq[3], wq[3];
+    double L[3][3], dL[3][3], Lf[3][2];
+    double mnorm[9];
+
+    DGBasis(gq, wq);
+
+    for (int a = 0; a < np; a ++)  {
+        for (int q = 0; q < np; q ++)  {
+            L[a][q] = DGLegendre(a, gq[q]);
+            dL[a][q] = DGLegendreD(a, gq[q]);
+        }
+        Lf[a][0] = DGLegendre(a, -1.0);
+        Lf[a][1] = DGLegendre(a, 1.0);
+    }
+    for (int j = 0; j < np; j ++)  {
+        for (int i = 0; i < np; i ++)
+            mnorm[i+np*j] = 4.0 / ((2 * i + 1) * (2 * j + 1));
+    }
+
+    #pragma omp parallel for
+    for (int e0 = 0; e0 < NE0; e0 ++)  {
+
+        double xc = Box[0] + (EDGE + e0 * DG_RATIO + 0.5 * (DG_RATIO - 1)) * H[0];
+        double xq[3], bq[3];
+        double moment[3][3] = { {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0} };
+        double ptemp[3] = { 0.0, 0.0, 0.0 };
+        double density[3], velocity_dft[3], temp_loc[3];
+        double fq[3][3];
+
+        for (int q = 0; q < np; q ++)  {
+            xq[q] = xc + 0.5 * he0 * gq[q];
+            bq[q] = -POTENTIAL_X(xq[q], 0.0);
+        }
+
+        // Local Maxwellian of the column at the x Gauss points
+        for (int e1 = 0; e1 < NE1; e1 ++)  {
+            const double *c = U + nm * (e0 * NE1 + e1);
+            double pc = Box[2] + (EDGE + e1 * DG_RATIO + 0.5 * (DG_RATIO - 1)) * H[1];
+            DGEval(c, L, fq);
+            for (int q0 = 0; q0 < np; q0 ++)  {
+                for (int q1 = 0; q1 < np; q1 ++)  {
+                    double pp = pc + 0.5 * he1 * gq[q1];
+                    double w = 0.5 * he1 * wq[q1] * fq[q0][q1];
+                    moment[q0][0] += w;
+                    moment[q0][1] += w * pp;
+                    moment[q0][2] += w * pp * pp;
+                }
+            }
+        }
+        for (int q0 = 0; q0 < np; q0 ++)  {
+            density[q0] = moment[q0][0];
+            velocity_dft[q0] = 0.0;
+            temp_loc[q0] = temp;
+            if ( density[q0] <= 0.0 || isLinearizedCollision )
+                continue;
+            velocity_dft[q0] = moment[q0][1] / (m * density[q0]);
+            if ( !isIsothermal )  {
+                ptemp[q0] = moment[q0][2] - 2.0 * m * velocity_dft[q0] * moment[q0][1] + 
+                            m * m * velocity_dft[q0] * velocity_dft[q0] * moment[q0][0];
+                temp_loc[q0] = ptemp[q0] / (m * kb * density[q0]);
+            }
+        }
+
+        for (int e1 = 0; e1 < NE1; e1 ++)  {
+
+            const double *c = U + nm * (e0 * NE1 + e1);
+            const double *cl = ( e0 > 0 ) ? U + nm * ((e0 - 1) * NE1 + e1) : NULL;
+            const double *cr = ( e0 < NE0 - 1 ) ? U + nm * ((e0 + 1) * NE1 + e1) : NULL;
+            const double *cb = ( e1 > 0 ) ? c - nm : NULL;
+            const double *ct = ( e1 < NE1 - 1 ) ? c + nm : NULL;
+            double *r = R + nm * (e0 * NE1 + e1);
+            double pc = Box[2] + (EDGE + e1 * DG_RATIO + 0.5 * (DG_RATIO - 1)) * H[1];
+            double res[9] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+            double pp, a, w, feq, fin, fout, flux;
+            int s, so;
+
+            DGEval(c, L, fq);
+
+            // Volume terms and the BGK source
+            for (int q0 = 0; q0 < np; q0 ++)  {
+                for (int q1 = 0; q1 < np; q1 ++)  {
+                    pp = pc + 0.5 * he1 * gq[q1];
+                    a = pp / m;
+                    w = wq[q0] * wq[q1];
+
+                    feq = 0.0;
+                    if ( density[q0] > 0.0 )  {
+                        feq = density[q0] * sqrt(1/(2*PI*m*kb*temp_loc[q0])) * exp(-pow((pp - m*velocity_dft[q0]), 2)/(2*m*kb*temp_loc[q0]));
+                        feq = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                    }
+                    feq *= gamma * jac * w;
+
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)
+                            res[i+np*j] += feq * L[i][q0] * L[j][q1] + 
+                                           w * fq[q0][q1] * (0.5 * he1 * a * dL[i][q0] * L[j][q1] + 0.5 * he0 * bq[q0] * L[i][q0] * dL[j][q1]);
+                    }
+                }
+            }
+
+            // x faces: the flux p/m changes sign with p only
+            for (int q1 = 0; q1 < np; q1 ++)  {
+                a = (pc + 0.5 * he1 * gq[q1]) / m;
+                for (int side = -1; side <= 1; side += 2)  {
+                    const double *cn = ( side < 0 ) ? cl : cr;
+                    s = ( side > 0 );
+                    so = 1 - s;
+                    fin = 0.0;
+                    fout = 0.0;
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)  {
+                            fin += c[i+np*j] * Lf[i][s] * L[j][q1];
+                            if ( cn != NULL )
+                                fout += cn[i+np*j] * Lf[i][so] * L[j][q1];
+                        }
+                    }
+                    flux = side * a > 0.0 ? a * fin : a * fout;
+                    flux *= 0.5 * he1 * wq[q1] * side;
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)
+                            res[i+np*j] -= flux * Lf[i][s] * L[j][q1];
+                    }
+                }
+            }
+
+            // p faces: the flux -V'(x) changes sign with x only
+            for (int q0 = 0; q0 < np; q0 ++)  {
+                for (int side = -1; side <= 1; side += 2)  {
+                    const double *cn = ( side < 0 ) ? cb : ct;
+                    s = ( side > 0 );
+                    so = 1 - s;
+                    fin = 0.0;
+                    fout = 0.0;
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)  {
+                            fin += c[i+np*j] * L[i][q0] * Lf[j][s];
+                            if ( cn != NULL )
+                                fout += cn[i+np*j] * L[i][q0] * Lf[j][so];
+                        }
+                    }
+                    flux = side * bq[q0] > 0.0 ? bq[q0] * fin : bq[q0] * fout;
+                    flux *= 0.5 * he0 * wq[q0] * side;
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)
+                            res[i+np*j] -= flux * L[i][q0] * Lf[j][s];
+                    }
+                }
+            }
+
+            for (int k = 0; k < nm; k ++)
+                r[k] = res[k] / (mnorm[k] * jac) - gamma * c[k];
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::DGEval(const double *c, const double L[3][3], double fq[3][3])
+{
+    // Element solution at the Gauss points, L[a][q] = P_a(g_q)
+    int np = DG_ORDER + 1;
+
+    for (int q0 = 0; q0 < np; q0 ++)  {
+        for (int q1 = 0; q1 < np; q1 ++)  {
+            fq[q0][q1] = 0.0;
+            for (int j = 0; j < np; j ++)  {
+                for (int i = 0; i < np; i ++)
+                    fq[q0][q1] += c[i+np*j] * L[i][q0] * L[j][q1];
+            }
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::DGBasis(double *gq, double *wq)
+{
+    // Gauss-Legendre rule on [-1, 1] with DG_ORDER + 1 points, exact for the
+    // mass matrix and the linear flux terms of the basis
+    if ( DG_ORDER == 1 )  {
+        gq[0] = -1.0 / sqrt(3.0);  gq[1] = 1.0 / sqrt(3.0);
+        wq[0] = 1.0;               wq[1] = 1.0;
+    }
+    else  {
+        gq[0] = -sqrt(0.6);   gq[1] = 0.0;          gq[2] = sqrt(0.6);
+        wq[0] = 5.0 / 9.0;    wq[1] = 8.0 / 9.0;    wq[2] = 5.0 / 9.0;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+double KleinKramers2d::DGLegendre(int a, double x)
+{
+    return ( a == 0 ) ? 1.0 : ( a == 1 ) ? x : 0.5 * (3.0 * x * x - 1.0);
+}
+/* ------------------------------------------------------------------------------- */
+
+double KleinKramers2d::DGLegendreD(int a, double x)
+{
+    return ( a == 0 ) ? 0.0 : ( a == 1 ) ? 1.0 : 3.0 * x;
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::DGCellModes(double *A)
+{
+    // A[j*np+a]: mean of P_a over grid cell j of an element side, the cell
+    // centred at xi_j = (2j + 1 - r) / r with half width 1 / r. The means of
+    // the modes above P_0 sum to zero, so the cell mean of P_0 keeps the mass.
+    int r = DG_RATIO;
+    int np = DG_ORDER + 1;
+    double xi, d = 1.0 / r;
+
+    for (int j = 0; j < r; j ++)  {
+        xi = (2.0 * j + 1.0 - r) / r;
+        for (int a = 0; a < np; a ++)
+            A[j*np+a] = ( a < 2 ) ? DGLegendre(a, xi) : DGLegendre(a, xi) + 0.5 * d * d;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::ProjectToDG(const double *F, double *U, int NE0, int NE1)
+{
+    // Least-squares fit of the element modes to the grid values, read as
+    // cell means. The normal matrix is the same for both directions and all
+    // elements, so the fit is the tensor product of one np x r map P.
+    int r = DG_RATIO;
+    int np = DG_ORDER + 1;
+    int nm = np * np;
+    double G[3][3], Ginv[3][3], piv, fac;
+
+    vector<double> A(r * np);
+    vector<double> P(np * r, 0.0);
+
+    DGCellModes(A.data());
+
+    for (int a = 0; a < np; a ++)  {
+        for (int b = 0; b < np; b ++)  {
+            G[a][b] = 0.0;
+            for (int j = 0; j < r; j ++)
+                G[a][b] += A[j*np+a] * A[j*np+b];
+            Ginv[a][b] = ( a == b ) ? 1.0 : 0.0;
+        }
+    }
+    // Gauss-Jordan, G is symmetric positive definite for r > DG_ORDER
+    for (int c = 0; c < np; c ++)  {
+        piv = G[c][c];
+        for (int b = 0; b < np; b ++)  {
+            G[c][b] /= piv;
+            Ginv[c][b] /= piv;
+        }
+        for (int a = 0; a < np; a ++)  {
+            if ( a == c )
+                continue;
+            fac = G[a][c];
+            for (int b = 0; b < np; b ++)  {
+                G[a][b] -= fac * G[c][b];
+                Ginv[a][b] -= fac * Ginv[c][b];
+            }
+        }
+    }
+    for (int a = 0; a < np; a ++)  {
+        for (int j = 0; j < r; j ++)  {
+            for (int b = 0; b < np; b ++)
+                P[a*r+j] += Ginv[a][b] * A[j*np+b];
+        }
+    }
+
+    #pragma omp parallel for
+    for (int e0 = 0; e0 < NE0; e0 ++)  {
+        for (int e1 = 0; e1 < NE1; e1 ++)  {
+            double c[9] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+            for (int j0 = 0; j0 < r; j0 ++)  {
+                for (int j1 = 0; j1 < r; j1 ++)  {
+                    double f = F[(EDGE + e0 * r + j0) * W1 + EDGE + e1 * r + j1];
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)
+                            c[i+np*j] += f * P[i*r+j0] * P[j*r+j1];
+                    }
+                }
+            }
+            for (int k = 0; k < nm; k ++)
+                U[nm*(e0*NE1+e1)+k] = c[k];
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::ProjectFromDG(const double *U, double *F, int NE0, int NE1)
+{
+    // Grid cell means of the DG solution, so the grid carries the DG mass;
+    // points left over by the element tiling stay zero
+    int r = DG_RATIO;
+    int np = DG_ORDER + 1;
+    int nm = np * np;
+
+    vector<double> A(r * np);
+
+    DGCellModes(A.data());
+
+    #pragma omp parallel for
+    for (int i = 0; i < O1; i ++)
+        F[i] = 0.0;
+
+    #pragma omp parallel for
+    for (int e0 = 0; e0 < NE0; e0 ++)  {
+        for (int e1 = 0; e1 < NE1; e1 ++)  {
+            const double *c = U + nm * (e0 * NE1 + e1);
+            for (int j0 = 0; j0 < r; j0 ++)  {
+                for (int j1 = 0; j1 < r; j1 ++)  {
+                    double f = 0.0;
+                    for (int j = 0; j < np; j ++)  {
+                        for (int i = 0; i < np; i ++)
+                            f += c[i+np*j] * A[j0*np+i] * A[j1*np+j];
+                    }
+                    F[(EDGE + e0 * r + j0) * W1 + EDGE + e1 * r + j1] = f;
+                }
+            }
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
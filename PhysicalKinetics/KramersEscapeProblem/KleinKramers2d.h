@@ -16,12 +16,16 @@
 #define QTR_KLEINKRAMERS2D_H
 
 #include <complex>
+#include <string>
+#include <vector>
 
 #include "Containers.h"
 #include "Eigen.h"
 #include "Pointers.h"
 
 namespace QTR_NS {
+
+    class ResultCache;
     
     class KleinKramers2d {
         
@@ -32,6 +36,7 @@ namespace QTR_NS {
         void                          Evolve();
         VectorXi                      IdxToGrid(int idx);
         inline int                    GridToIdx(int x1, int x2);
+        inline int                    NumThreads(int work);
 
         inline double                 Wavefunction_DW1(double x1, double x2);
         inline double                 Potential_DW1(double x1, double x2);
@@ -48,6 +53,29 @@ namespace QTR_NS {
     private:
 
         void            init();
+        void            BuildSpans(const bool *TAMask, int x1_min, int x1_max, int x2_min, int x2_max);
+        void            AutoBox();
+        void            SnapBox(int dim, double lo, double hi);
+        void            CalibrateThreads();
+        void            InitQuasiEquilibrium(double *F);
+        void            EvolveParareal(double *F, int tt0, double *F0, double corr_0, ResultCache &cache);
+        void            PropagateFullGrid(double *F, double *W, double k, int nsteps, int nthreads,
+                                          int tt_first, double *F0, std::vector<double> *Obs);
+        void            LocalMaxwellian(const double *F, double *Feq_loc, int n1,
+                                        double *Dens, double *Vel, double *Temp, int nthreads);
+        void            FullGridStage(int s, const double *F, const double *Kp, double *Kn, double *FF,
+                                      const double *Feq_loc, double k, int i1_end);
+        void            EvolveDG(double *F, int tt0, double *F0, double corr_0, ResultCache &cache);
+        void            DGRhs(const double *U, double *R, int NE0, int NE1);
+        void            ProjectToDG(const double *F, double *U, int NE0, int NE1);
+        void            ProjectFromDG(const double *U, double *F, int NE0, int NE1);
+        void            DGEval(const double *c, const double L[3][3], double fq[3][3]);
+        void            DGBasis(double *gq, double *wq);
+        double          DGLegendre(int a, double x);
+        double          DGLegendreD(int a, double x);
+        void            DGCellModes(double *A);
+        bool            CheckParity();
+        bool            IsParityState(double *F);
         QTR             *qtr;
         Error           *err;
         Log             *log;
@@ -61,10 +89,30 @@ namespace QTR_NS {
         int             PERIOD;
         int             SORT_PERIOD;
         int             PRINT_PERIOD;
+        int             TELEMETRY_PERIOD; // steps between telemetry.csv records, 0 if disabled
         int             PRINT_WAVEFUNC_PERIOD;
+        int             AUTO_GRID_PERIOD;
+        int             INIT_MODE;
+        int             PR_SLICES;        // Parareal time slices, < 2 if disabled
+        int             PR_ITERS;
+        int             PR_COARSE;        // fine steps per coarse step
+        double          PR_TOL;
+        int             DG_RATIO;         // grid points per DG element side, < 2 if disabled
+        int             DG_ORDER;         // DG polynomial degree per direction, 1 or 2
+        double          DG_CFL;
+        int             SYM_MODE;         // 0 = none, 1 = detect parity, 2 = declared parity
+        int             SYM_ROWS;         // x1 rows solved by the full-grid stages
+        bool            isSymmetric;      // f(x,p) = f(-x,-p), lower half solved
         int             GRIDS_TOT;
         bool            QUIET;
         bool            TIMING;
+        std::string     TIMING_LOG;  // file of the per-region timing lines, empty for the log
+        bool            ENERGY;      // RAPL energy of the time iteration
+        bool            isAdaptiveThreads;
+        int             MAX_THREADS;
+        int             MIN_WORK_THREAD;  // grid points per thread to amortize a fork/join
+        bool            isCacheState;
+        std::string     CACHE_DIR;        // result cache directory, empty if disabled
         double          TIME;   
         double          PI_INV;  // 1/pi
         double          HBSQ_INV; // (1/hb)^2
@@ -82,6 +130,11 @@ namespace QTR_NS {
         int             W1;
         int             O1;
 
+        // Active x2 runs of each x1 row of the TA, see BuildSpans
+        std::vector<int> SpanPtr;
+        std::vector<int> SpanLo;
+        std::vector<int> SpanHi;
+
         // Potential parameters
         int             idx_x0; 
         double          trans_x0;      
@@ -98,6 +151,8 @@ namespace QTR_NS {
 
         // Truncate parameters
         bool            isFullGrid; 
+        bool            isAutoGrid;    // switch between TG and FG at runtime
+        bool            isAutoBox;     // derive the box from the physics, user box as bound
         bool            isExtrapolate;  
         bool            isTouchBoundary;       
         double          TolH;
@@ -105,6 +160,8 @@ namespace QTR_NS {
         double          TolHd;
         double          TolLd;
         double          ExReduce;
+        double          AutoGridThreshold;
+        double          AutoBoxTol;
         int             ExLimit;
 
         // Domains
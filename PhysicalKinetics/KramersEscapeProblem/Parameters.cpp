@@ -105,6 +105,10 @@ int Parameters::load(FILE *file){
         writeLog    = ini.GetValueB("MAIN", "write_log", writeLog);
         // SCATTERXD //
         scxd_isFullGrid = ini.GetValueB("SCATTERXD", "isFullGrid", 1);  
+        scxd_isAutoGrid = ini.GetValueB("SCATTERXD", "isAutoGrid", 0);
+        scxd_isAutoBox  = ini.GetValueB("SCATTERXD", "isAutoBox", 0);
+        scxd_isAdaptiveThreads = ini.GetValueB("SCATTERXD", "isAdaptiveThreads", 0);
+        scxd_isCacheState = ini.GetValueB("SCATTERXD", "isCacheState", 1);
         scxd_isTrans    = ini.GetValueB("SCATTERXD", "isTrans", 1);
         scxd_isAcf      = ini.GetValueB("SCATTERXD", "isAcf", 1);
         scxd_isPrintEdge = ini.GetValueB("SCATTERXD", "isPrintEdge", 0);
@@ -122,8 +126,17 @@ int Parameters::load(FILE *file){
         scxd_isDampX2        = ini.GetValueB("SCATTERXD", "isDampX2", 0);
         scxd_dimensions = ini.GetValueI("SCATTERXD", "dimensions", 3);  
         scxd_period = ini.GetValueI("SCATTERXD", "period", 100);
+        scxd_autogridperiod = ini.GetValueI("SCATTERXD", "autogridperiod", 100);
+        scxd_initmode = ini.GetValueI("SCATTERXD", "initmode", 0);
+        scxd_pslices = ini.GetValueI("SCATTERXD", "pslices", 0);
+        scxd_piters = ini.GetValueI("SCATTERXD", "piters", 0);
+        scxd_symmetry = ini.GetValueI("SCATTERXD", "symmetry", 0);
+        scxd_dgratio = ini.GetValueI("SCATTERXD", "dgratio", 0);
+        scxd_dgorder = ini.GetValueI("SCATTERXD", "dgorder", 2);
+        scxd_pcoarse = ini.GetValueI("SCATTERXD", "pcoarse", 10);
         scxd_sortperiod = ini.GetValueI("SCATTERXD", "sortperiod", 100);
         scxd_printperiod = ini.GetValueI("SCATTERXD", "printperiod", 100);
+        scxd_telemetryperiod = ini.GetValueI("SCATTERXD", "telemetryperiod", 0);
         scxd_printwavefuncperiod = ini.GetValueI("SCATTERXD", "printwavefuncperiod", 100);
         scxd_cfactor = ini.GetValueI("SCATTERXD", "cfactor", 1);
         scxd_skin    = ini.GetValueI("SCATTERXD", "skin", 5);
@@ -171,6 +184,10 @@ int Parameters::load(FILE *file){
         scxd_TolHd    = ini.GetValueF("SCATTERXD", "TolHd", 0);
         scxd_TolLd    = ini.GetValueF("SCATTERXD", "TolLd", 0);
         scxd_ExReduce = ini.GetValueF("SCATTERXD", "ExReduce", 0);
+        scxd_AutoGridThreshold = ini.GetValueF("SCATTERXD", "AutoGridThreshold", 0.2);
+        scxd_AutoBoxTol = ini.GetValueF("SCATTERXD", "AutoBoxTol", 1e-8);
+        scxd_ptol = ini.GetValueF("SCATTERXD", "ptol", 1e-10);
+        scxd_dgcfl = ini.GetValueF("SCATTERXD", "dgcfl", 0.3);
         scxd_Vmode_1  = ini.GetValueI("SCATTERXD", "Vmode_1", 0);
         scxd_Vmode_2  = ini.GetValueI("SCATTERXD", "Vmode_2", 0);
         scxd_Vmode_3  = ini.GetValueI("SCATTERXD", "Vmode_3", 0);
@@ -206,10 +223,23 @@ int Parameters::load(FILE *file){
         scxd_trans_x0 = ini.GetValueF("SCATTERXD", "trans_x0", 0.0);    
         scxd_quantumness = ini.GetValueF("SCATTERXD", "quantumness", 1.0);    
         scxd_edge   = ini.GetValueI("SCATTERXD", "edge", 2);          // Edge size
+        scxd_cachedir = ini.GetValue("SCATTERXD", "cachedir", "");
+        scxd_timinglog = ini.GetValue("SCATTERXD", "timinglog", "");
+        scxd_energy = ini.GetValueB("SCATTERXD", "energy", false);
        
         // RANDOM //
         rngSeed     = ini.GetValueL("RANDOM", "random_seed" , rngSeed);
         rngType     = ini.GetValue ("RANDOM", "random_type" , rngType);
+
+        // CHECKS //
+        if ( scxd_initmode < 0 || scxd_initmode > 2 )  {
+            fprintf(stderr, "error: initmode %d is not 0 (wavefunction), 1 (local Maxwellian) or 2 (basin Boltzmann)\n", scxd_initmode);
+            error = 1;
+        }
+        if ( scxd_dgorder < 1 || scxd_dgorder > 2 )  {
+            fprintf(stderr, "error: dgorder %d is not 1 (P1) or 2 (P2)\n", scxd_dgorder);
+            error = 1;
+        }
     }
     else
     {
@@ -221,4 +251,73 @@ int Parameters::load(FILE *file){
 }
 /* ------------------------------------------------------------------------------- */
 
+string Parameters::Fingerprint(bool isWithTf)
+{
+    // Canonical text of every input that can change the numerical result.
+    // Output-only settings (print flags and periods, timing, thread sizing,
+    // the cache itself) are left out so they do not split the cache.
+    string s = job + ";";
+    char buf[128];
+
+#define FP_I(v) { snprintf(buf, sizeof(buf), #v "=%d;", (int)(v)); s += buf; }
+#define FP_F(v) { snprintf(buf, sizeof(buf), #v "=%a;", (double)(v)); s += buf; }
+
+    FP_I(scxd_dimensions);  FP_I(scxd_isFullGrid);  FP_I(scxd_isAutoGrid);
+    FP_I(scxd_isTrans);     FP_I(scxd_isAcf);       FP_I(scxd_isDensityMatrix);
+    FP_I(scxd_isIsothermal);  FP_I(scxd_isLinearizedCollision);
+    FP_I(scxd_isModCL);     FP_I(scxd_isDampX1);    FP_I(scxd_isDampX2);
+    FP_I(scxd_Vmode_1);     FP_I(scxd_Vmode_2);     FP_I(scxd_Vmode_3);    FP_I(scxd_Vmode_4);
+    FP_I(scxd_period);      FP_I(scxd_autogridperiod);  FP_I(scxd_initmode);
+    FP_I(scxd_ExLimit);     FP_I(scxd_cfactor);     FP_I(scxd_skin);
+    FP_I(scxd_edge);        FP_I(scxd_Np);          FP_I(scxd_lcorr);
+    FP_F(scxd_k);
+    FP_F(scxd_h1);   FP_F(scxd_h2);   FP_F(scxd_h3);   FP_F(scxd_h4);
+    FP_F(scxd_xi1);  FP_F(scxd_xf1);  FP_F(scxd_xi2);  FP_F(scxd_xf2);
+    FP_F(scxd_xi3);  FP_F(scxd_xf3);  FP_F(scxd_xi4);  FP_F(scxd_xf4);
+    FP_F(scxd_bi1);  FP_F(scxd_bf1);  FP_F(scxd_bi2);  FP_F(scxd_bf2);
+    FP_F(scxd_bi3);  FP_F(scxd_bf3);  FP_F(scxd_bi4);  FP_F(scxd_bf4);
+    FP_F(scxd_x01);  FP_F(scxd_x02);  FP_F(scxd_x03);  FP_F(scxd_x04);
+    FP_F(scxd_a1);   FP_F(scxd_a2);   FP_F(scxd_a3);   FP_F(scxd_a4);
+    FP_F(scxd_p1);   FP_F(scxd_p2);   FP_F(scxd_p3);   FP_F(scxd_p4);
+    FP_F(scxd_hb);   FP_F(scxd_m);
+    FP_F(scxd_TolH); FP_F(scxd_TolL); FP_F(scxd_TolHd); FP_F(scxd_TolLd);
+    FP_F(scxd_ExReduce);  FP_F(scxd_AutoGridThreshold);
+    FP_F(scxd_w);    FP_F(scxd_V0);   FP_F(scxd_ek2v); FP_F(scxd_alpha);
+    FP_F(scxd_k0);   FP_F(scxd_sig);  FP_F(scxd_lan);  FP_F(scxd_De);
+    FP_F(scxd_Da);   FP_F(scxd_r0);   FP_F(scxd_lambda);  FP_F(scxd_sigma);
+    FP_F(scxd_beta); FP_F(scxd_dk);   FP_F(scxd_kmax);
+    FP_F(scxd_kb);   FP_F(scxd_temp); FP_F(scxd_gamma);   FP_F(scxd_latconst);
+    FP_F(scxd_chempotl);  FP_F(scxd_chempotr);  FP_F(scxd_chempotbarr);  FP_F(scxd_biasvol);
+    FP_F(scxd_charge);    FP_F(scxd_permittivity);  FP_F(scxd_potl);  FP_F(scxd_potr);
+    FP_F(scxd_omega);     FP_F(scxd_trans_x0);      FP_F(scxd_quantumness);
+
+    // Parareal stops at a tolerance, so its settings change the result
+    FP_I(scxd_pslices);
+
+    if ( scxd_pslices > 1 )  {
+        FP_I(scxd_piters);  FP_I(scxd_pcoarse);  FP_F(scxd_ptol);
+    }
+
+    // The automatic box replaces the user box by a derived one
+    if ( scxd_isAutoBox )  {
+        FP_I(scxd_isAutoBox);  FP_F(scxd_AutoBoxTol);
+    }
 
+    // The DG discretization replaces the finite differences
+    if ( scxd_dgratio > 1 )  {
+        FP_I(scxd_dgratio);  FP_I(scxd_dgorder);  FP_F(scxd_dgcfl);
+    }
+
+    // A declared symmetry is enforced rather than checked
+    if ( scxd_symmetry > 0 )
+        FP_I(scxd_symmetry);
+
+    if ( isWithTf )
+        FP_F(scxd_Tf);
+
+#undef FP_I
+#undef FP_F
+
+    return s;
+}
+/* ------------------------------------------------------------------------------- */
@@ -36,6 +36,7 @@ namespace QTR_NS   {
         
         int      load(string filename);
         int      load(FILE *file);
+        string   Fingerprint(bool isWithTf);
         
         // MAIN //
         string   job;
@@ -57,6 +58,10 @@ namespace QTR_NS   {
         // SCATTERXD //
         int      scxd_dimensions;
         bool     scxd_isFullGrid;
+        bool     scxd_isAutoGrid;
+        bool     scxd_isAutoBox;
+        bool     scxd_isAdaptiveThreads;
+        bool     scxd_isCacheState;
         bool     scxd_isTrans;
         bool     scxd_isAcf;
         bool     scxd_isDensityMatrix;
@@ -69,6 +74,7 @@ namespace QTR_NS   {
         bool     scxd_isPrintWavefunc;
         bool     scxd_isIsothermal;
         bool     scxd_isLinearizedCollision;
+        bool     scxd_isDeltaF;  // evolve f - f_M, f_M the initial density times the Maxwellian
         bool     scxd_isModCL;
         bool     scxd_isDampX1;
         bool     scxd_isDampX2;
@@ -77,8 +83,17 @@ namespace QTR_NS   {
         int      scxd_Vmode_3; 
         int      scxd_Vmode_4;    
         int      scxd_period;
+        int      scxd_autogridperiod;
+        int      scxd_initmode;
+        int      scxd_pslices;   // Parareal time slices, 0 to disable
+        int      scxd_piters;
+        int      scxd_pcoarse;   // fine steps per coarse step
+        int      scxd_symmetry;  // 0 = none, 1 = detect parity, 2 = declared parity
+        int      scxd_dgratio;   // grid points per DG element side, 0 to disable
+        int      scxd_dgorder;   // DG degree per direction, 1 or 2 (P2 at dgratio 3 keeps KEP Trans within 1% of FD)
         int      scxd_sortperiod;
         int      scxd_printperiod;
+        int      scxd_telemetryperiod;     // truncation telemetry period, 0 if disabled
         int      scxd_printwavefuncperiod;
         int      scxd_ExLimit;
         int      scxd_cfactor;
@@ -127,6 +142,10 @@ namespace QTR_NS   {
         double     scxd_TolHd;
         double     scxd_TolLd;
         double     scxd_ExReduce;
+        double     scxd_AutoGridThreshold;
+        double     scxd_AutoBoxTol;  // tail tolerance of the automatic box
+        double     scxd_ptol;
+        double     scxd_dgcfl;
         double     scxd_w;  // HO specific
         double     scxd_V0; // Eckart potential 
         double     scxd_ek2v;
@@ -157,6 +176,9 @@ namespace QTR_NS   {
         double     scxd_omega;  // phase
         double     scxd_trans_x0;
         double     scxd_quantumness;
+        string     scxd_cachedir;  // result cache directory, empty to disable
+        string     scxd_timinglog; // file of the per-region timing lines, empty for the log
+        bool       scxd_energy;    // RAPL energy summary of the time iteration
         
         // RANDOM //
         string     rngType;
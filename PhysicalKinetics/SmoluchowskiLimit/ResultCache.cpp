@@ -0,0 +1,252 @@
+// ==============================================================================
+//
+//  ResultCache.cpp
+//  QTR
+//
+//  Note: Entries are written to a temporary file and renamed into place, so
+//        concurrent runs of a sweep never see a partial entry. A saved state
+//        comes with the records up to its step (.hist), tagged with that
+//        step so a state and a history from different runs never pair up.
+//
+// ==============================================================================
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "ResultCache.h"
+
+using namespace QTR_NS;
+using std::string;
+
+#define CACHE_MAGIC 0x51545246  // "QTRF"
+
+/* ------------------------------------------------------------------------------- */
+
+ResultCache::ResultCache()
+{
+    dir = "";
+    key = "";
+    warmkey = "";
+}
+/* ------------------------------------------------------------------------------- */
+
+ResultCache::~ResultCache()
+{
+    return;
+}
+/* ------------------------------------------------------------------------------- */
+
+void ResultCache::open(string dir_in, string key_in, string warmkey_in)
+{
+    dir = dir_in;
+    key = key_in;
+    warmkey = warmkey_in;
+    Records.clear();
+}
+/* ------------------------------------------------------------------------------- */
+
+bool ResultCache::isEnabled()
+{
+    return dir.length() > 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+bool ResultCache::load()
+{
+    if ( !isEnabled() )
+        return false;
+
+    Records.clear();
+
+    return ReadRecords(dir + "/" + key + ".res", -1);
+}
+/* ------------------------------------------------------------------------------- */
+
+void ResultCache::record(const char *name, double time, double value)
+{
+    Record rec;
+
+    if ( !isEnabled() )
+        return;
+
+    rec.name = name;
+    rec.time = time;
+    rec.value = value;
+    Records.push_back(rec);
+}
+/* ------------------------------------------------------------------------------- */
+
+int ResultCache::save()
+{
+    if ( !isEnabled() )
+        return 0;
+
+    return WriteRecords(dir + "/" + key + ".res", -1);
+}
+/* ------------------------------------------------------------------------------- */
+
+bool ResultCache::loadState(int steps_max, int n1, int n2, int &steps, double *F)
+{
+    FILE *fh;
+    int header[4];
+    size_t n = (size_t) n1 * n2;
+    bool ok;
+
+    if ( !isEnabled() )
+        return false;
+
+    fh = fopen((dir + "/" + warmkey + ".state").c_str(), "rb");
+
+    if (fh == NULL)
+        return false;
+
+    ok = fread(header, sizeof(int), 4, fh) == 4 &&
+         header[0] == CACHE_MAGIC && header[1] == n1 && header[2] == n2 &&
+         header[3] > 0 && header[3] <= steps_max;
+
+    // Read into a buffer so a truncated file leaves F untouched
+    if ( ok )  {
+        std::vector<double> buf(n);
+        ok = fread(buf.data(), sizeof(double), n, fh) == n;
+        if ( ok )  {
+            memcpy(F, buf.data(), n * sizeof(double));
+            steps = header[3];
+        }
+    }
+    fclose(fh);
+
+    // Records of the run that left the state, ahead of the ones still to come
+    if ( ok )  {
+        std::vector<Record> later;
+        later.swap(Records);
+        ReadRecords(dir + "/" + warmkey + ".hist", steps);
+        Records.insert(Records.end(), later.begin(), later.end());
+    }
+
+    return ok;
+}
+/* ------------------------------------------------------------------------------- */
+
+int ResultCache::saveState(int steps, int n1, int n2, const double *F)
+{
+    FILE *fh;
+    int header[4];
+    size_t n = (size_t) n1 * n2;
+    string path = dir + "/" + warmkey + ".state";
+    string tmp = path + ".tmp" + std::to_string(getpid());
+    bool ok;
+
+    if ( !isEnabled() )
+        return 0;
+
+    // Keep the state that reaches furthest in time
+    fh = fopen(path.c_str(), "rb");
+
+    if (fh != NULL)  {
+        ok = fread(header, sizeof(int), 4, fh) == 4 && header[0] == CACHE_MAGIC && header[3] >= steps;
+        fclose(fh);
+        if ( ok )
+            return 0;
+    }
+
+    fh = fopen(tmp.c_str(), "wb");
+
+    if (fh == NULL)
+        return 1;
+
+    header[0] = CACHE_MAGIC;
+    header[1] = n1;
+    header[2] = n2;
+    header[3] = steps;
+    ok = fwrite(header, sizeof(int), 4, fh) == 4 && fwrite(F, sizeof(double), n, fh) == n;
+    fclose(fh);
+
+    if ( !ok )  {
+        remove(tmp.c_str());
+        return 1;
+    }
+
+    if ( WriteRecords(dir + "/" + warmkey + ".hist", steps) )  {
+        remove(tmp.c_str());
+        return 1;
+    }
+
+    return rename(tmp.c_str(), path.c_str()) != 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+bool ResultCache::ReadRecords(string path, int steps)
+{
+    FILE *fh;
+    char line[256];
+    char name[64];
+    int tag;
+    Record rec;
+
+    fh = fopen(path.c_str(), "r");
+
+    if (fh == NULL)
+        return false;
+
+    // A history belongs to the state saved at the same step
+    if ( steps >= 0 && ( fgets(line, sizeof(line), fh) == NULL ||
+                         sscanf(line, "# steps %d", &tag) != 1 || tag != steps ) )  {
+        fclose(fh);
+        return false;
+    }
+
+    while ( fgets(line, sizeof(line), fh) != NULL )  {
+        if ( line[0] == '#' )
+            continue;
+        if ( sscanf(line, "%63s %lf %lf", name, &rec.time, &rec.value) == 3 )  {
+            rec.name = name;
+            Records.push_back(rec);
+        }
+    }
+    fclose(fh);
+
+    return true;
+}
+/* ------------------------------------------------------------------------------- */
+
+int ResultCache::WriteRecords(string path, int steps)
+{
+    FILE *fh;
+    string tmp = path + ".tmp" + std::to_string(getpid());
+
+    fh = fopen(tmp.c_str(), "w");
+
+    if (fh == NULL)
+        return 1;
+
+    if ( steps >= 0 )
+        fprintf(fh, "# steps %d\n", steps);
+
+    fprintf(fh, "# key %s\n", key.c_str());
+
+    for (unsigned int i = 0; i < Records.size(); i ++)
+        fprintf(fh, "%s %.16e %.16e\n", Records[i].name.c_str(), Records[i].time, Records[i].value);
+
+    fclose(fh);
+
+    return rename(tmp.c_str(), path.c_str()) != 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+string ResultCache::Hash(string s)
+{
+    // 64-bit FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    char buf[17];
+
+    for (string::size_type i = 0; i < s.length(); i ++)  {
+        h ^= (unsigned char) s[i];
+        h *= 1099511628211ULL;
+    }
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) h);
+
+    return string(buf);
+}
+/* ------------------------------------------------------------------------------- */
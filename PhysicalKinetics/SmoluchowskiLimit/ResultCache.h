@@ -0,0 +1,62 @@
+// ==============================================================================
+//
+//  ResultCache.h
+//  QTR
+//
+//  Note: Content-addressed store of finished runs. A run is keyed by the
+//        fingerprint of its effective Parameters and the build identity.
+//        An exact match returns the recorded observables; a match that
+//        differs only in Tf provides the saved F as a warm start.
+//
+// ==============================================================================
+
+#ifndef QTR_RESULTCACHE_H
+#define QTR_RESULTCACHE_H
+
+#include <string>
+#include <vector>
+
+using std::string;
+
+namespace QTR_NS {
+
+    class ResultCache {
+
+    public:
+        ResultCache();
+        ~ResultCache();
+
+        struct Record {
+            string      name;
+            double      time;
+            double      value;
+        };
+
+        void            open(string dir, string key, string warmkey);
+        bool            isEnabled();
+
+        // Observables of an identical run
+        bool            load();
+        void            record(const char *name, double time, double value);
+        int             save();
+
+        // Final state of a run with the same key but a different Tf, with
+        // the records that led up to it
+        bool            loadState(int steps_max, int n1, int n2, int &steps, double *F);
+        int             saveState(int steps, int n1, int n2, const double *F);
+
+        std::vector<Record> Records;
+
+        static string   Hash(string s);
+
+    private:
+        bool            ReadRecords(string path, int steps);   // steps < 0: no step tag
+        int             WriteRecords(string path, int steps);
+
+        string          dir;
+        string          key;
+        string          warmkey;
+    };
+}
+
+#endif /* QTR_RESULTCACHE_H */
@@ -0,0 +1,167 @@
+// ==============================================================================
+//
+//  TimingLog.cpp
+//  QTR
+//
+//  Note: Records carry a global sequence number taken just before they are
+//        published, so the drain merges the rings by it. A missing number
+//        is a record still being written; the drain stops there and picks
+//        it up on the next pass.
+//
+// ==============================================================================
+
+#include <chrono>
+
+#include "Log.h"
+#include "TimingLog.h"
+
+using namespace QTR_NS;
+using std::string;
+
+/* ------------------------------------------------------------------------------- */
+
+TimingLog::TimingLog()
+{
+    out = NULL;
+    fp = NULL;
+    rings = NULL;
+    nrings = 0;
+    capacity = 0;
+    next = 0;
+    seq.store(0);
+    overflow.store(0);
+    running.store(false);
+}
+/* ------------------------------------------------------------------------------- */
+
+TimingLog::~TimingLog()
+{
+    close();
+}
+/* ------------------------------------------------------------------------------- */
+
+void TimingLog::open(Log *log_in, string path, int threads, int capacity_in)
+{
+    close();
+
+    out = log_in;
+    nrings = threads > 0 ? threads : 1;
+    capacity = 1;
+
+    while ( capacity < capacity_in )
+        capacity *= 2;
+
+    rings = new Ring[nrings];
+
+    for (int t = 0; t < nrings; t ++)  {
+        rings[t].head.store(0);
+        rings[t].tail.store(0);
+        rings[t].dropped = 0;
+        rings[t].buf = new Record[capacity];
+    }
+    next = 0;
+    seq.store(0);
+    overflow.store(0);
+
+    if ( path.length() > 0 )  {
+        fp = fopen(path.c_str(), "w");
+        if ( fp == NULL )
+            out->log("[TimingLog] Cannot open %s, timing lines go to the log\n", path.c_str());
+    }
+
+    if ( fp != NULL )  {
+        running.store(true, std::memory_order_release);
+        writer = std::thread(&TimingLog::Writer, this);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+bool TimingLog::isEnabled()
+{
+    return rings != NULL;
+}
+/* ------------------------------------------------------------------------------- */
+
+void TimingLog::flush()
+{
+    if ( rings != NULL && fp == NULL )
+        Drain();
+}
+/* ------------------------------------------------------------------------------- */
+
+void TimingLog::close()
+{
+    uint64_t dropped;
+
+    if ( rings == NULL )
+        return;
+
+    if ( writer.joinable() )  {
+        running.store(false, std::memory_order_release);
+        writer.join();
+    }
+    Drain();
+
+    dropped = overflow.load();
+
+    for (int t = 0; t < nrings; t ++)  {
+        dropped += rings[t].dropped;
+        delete [] rings[t].buf;
+    }
+    delete [] rings;
+    rings = NULL;
+
+    if ( fp != NULL )  {
+        fclose(fp);
+        fp = NULL;
+    }
+
+    if ( dropped > 0 )
+        out->log("[TimingLog] %llu timing lines dropped, rings full\n", (unsigned long long) dropped);
+}
+/* ------------------------------------------------------------------------------- */
+
+int TimingLog::Drain()
+{
+    char line[LINE_LEN];
+    uint64_t tail = 0;
+    int lines = 0;
+    int t;
+
+    for (;;)  {
+
+        // Ring whose oldest record is the next in sequence
+        for (t = 0; t < nrings; t ++)  {
+            tail = rings[t].tail.load(std::memory_order_relaxed);
+            if ( tail < rings[t].head.load(std::memory_order_acquire) &&
+                 rings[t].buf[tail & (capacity - 1)].seq == next )
+                break;
+        }
+        if ( t == nrings )
+            break;
+
+        Record &rec = rings[t].buf[tail & (capacity - 1)];
+        rec.format(line, rec.fmt, rec.args);
+
+        if ( fp != NULL )
+            fputs(line, fp);
+        else
+            out->log("%s", line);
+
+        rings[t].tail.store(tail + 1, std::memory_order_release);
+        next ++;
+        lines ++;
+    }
+    return lines;
+}
+/* ------------------------------------------------------------------------------- */
+
+void TimingLog::Writer()
+{
+    while ( running.load(std::memory_order_acquire) )  {
+        if ( Drain() > 0 )
+            fflush(fp);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+/* ------------------------------------------------------------------------------- */
@@ -0,0 +1,234 @@
+// ==============================================================================
+//
+//  MomentRing.cpp
+//  QTR
+//
+//  Note: The producer never waits on readers. A reader that is lapped while
+//        copying a slot sees the counter change and retries on a newer one.
+//
+// ==============================================================================
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "MomentRing.h"
+
+using namespace QTR_NS;
+using std::string;
+
+#define RING_MAGIC   0x5154524d  // "QTRM"
+#define RING_VERSION 1
+
+/* ------------------------------------------------------------------------------- */
+
+MomentRing::MomentRing()
+{
+    name = "";
+    hdr = NULL;
+    bytes = 0;
+    owner = false;
+}
+/* ------------------------------------------------------------------------------- */
+
+MomentRing::~MomentRing()
+{
+    close();
+}
+/* ------------------------------------------------------------------------------- */
+
+int MomentRing::create(string name_in, int npoints, int nfields, const char **names,
+                       int slots, double x0, double h)
+{
+    size_t slotbytes;
+    void *p;
+    int fd;
+
+    if ( name_in.length() == 0 || nfields < 1 || nfields > MAX_FIELDS || slots < 2 )
+        return 1;
+
+    if ( name_in[0] != '/' )
+        name_in = "/" + name_in;
+
+    // Keep every slot 64-byte aligned so the counters do not share cache lines
+    slotbytes = offsetof(Slot, data) + (size_t) nfields * npoints * sizeof(double);
+    slotbytes = (slotbytes + 63) & ~(size_t) 63;
+    bytes = ((sizeof(Header) + 63) & ~(size_t) 63) + slots * slotbytes;
+
+    fd = shm_open(name_in.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return 1;
+
+    if ( ftruncate(fd, (off_t) bytes) != 0 )  {
+        ::close(fd);
+        shm_unlink(name_in.c_str());
+        return 1;
+    }
+
+    p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)  {
+        shm_unlink(name_in.c_str());
+        return 1;
+    }
+
+    name = name_in;
+    owner = true;
+    hdr = (Header *) p;
+    hdr->version = RING_VERSION;
+    hdr->nfields = nfields;
+    hdr->npoints = npoints;
+    hdr->slots = slots;
+    hdr->slotbytes = (int32_t) slotbytes;
+    hdr->x0 = x0;
+    hdr->h = h;
+
+    for (int k = 0; k < nfields; k ++)
+        strncpy(hdr->names[k], names[k], NAME_LEN - 1);
+
+    hdr->head.store(0, std::memory_order_relaxed);
+
+    for (int s = 0; s < slots; s ++)
+        slot(s)->seq.store(0, std::memory_order_relaxed);
+
+    // Readers ignore the segment until the magic is set
+    std::atomic_thread_fence(std::memory_order_release);
+    hdr->magic = RING_MAGIC;
+
+    return 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+void MomentRing::publish(int step, double time, const double **fields)
+{
+    uint64_t n;
+    uint64_t seq;
+    Slot *s;
+    int np;
+
+    if ( hdr == NULL || !owner )
+        return;
+
+    n = hdr->head.load(std::memory_order_relaxed);
+    s = slot(n);
+    np = hdr->npoints;
+    seq = s->seq.load(std::memory_order_relaxed);
+
+    s->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s->step = step;
+    s->time = time;
+
+    for (int k = 0; k < hdr->nfields; k ++)
+        memcpy(s->data + (size_t) k * np, fields[k], np * sizeof(double));
+
+    s->seq.store(seq + 2, std::memory_order_release);
+    hdr->head.store(n + 1, std::memory_order_release);
+}
+/* ------------------------------------------------------------------------------- */
+
+int MomentRing::attach(string name_in)
+{
+    Header h0;
+    void *p;
+    int fd;
+
+    if ( name_in.length() == 0 )
+        return 1;
+
+    if ( name_in[0] != '/' )
+        name_in = "/" + name_in;
+
+    fd = shm_open(name_in.c_str(), O_RDONLY, 0);
+
+    if (fd < 0)
+        return 1;
+
+    if ( read(fd, &h0, offsetof(Header, head)) != (ssize_t) offsetof(Header, head) ||
+         h0.magic != RING_MAGIC || h0.version != RING_VERSION )  {
+        ::close(fd);
+        return 1;
+    }
+
+    bytes = ((sizeof(Header) + 63) & ~(size_t) 63) + (size_t) h0.slots * h0.slotbytes;
+    p = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (p == MAP_FAILED)
+        return 1;
+
+    name = name_in;
+    owner = false;
+    hdr = (Header *) p;
+
+    return 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+bool MomentRing::latest(int64_t &step, double &time, double *out)
+{
+    uint64_t n;
+    uint64_t s1;
+    uint64_t s2;
+    Slot *s;
+
+    if ( hdr == NULL )
+        return false;
+
+    for (int attempt = 0; attempt < 64; attempt ++)  {
+        n = hdr->head.load(std::memory_order_acquire);
+
+        if ( n == 0 )
+            return false;
+
+        s = slot(n - 1);
+        s1 = s->seq.load(std::memory_order_acquire);
+
+        if ( s1 & 1 )
+            continue;
+
+        step = s->step;
+        time = s->time;
+        memcpy(out, s->data, (size_t) hdr->nfields * hdr->npoints * sizeof(double));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        s2 = s->seq.load(std::memory_order_relaxed);
+
+        if ( s1 == s2 )
+            return true;
+    }
+
+    return false;
+}
+/* ------------------------------------------------------------------------------- */
+
+bool MomentRing::isEnabled()
+{
+    return hdr != NULL;
+}
+/* ------------------------------------------------------------------------------- */
+
+void MomentRing::close()
+{
+    if ( hdr == NULL )
+        return;
+
+    munmap(hdr, bytes);
+    hdr = NULL;
+
+    if ( owner )
+        shm_unlink(name.c_str());
+}
+/* ------------------------------------------------------------------------------- */
+
+MomentRing::Slot *MomentRing::slot(uint64_t n)
+{
+    char *base = (char *) hdr + ((sizeof(Header) + 63) & ~(size_t) 63);
+
+    return (Slot *) (base + (size_t) (n % hdr->slots) * hdr->slotbytes);
+}
+/* ------------------------------------------------------------------------------- */
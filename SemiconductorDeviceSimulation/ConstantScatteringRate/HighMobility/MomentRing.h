@@ -0,0 +1,81 @@
+// ==============================================================================
+//
+//  MomentRing.h
+//  QTR
+//
+//  Note: Ring of moment snapshots (Density, Velocity, ...) in POSIX shared
+//        memory, for local consumers that want the latest profiles without
+//        parsing density.dat. One producer, any number of readers, no locks:
+//        each slot carries a sequence counter that is odd while the slot is
+//        being written (seqlock). A reader reads the counter, the slot, then
+//        the counter again, and keeps the slot only if both reads are equal
+//        and even. Readers may work on the mapped slot in place.
+//
+//        Layout: Header | Slot 0 | ... | Slot (slots-1), with
+//        Slot = { seq, step, time, data[nfields][npoints] }.
+//
+// ==============================================================================
+
+#ifndef QTR_MOMENTRING_H
+#define QTR_MOMENTRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+using std::string;
+
+namespace QTR_NS {
+
+    class MomentRing {
+
+    public:
+        MomentRing();
+        ~MomentRing();
+
+        enum { MAX_FIELDS = 8, NAME_LEN = 16 };
+
+        struct Header {
+            uint32_t              magic;
+            uint32_t              version;
+            int32_t               nfields;
+            int32_t               npoints;
+            int32_t               slots;
+            int32_t               slotbytes;
+            double                x0;          // coordinate of the first point
+            double                h;           // grid spacing
+            char                  names[MAX_FIELDS][NAME_LEN];
+            std::atomic<uint64_t> head;        // number of snapshots published
+        };
+
+        struct Slot {
+            std::atomic<uint64_t> seq;
+            int64_t               step;
+            double                time;
+            double                data[1];     // nfields * npoints
+        };
+
+        // Producer
+        int             create(string name, int npoints, int nfields, const char **names,
+                               int slots, double x0, double h);
+        void            publish(int step, double time, const double **fields);
+
+        // Consumer
+        int             attach(string name);
+        bool            latest(int64_t &step, double &time, double *out);
+
+        bool            isEnabled();
+        void            close();
+
+    private:
+        Slot            *slot(uint64_t n);
+
+        string          name;
+        Header          *hdr;
+        size_t          bytes;
+        bool            owner;
+    };
+}
+
+#endif /* QTR_MOMENTRING_H */
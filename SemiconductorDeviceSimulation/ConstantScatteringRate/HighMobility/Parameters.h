@@ -57,6 +57,8 @@ namespace QTR_NS   {
         // SCATTERXD //
         int      scxd_dimensions;
         bool     scxd_isFullGrid;
+        bool     scxd_isAutoGrid;
+        bool     scxd_isAutoBox;
         bool     scxd_isTrans;
         bool     scxd_isAcf;
         bool     scxd_isDensityMatrix;
@@ -71,6 +73,7 @@ namespace QTR_NS   {
         bool     scxd_isPrintWavefunc;
         bool     scxd_isIsothermal;
         bool     scxd_isLinearizedCollision;
+        bool     scxd_isDeltaF;  // evolve f - f_M, f_M the doping times the Maxwellian
         bool     scxd_isModCL;
         bool     scxd_isDampX1;
         bool     scxd_isDampX2;
@@ -79,8 +82,13 @@ namespace QTR_NS   {
         int      scxd_Vmode_3; 
         int      scxd_Vmode_4;    
         int      scxd_period;
+        int      scxd_autogridperiod;
+        int      scxd_oocslab;
+        int      scxd_shmperiod;
+        int      scxd_shmslots;
         int      scxd_sortperiod;
         int      scxd_printperiod;
+        int      scxd_telemetryperiod;     // truncation telemetry period, 0 if disabled
         int      scxd_printwavefuncperiod;
         int      scxd_ExLimit;
         int      scxd_cfactor;
@@ -129,6 +137,8 @@ namespace QTR_NS   {
         double     scxd_TolHd;
         double     scxd_TolLd;
         double     scxd_ExReduce;
+        double     scxd_AutoGridThreshold;
+        double     scxd_AutoBoxTol;  // tail tolerance of the automatic box
         double     scxd_w;  // HO specific
         double     scxd_V0; // Eckart potential 
         double     scxd_ek2v;
@@ -165,6 +175,11 @@ namespace QTR_NS   {
         double     scxd_omega;  // phase
         double     scxd_trans_x0;
         double     scxd_quantumness;
+        string     scxd_oocdir;  // out-of-core scratch directory, empty to disable
+        string     scxd_shmname; // shared-memory moment ring, empty to disable
+        string     scxd_kernelisa; // stage kernel ISA: auto, avx512, avx2, sse4.2 or base
+        string     scxd_timinglog; // file of the per-region timing lines, empty for the log
+        bool       scxd_energy;    // RAPL energy summary of the time iteration
         
         // RANDOM //
         string     rngType;
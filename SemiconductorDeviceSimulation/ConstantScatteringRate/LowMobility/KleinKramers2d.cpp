@@ -24,9 +24,13 @@
 
 #include "Constants.h"
 #include "Containers.h"
+#include "EnergyMeter.h"
 #include "Error.h"
 #include "Log.h"
+#include "MomentRing.h"
+#include "OutOfCore.h"
 #include "Parameters.h"
+#include "TimingLog.h"
 #include "KleinKramers2d.h"
 
 using namespace QTR_NS;
@@ -103,10 +107,13 @@ void KleinKramers2d::init()
     PERIOD = parameters->scxd_period;
     SORT_PERIOD = parameters->scxd_sortperiod;
     PRINT_PERIOD = parameters->scxd_printperiod;
+    TELEMETRY_PERIOD = parameters->scxd_telemetryperiod;
     PRINT_WAVEFUNC_PERIOD = parameters->scxd_printwavefuncperiod;
     TIME = parameters->scxd_Tf;
     QUIET = parameters->quiet;
     TIMING = parameters->timing;
+    TIMING_LOG = parameters->scxd_timinglog;
+    ENERGY = parameters->scxd_energy;
     isTrans = parameters->scxd_isTrans;
     isCorr = parameters->scxd_isAcf;
     isPrintEdge = parameters->scxd_isPrintEdge;
@@ -123,6 +130,8 @@ void KleinKramers2d::init()
     log->log("[KleinKramers2d] DIMENSIONS: %d\n", DIMENSIONS);
     log->log("[KleinKramers2d] EDGE: %d\n", EDGE);
 
+    SelectKernelISA(parameters->scxd_kernelisa);
+
     // Grid size
     H.resize(DIMENSIONS);
     S.resize(DIMENSIONS);  
@@ -146,6 +155,12 @@ void KleinKramers2d::init()
     Box[3] = parameters->scxd_xf2; 
     BoxShape.resize(DIMENSIONS);
 
+    isAutoBox = parameters->scxd_isAutoBox;
+    AutoBoxTol = parameters->scxd_AutoBoxTol;
+
+    if ( isAutoBox )
+        AutoBox();
+
     GRIDS_TOT = 1;
     log->log("[KleinKramers2d] Number of grids = (");
 
@@ -162,6 +177,11 @@ void KleinKramers2d::init()
     W1 = BoxShape[1];
     O1 = BoxShape[0] * BoxShape[1];
 
+    // The x-upwind direction flips at the first non-negative momentum
+    IDX_P0 = 0;
+    while ( IDX_P0 < BoxShape[1] && Box[2] + IDX_P0 * H[1] < 0.0 )
+        IDX_P0 ++;
+
     // Parameters
     hb = parameters->scxd_hb;
     m  = parameters->scxd_m;
@@ -197,6 +217,14 @@ void KleinKramers2d::init()
 
     // Truncate parameters
     isFullGrid = parameters->scxd_isFullGrid;
+    isAutoGrid = parameters->scxd_isAutoGrid;
+    AUTO_GRID_PERIOD = parameters->scxd_autogridperiod;
+    OOC_DIR = parameters->scxd_oocdir;
+    OOC_SLAB = parameters->scxd_oocslab;
+    SHM_NAME = parameters->scxd_shmname;
+    SHM_PERIOD = parameters->scxd_shmperiod;
+    SHM_SLOTS = parameters->scxd_shmslots;
+    AutoGridThreshold = parameters->scxd_AutoGridThreshold; // Relative predicted gain required to switch
     TolH = parameters->scxd_TolH;    // Tolerance of probability density for Zero point Cutoff
     TolL = parameters->scxd_TolL;    // Tolerance of probability density for Edge point
     TolHd = parameters->scxd_TolHd;  // Tolerance of probability first diff for Zero point Cutoff
@@ -209,6 +237,17 @@ void KleinKramers2d::init()
     idx_x0 = (int) std::round( ( trans_x0 - Box[0] ) / H[0] );
 
     log->log("[KleinKramers2d] isFullGrid: %d\n", (int)isFullGrid);
+    log->log("[KleinKramers2d] isAutoGrid: %d\n", (int)isAutoGrid);
+    if ( isAutoGrid )  {
+        log->log("[KleinKramers2d] AUTO_GRID_PERIOD: %d\n", AUTO_GRID_PERIOD);
+        log->log("[KleinKramers2d] AutoGridThreshold: %lf\n", AutoGridThreshold);
+    }
+
+    // Delta-f about the initial Maxwellian, the tolerances then apply to |g|
+    isDeltaF = parameters->scxd_isDeltaF;
+
+    if ( isDeltaF )
+        log->log("[KleinKramers2d] isDeltaF: %d\n", (int)isDeltaF);
     log->log("[KleinKramers2d] TolH: %e\n", TolH);
     log->log("[KleinKramers2d] TolL: %e\n", TolL);
     log->log("[KleinKramers2d] TolHd: %e\n", TolHd);
@@ -217,16 +256,87 @@ void KleinKramers2d::init()
     log->log("[KleinKramers2d] ExLimit: %d\n", ExLimit);
     log->log("[KleinKramers2d] trans_x0: %d\n", trans_x0);
     log->log("[KleinKramers2d] idx_x0: %d\n", idx_x0);
+    if ( OOC_DIR.length() > 0 && ( !isFullGrid || isAutoGrid ) )  {
+        log->log("[KleinKramers2d] Out-of-core streaming needs a fixed full grid, arrays stay in memory\n");
+        OOC_DIR = "";
+    }
+    else if ( OOC_DIR.length() > 0 )
+        log->log("[KleinKramers2d] Out-of-core directory: %s, slab = %d rows\n", OOC_DIR.c_str(), OOC_SLAB);
+    if ( SHM_NAME.length() > 0 )
+        log->log("[KleinKramers2d] Moment ring: %s, period = %d, slots = %d\n", SHM_NAME.c_str(), SHM_PERIOD, SHM_SLOTS);
+
     log->log("[KleinKramers2d] INIT done.\n\n");
 }
 /* ------------------------------------------------------------------------------- */
 
+void KleinKramers2d::AutoBox()
+{
+    // x1 is the device and keeps the user range. In x2 the carriers reach
+    // the thermal tail down to AutoBoxTol plus the energy of the full bias
+    // drop, which bounds what the field can add between two collisions.
+    double lnt = std::log(1.0 / AutoBoxTol);
+    double user[4] = {Box[0], Box[1], Box[2], Box[3]};
+    double eacc, pmax;
+
+    eacc = parameters->scxd_kb * parameters->scxd_temp * lnt +
+           parameters->scxd_charge * std::abs(parameters->scxd_potr - parameters->scxd_potl);
+    pmax = std::sqrt(2.0 * parameters->scxd_m * eacc);
+    SnapBox(1, -pmax, pmax);
+
+    log->log("[KleinKramers2d] Auto box: reachable energy %e\n", eacc);
+    log->log("[KleinKramers2d] Auto box: x2 [%lf, %lf] of [%lf, %lf]\n", Box[2], Box[3], user[2], user[3]);
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::SnapBox(int dim, double lo, double hi)
+{
+    // Widen [lo, hi] by the edge cells and round it outward to points of the
+    // user grid, clipped to the user box. A box centred on 0 stays centred,
+    // so a parity-symmetric problem keeps a mirrored grid.
+    double b0 = Box[2 * dim];
+    double h = H[dim];
+    int n = (int)std::round((Box[2 * dim + 1] - b0) / h);
+    bool isCentred = std::abs(Box[2 * dim] + Box[2 * dim + 1]) < 0.5 * h;
+    int j0, j1;
+
+    if ( isCentred )  {
+        hi = std::max(std::abs(lo), std::abs(hi));
+        lo = -hi;
+    }
+    lo -= (EDGE + 1) * h;
+    hi += (EDGE + 1) * h;
+
+    j1 = std::min(n, (int)std::ceil((hi - b0) / h));
+    j0 = isCentred ? n - j1 : std::max(0, (int)std::floor((lo - b0) / h));
+
+    if ( j1 - j0 < 2 * EDGE + 2 )
+        return;
+
+    Box[2 * dim] = b0 + j0 * h;
+    Box[2 * dim + 1] = b0 + j1 * h;
+}
+/* ------------------------------------------------------------------------------- */
+
 void KleinKramers2d::Evolve()
 {
     #pragma omp declare reduction (merge : MeshIndex : omp_out.insert(omp_out.end(), omp_in.begin(), omp_in.end()))
 
     log->log("[KleinKramers2d] Evolve starts ...\n");
 
+    // RAPL package and DRAM energy, read around the initialization, the
+    // time iteration and each PERIOD
+    EnergyMeter meter;
+    double energy_iter = 0.0;
+    double energy_period = 0.0;
+    double cell_updates = 0.0;
+
+    if ( ENERGY )  {
+        if ( meter.open() > 0 )
+            log->log("[KleinKramers2d] Energy counters: %s\n", meter.zones().c_str());
+        else
+            log->log("[KleinKramers2d] Energy counters unavailable, no energy report\n");
+    }
+
     // Files
     FILE *pfile;
     FILE *pfile_density;
@@ -276,6 +386,20 @@ void KleinKramers2d::Evolve()
     // Overhead time (truncate)
     double t_overhead = 0.0;
 
+    // Automatic grid switching (accumulated over AUTO_GRID_PERIOD steps)
+    int auto_steps = 0;
+    int ta_est;
+    int n_interior = (BoxShape[0] - 2 * EDGE) * (BoxShape[1] - 2 * EDGE);
+    double auto_points = 0.0;  // sum of active grid points per step
+    double core_points = 0.0;  // sum of active grid points per moment and RK4 update
+    double norm_points = 0.0;  // sum of active grid points per normalization
+    double t_auto_begin;
+    double t_auto_step = 0.0;
+    double t_auto_core = 0.0;
+    double t_auto_norm = 0.0;
+    double t_auto_ovh = -1.0;  // TG overhead per TA point, < 0 if not measured yet
+    double c_core, c_norm, cost_tg, cost_fg;
+
     // Constants
     double kh0m = kk / (H[0] * m);
     double k2h0m = kk / (2.0 * H[0] * m);
@@ -284,6 +408,7 @@ void KleinKramers2d::Evolve()
     double i2h1 = 1.0 / (2.0 * H[1]);
     double mkT2h1sq = m * kb * temp / (H[1] * H[1]);
     double kgamma = kk * gamma;
+    double khq = kh1 * charge;
     double TolHd_sq = TolHd * TolHd;
     double TolLd_sq = TolLd * TolLd;
     double mkT2pihbarSq = m * kb * temp / (PI * hb * hb);
@@ -325,6 +450,19 @@ void KleinKramers2d::Evolve()
     VectorXi Check;
     VectorXd ExTBL;
     int Excount;
+    int tbl_points, ex_points;     // TBL and extrapolated points handled this step
+    double mass_step = 0.0;        // mass before renormalization
+    double mass_cut, mass_ex;      // mass dropped by truncation, added by extrapolation
+    FILE *pfile_telemetry = NULL;
+
+    // Delta-f: moments of the background
+    int r1_min, r1_max;            // rows of the TG moments
+    double fm0 = 0.0;              // integrals of MM, p MM and p^2 MM over p
+    double fm1 = 0.0;
+    double fm2 = 0.0;
+    double mass_fm = 0.0;          // mass of f_M on the interior
+    double trans_fm = 0.0;         // mass of f_M from idx_x0 on
+    double norm_fm;                // mass of f_M on the TA
 
     // Neighborlist
     int nneigh = 0;
@@ -344,23 +482,33 @@ void KleinKramers2d::Evolve()
 
     bool *TAMask;
 
-    if ( !isFullGrid ) 
+    if ( !isFullGrid || isAutoGrid ) 
         TAMask = new bool[O1];
     
-    double *F = new double[O1];
-    double *Feq_loc = new double[O1];
-    double *FF = new double[O1];
-    double *PF = new double[O1];
-    double *KK1 = new double[O1];
-    double *KK2 = new double[O1];
-    double *KK3 = new double[O1];
-    double *KK4 = new double[O1];
+    // Grid arrays, memory-mapped when out of core
+    OutOfCore ooc;
+    ooc.open(OOC_DIR, BoxShape[0], W1, OOC_SLAB, 1);
+
+    double *F = ooc.alloc(O1);
+    double *Feq_loc = ooc.alloc(O1);
+    double *FF = ooc.alloc(O1);
+    double *PF = ooc.alloc(O1);
+    double *KK1 = ooc.alloc(O1);
+    double *KK2 = ooc.alloc(O1);
+    double *KK3 = ooc.alloc(O1);
+    double *KK4 = ooc.alloc(O1);
+
+    if ( ooc.isEnabled() )
+        log->log("[KleinKramers2d] Out-of-core: %d arrays mapped\n", ooc.mapped());
 
     double *Density = new double[BoxShape[0]];
     double *Velocity = new double[BoxShape[0]];
     double *Temperature = new double[BoxShape[0]];
     double *Doping = new double[BoxShape[0]];
     double *Efield = new double[BoxShape[0]];
+    double *KRate = new double[BoxShape[1]];  // kk * scattering rate per momentum
+    double *NM = isDeltaF ? new double[BoxShape[0]] : nullptr;  // delta-f: f_M = NM[i1] MM[i2]
+    double *MM = isDeltaF ? new double[BoxShape[1]] : nullptr;
 
     double *F0;
     double *Ft;
@@ -406,7 +554,11 @@ void KleinKramers2d::Evolve()
         Doping[i1] = DopingProfile(Box[0] + i1 * H[0]);
     }
 
-    if ( !isFullGrid )  {
+    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+        KRate[i2] = kgamma;
+    }
+
+    if ( !isFullGrid || isAutoGrid )  {
 
         t_1_begin = omp_get_wtime();
         
@@ -524,6 +676,40 @@ void KleinKramers2d::Evolve()
 
     // .........................................................................................
 
+    // Delta-f: split off f_M = NM[i1] MM[i2], the doping times the Maxwellian
+    // at the lattice temperature, and evolve g = f - f_M
+
+    if ( isDeltaF )
+    {
+        for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
+            NM[i1] = Doping[i1];
+        }
+        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+            xx2 = Box[2] + i2 * H[1];
+            MM[i2] = (i2 < EDGE || i2 >= BoxShape[1] - EDGE) ? 0.0 : sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT));
+            fm0 += MM[i2] * H[1];
+            fm1 += xx2 * MM[i2] * H[1];
+            fm2 += xx2 * xx2 * MM[i2] * H[1];
+        }
+        for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+            mass_fm += NM[i1] * fm0 * H[0];
+            if (i1 >= idx_x0)
+                trans_fm += NM[i1] * fm0 * H[0];
+        }
+
+        #pragma omp parallel for
+        for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                F[i1*W1+i2] -= NM[i1] * MM[i2];
+                PF[i1*W1+i2] = F[i1*W1+i2];
+            }
+        }
+        log->log("[KleinKramers2d] Delta-f: evolving g = f - f_M, mass of f_M = %.16e\n", mass_fm);
+        log->log("[KleinKramers2d] Delta-f: wave.dat holds g\n");
+    }
+
+    // .........................................................................................
+
     // Initial truncation & edge point check
 
     if ( !isFullGrid )
@@ -554,7 +740,7 @@ void KleinKramers2d::Evolve()
                 f2p = F[i1*W1+(i2+1)];
                 f2m = F[i1*W1+(i2-1)];
 
-                b1 = F[i1*W1+i2] < TolH;
+                b1 = Level(F[i1*W1+i2]) < TolH;
                 b2 = ((nx1 == 0) ? 0.0 : pow(std::abs(f1p - f1m)/(nx1*H[0]),2)) + \
                      ((nx2 == 0) ? 0.0 : pow(std::abs(f2p - f2m)/(nx2*H[1]),2)) < TolHd_sq;
                 
@@ -707,8 +893,12 @@ void KleinKramers2d::Evolve()
     // Compute the 3 Momentum Moments.
     if ( !isFullGrid )   // 3 Momentum Moments in Truncated-Grid Formalism
     {
+        // Delta-f: the rows off the TA still carry f_M
+        r1_min = isDeltaF ? EDGE : x1_min;
+        r1_max = isDeltaF ? BoxShape[0] - EDGE - 1 : x1_max;
+
         if (isLinearizedCollision) {
-            for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+            for (int i1 = r1_min; i1 <= r1_max; i1 ++)  {
                 density = 0.0;
                 velocity_dft = 0.0;
                 temp_loc = 0.0;
@@ -717,6 +907,8 @@ void KleinKramers2d::Evolve()
                         density += F[i1*W1+i2] * H[1];
                     }
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                 }
@@ -731,7 +923,7 @@ void KleinKramers2d::Evolve()
             }
         }
         else if (isIsothermal) {
-            for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+            for (int i1 = r1_min; i1 <= r1_max; i1 ++)  {
                 density = 0.0;
                 velocity_dft = 0.0;
                 temp_loc = 0.0;
@@ -740,6 +932,8 @@ void KleinKramers2d::Evolve()
                         density += F[i1*W1+i2] * H[1];
                     }
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                 }
@@ -750,6 +944,8 @@ void KleinKramers2d::Evolve()
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        velocity_dft += NM[i1] * fm1;
                     velocity_dft = velocity_dft / (m * density);
                     temp_loc = temp;
                 }   
@@ -759,7 +955,7 @@ void KleinKramers2d::Evolve()
             }
         }
         else {
-            for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+            for (int i1 = r1_min; i1 <= r1_max; i1 ++)  {
                 density = 0.0;
                 velocity_dft = 0.0;
                 temp_loc = 0.0;
@@ -768,6 +964,8 @@ void KleinKramers2d::Evolve()
                         density += F[i1*W1+i2] * H[1];
                     }
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                 }
@@ -778,12 +976,16 @@ void KleinKramers2d::Evolve()
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        velocity_dft += NM[i1] * fm1;
                     velocity_dft = velocity_dft / (m * density);
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                         if (TAMask[i1*W1+i2])  {
                             temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        temp_loc += NM[i1] * (fm2 - 2.0 * m * velocity_dft * fm1 + pow(m * velocity_dft, 2) * fm0);
                     temp_loc = temp_loc / (m * kb * density);
                 }
                 Density[i1] = density;
@@ -802,6 +1004,8 @@ void KleinKramers2d::Evolve()
                 for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                     density += F[i1*W1+i2] * H[1];
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                 }
@@ -823,6 +1027,8 @@ void KleinKramers2d::Evolve()
                 for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                     density += F[i1*W1+i2] * H[1];
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                 }
@@ -831,6 +1037,8 @@ void KleinKramers2d::Evolve()
                     for (int i2 =0; i2 < BoxShape[1]; i2 ++)  {
                         velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                     }
+                    if ( isDeltaF )
+                        velocity_dft += NM[i1] * fm1;
                     velocity_dft = velocity_dft / (m * density);
                     temp_loc = temp;
                 }   
@@ -847,6 +1055,8 @@ void KleinKramers2d::Evolve()
                 for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                     density += F[i1*W1+i2] * H[1];
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                 } 
@@ -855,10 +1065,14 @@ void KleinKramers2d::Evolve()
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                         velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                     }
+                    if ( isDeltaF )
+                        velocity_dft += NM[i1] * fm1;
                     velocity_dft = velocity_dft / (m * density);
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                         temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                     }
+                    if ( isDeltaF )
+                        temp_loc += NM[i1] * (fm2 - 2.0 * m * velocity_dft * fm1 + pow(m * velocity_dft, 2) * fm0);
                     temp_loc = temp_loc / (m * kb * density);
                 }
                 Density[i1] = density;
@@ -893,7 +1107,83 @@ void KleinKramers2d::Evolve()
         Efield[i1] = - ((potr - potl - I1)/(rightbnd-leftbnd) + I2);
     }
 
+    // Delta-f: g starts at zero, so the TA starts from the support of the source
+    if ( isDeltaF && !isFullGrid )  {
+        SeedSource(TAMask, NM, MM, KRate, Efield, kh0m, khq);
+
+        x1_min = BIG_NUMBER;
+        x2_min = BIG_NUMBER;
+        x1_max = -BIG_NUMBER;
+        x2_max = -BIG_NUMBER;
+        ta_size = 0;
+
+        #pragma omp parallel for reduction(min: x1_min,x2_min) reduction(max: x1_max,x2_max) \
+                                 reduction(+: ta_size)
+        for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
+            for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
+                if (TAMask[i1*W1+i2])  {
+                    if (i1 < x1_min)  x1_min = i1;
+                    if (i1 > x1_max)  x1_max = i1;
+                    if (i2 < x2_min)  x2_min = i2;
+                    if (i2 > x2_max)  x2_max = i2;
+                    ta_size += 1;
+                }
+                else  {
+                    F[i1*W1+i2] = 0.0;
+                    PF[i1*W1+i2] = 0.0;
+                }
+            }
+        }
+
+        tmpVec.clear();
+
+        if (ta_size == 0)
+            tb_size = 0;
+        else  {
+            #pragma omp parallel for reduction(merge: tmpVec)
+            for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+                for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+                    if (TAMask[i1*W1+i2] && ( \
+                        !TAMask[(i1+1)*W1+i2] || !TAMask[(i1-1)*W1+i2] || \
+                        !TAMask[i1*W1+(i2+1)] || !TAMask[i1*W1+(i2-1)]))
+                        tmpVec.push_back(i1*W1+i2);
+                }
+            }
+            tmpVec.swap(TB);
+            tmpVec.clear();
+            tb_size = TB.size();
+        }
+        log->log("[KleinKramers2d] Delta-f: TA seeded from the source, TA size = %d, TB size = %d\n", ta_size, tb_size);
+    }
+
+    // Live moments for local consumers
+    MomentRing ring;
+    const char *ring_names[] = {"Density", "Velocity", "Temperature", "Efield"};
+    const double *ring_fields[] = {Density, Velocity, Temperature, Efield};
+
+    if ( SHM_NAME.length() > 0 && SHM_PERIOD > 0 )  {
+        if ( ring.create(SHM_NAME, BoxShape[0], 4, ring_names, SHM_SLOTS, Box[0], H[0]) == 0 )
+            log->log("[KleinKramers2d] Moment ring %s created\n", SHM_NAME.c_str());
+        else
+            log->log("[KleinKramers2d] Moment ring %s could not be created, disabled\n", SHM_NAME.c_str());
+    }
+
     // .........................................................................................
+    // Per-region timing lines go through a buffer, off the timed regions
+    TimingLog tlog;
+
+    if ( !QUIET && TIMING )  {
+        tlog.open(log, TIMING_LOG, omp_get_max_threads(), 4096);
+        if ( TIMING_LOG.length() > 0 )
+            log->log("[KleinKramers2d] Timing lines go to %s\n", TIMING_LOG.c_str());
+    }
+
+    if ( meter.isEnabled() )  {
+        meter.update();
+        energy_iter = meter.total();
+        energy_period = energy_iter;
+    }
+
     // Time iteration 
 
     log->log("=======================================================\n\n"); 
@@ -901,10 +1191,24 @@ void KleinKramers2d::Evolve()
     log->log("[KleinKramers2d] Number of steps = %d\n\n", (int)(TIME / kk)); 
     log->log("=======================================================\n\n"); 
 
+    if ( TELEMETRY_PERIOD > 0 )  {
+        pfile_telemetry = fopen("telemetry.csv", "w");
+        if ( pfile_telemetry == NULL )
+            log->log("[KleinKramers2d] Cannot open telemetry.csv\n");
+        else
+            fprintf(pfile_telemetry, "step,time,fullgrid,ta_size,tb_size,tbl_points,ex_points,"
+                                     "x1_min,x1_max,x2_min,x2_max,excount,mass,mass_cut,mass_ex,"
+                                     "t_core,t_overhead,t_step\n");
+    }
+
     for (int tt = 0; tt < (int)(TIME / kk); tt ++)
     {
         t_0_begin = omp_get_wtime(); 
         Excount = 0;
+        tbl_points = 0;
+        ex_points = 0;
+        mass_cut = 0.0;
+        mass_ex = 0.0;
 
         if ( isPrintWavefunc && tt % PRINT_WAVEFUNC_PERIOD == 0 )
         {
@@ -921,9 +1225,13 @@ void KleinKramers2d::Evolve()
             }
             else  {
                 fprintf(pfile, "%d %d\n", tt, GRIDS_TOT);
-                for (int i1 = 0; i1 < BoxShape[0]; i1 ++)  {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        fprintf(pfile, "%d %d %.8e\n", i1, i2, F[i1*W1+i2]);
+                for (int s1 = 0, e1; s1 < BoxShape[0]; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0]);
+                    ooc.Stream(s1, BoxShape[0], {F});
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            fprintf(pfile, "%d %d %.8e\n", i1, i2, F[i1*W1+i2]);
+                        }
                     }
                 }
             }
@@ -1031,6 +1339,78 @@ void KleinKramers2d::Evolve()
             }
         }
 
+        if ( ring.isEnabled() && tt % SHM_PERIOD == 0 )
+            ring.publish(tt, tt * kk, ring_fields);
+
+        // Automatic grid switching: compare the measured cost per step of the
+        // current mode with the cost predicted for the other one
+
+        if ( isAutoGrid && auto_steps >= AUTO_GRID_PERIOD && core_points > 0.0 )
+        {
+            c_core = t_auto_core / core_points;  // moment and RK4 cost per active grid point
+            c_norm = ( norm_points > 0.0 ) ? t_auto_norm / norm_points : 0.0;
+
+            if ( !isFullGrid )  {
+
+                cost_tg = t_auto_step / auto_steps;
+                cost_fg = ( c_core + c_norm ) * n_interior;
+                t_auto_ovh = std::max(cost_tg * auto_steps / auto_points - c_core, 0.0);
+
+                if ( cost_tg > (1.0 + AutoGridThreshold) * cost_fg )  {
+
+                    // F is already zero outside TA
+                    isFullGrid = true;
+                    TB.clear();
+                    log->log("[KleinKramers2d] Step: %d, switching to full grid (TG %.4e sec/step, FG predicted %.4e sec/step)\n", tt, cost_tg, cost_fg);
+                }
+            }
+            else  {
+
+                ta_est = 0;
+
+                #pragma omp parallel for reduction(+: ta_est)
+                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                        if (Level(PF[i1*W1+i2]) >= TolH)
+                            ta_est += 1;
+                    }
+                }
+                cost_fg = t_auto_step / auto_steps;
+                cost_tg = ta_est * (c_core + ((t_auto_ovh < 0.0) ? c_core : t_auto_ovh));
+
+                if ( cost_fg > (1.0 + AutoGridThreshold) * cost_tg )  {
+
+                    // Start from the whole interior and let the truncation
+                    // at the end of this step prune it.
+                    #pragma omp parallel for
+                    for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                            TAMask[i1*W1+i2] = (i1 > EDGE && i1 < BoxShape[0]-EDGE-1 && i2 > EDGE && i2 < BoxShape[1]-EDGE-1);
+                            if (!TAMask[i1*W1+i2])  {
+                                F[i1*W1+i2] = 0.0;
+                                PF[i1*W1+i2] = 0.0;
+                            }
+                        }
+                    }
+                    x1_min = EDGE + 1;
+                    x2_min = EDGE + 1;
+                    x1_max = BoxShape[0] - EDGE - 2;
+                    x2_max = BoxShape[1] - EDGE - 2;
+                    ta_size = (x1_max - x1_min + 1) * (x2_max - x2_min + 1);
+                    TB.clear();
+                    isFullGrid = false;
+                    log->log("[KleinKramers2d] Step: %d, switching to truncated grid (FG %.4e sec/step, TG predicted %.4e sec/step)\n", tt, cost_fg, cost_tg);
+                }
+            }
+            auto_steps = 0;
+            auto_points = 0.0;
+            core_points = 0.0;
+            norm_points = 0.0;
+            t_auto_step = 0.0;
+            t_auto_core = 0.0;
+            t_auto_norm = 0.0;
+        }
+
         // Check if TB of f is higher than TolL
         
         if ( !isFullGrid )
@@ -1060,7 +1440,7 @@ void KleinKramers2d::Evolve()
                 f2p = (TAMask[g1*W1+(g2+1)]) ? F[g1*W1+(g2+1)] : F[g1*W1+g2];
                 f2m = (TAMask[g1*W1+(g2-1)]) ? F[g1*W1+(g2-1)] : F[g1*W1+g2];
 
-                b1 = PF[g1*W1+g2] >= TolL;
+                b1 = Level(PF[g1*W1+g2]) >= TolL;
                 b2 = ((nx1 == 0) ? 0.0 : pow(std::abs(f1p - f1m)/(nx1*H[0]),2)) + \
                      ((nx2 == 0) ? 0.0 : pow(std::abs(f2p - f2m)/(nx2*H[1]),2)) >= TolLd_sq;
                 b3 = g1 > EDGE && g2 > EDGE;
@@ -1076,7 +1456,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-a-1: TBL) = %lf sec\n", t_1_elapsed);   
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-a-1: TBL) = %lf sec\n", t_1_elapsed);   
             if (!QUIET && TIMING) log->log("TBL size = %d\n", TBL.size()); 
         }
         else  
@@ -1098,6 +1478,7 @@ void KleinKramers2d::Evolve()
             __gnu_parallel::sort(TBL.begin(),TBL.end());
             it = std::unique (TBL.begin(), TBL.end()); 
             TBL.resize(std::distance(TBL.begin(),it)); 
+            tbl_points += TBL.size();
 
             // Find extrapolation target
             // ExFF: Index of Extrapolated points
@@ -1124,7 +1505,7 @@ void KleinKramers2d::Evolve()
 
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-b-1: ExFF) = %.4e sec\n", t_1_elapsed); 
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-1: ExFF) = %.4e sec\n", t_1_elapsed); 
 
             if ( ExFF.size() > 0 )  {
 
@@ -1147,7 +1528,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-b-2: ExFF) = %lf sec\n", t_1_elapsed);   
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-2: ExFF) = %lf sec\n", t_1_elapsed);   
 
                 // Find the direction of Outer to Edge points
                 t_1_begin = omp_get_wtime();
@@ -1177,7 +1558,7 @@ void KleinKramers2d::Evolve()
                             min_dir = 0;
                         }
                         if ( F[(g1-2)*W1+g2] != 0.0 )  {
-                            val = exp( 2.0 * std::log(F[(g1-1)*W1+g2]) - std::log(F[(g1-2)*W1+g2]) );
+                            val = Extrapolate(F[(g1-1)*W1+g2], F[(g1-2)*W1+g2]);
                             if (!(isnan(val) || isnan(-val)) && !(isinf(val) || isinf(-val)))  
                             {
                                 sum += val;
@@ -1194,7 +1575,7 @@ void KleinKramers2d::Evolve()
                             min_dir = 0;
                         }
                         if ( F[(g1+2)*W1+g2] != 0.0 )  {
-                            val = exp( 2.0 * std::log(F[(g1+1)*W1+g2]) - std::log(F[(g1+2)*W1+g2]) );
+                            val = Extrapolate(F[(g1+1)*W1+g2], F[(g1+2)*W1+g2]);
                             if (!(isnan(val) || isnan(-val)) && !(isinf(val) || isinf(-val)))
                             {
                                 sum += val;
@@ -1212,7 +1593,7 @@ void KleinKramers2d::Evolve()
                         }
                         if ( F[g1*W1+(g2-2)] != 0.0 )  {
 
-                            val = exp( 2.0 * std::log(F[g1*W1+(g2-1)]) - std::log(F[g1*W1+(g2-2)]) );
+                            val = Extrapolate(F[g1*W1+(g2-1)], F[g1*W1+(g2-2)]);
                             if (!(isnan(val) || isnan(-val)) && !(isinf(val) || isinf(-val)))
                             {
                                 sum += val;
@@ -1229,7 +1610,7 @@ void KleinKramers2d::Evolve()
                             min_dir = 1;
                         }
                         if ( F[g1*W1+(g2+2)] != 0.0 )  {
-                            val = exp( 2.0 * std::log(F[g1*W1+(g2+1)]) - std::log(F[g1*W1+(g2+2)]) );
+                            val = Extrapolate(F[g1*W1+(g2+1)], F[g1*W1+(g2+2)]);
                             if (!(isnan(val) || isnan(-val)) && !(isinf(val) || isinf(-val))) 
                             {
                                 sum += val;
@@ -1257,13 +1638,15 @@ void KleinKramers2d::Evolve()
                 }
                 count = 0;
 
-                #pragma omp parallel for reduction (+:count) 
+                #pragma omp parallel for reduction (+:count,mass_ex)
                 for ( int i = 0; i < ExFF.size(); i++ )  {
                     if (Check[i])  {
                         F[ExFF[i]] = ExTBL[i];
+                        mass_ex += ExTBL[i];
                         count += 1;
                     }
                 }
+                ex_points += count;
 
                 if (count == 0)  {
                     ExFF.clear();
@@ -1273,7 +1656,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-b-3: ExFF) = %.4e sec\n", t_1_elapsed);  
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-b-3: ExFF) = %.4e sec\n", t_1_elapsed);  
             } // if ExFF.size() > 0 
 
             // ............................................................................................. Extrapolation
@@ -1307,6 +1690,8 @@ void KleinKramers2d::Evolve()
 
                     g1 = (int)(tmpVec[i] / M1);
                     g2 = (int)(tmpVec[i] % M1);
+                    if (!TAMask[tmpVec[i]])
+                        ta_size += 1;
                     TAMask[tmpVec[i]] = 1;
                     
                     // Update TA box
@@ -1320,7 +1705,9 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-c-1: CASE 1 TA) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-c-1: CASE 1 TA) = %lf sec\n", t_1_elapsed); 
+
+                t_auto_begin = omp_get_wtime();
 
                 #pragma omp parallel for
                 for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
@@ -1328,7 +1715,10 @@ void KleinKramers2d::Evolve()
                 }
 
                 // Update the 3 Momentum Moments before time integration.
-                for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+                r1_min = isDeltaF ? EDGE : x1_min;
+                r1_max = isDeltaF ? BoxShape[0] - EDGE - 1 : x1_max;
+
+                for (int i1 = r1_min; i1 <= r1_max; i1 ++)  {
                     density = 0.0;
                     velocity_dft = 0.0;
                     temp_loc = 0.0;
@@ -1337,6 +1727,8 @@ void KleinKramers2d::Evolve()
                             density += F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        density += NM[i1] * fm0;
                     if (density <= 0.0) {
                         density = 0.0;
                         for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
@@ -1363,6 +1755,8 @@ void KleinKramers2d::Evolve()
                                 velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                             }
                         }
+                        if ( isDeltaF )
+                            velocity_dft += NM[i1] * fm1;
                         velocity_dft = velocity_dft / (m * density);
                         temp_loc = temp;
                         for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
@@ -1379,12 +1773,16 @@ void KleinKramers2d::Evolve()
                                 velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                             }
                         }
+                        if ( isDeltaF )
+                            velocity_dft += NM[i1] * fm1;
                         velocity_dft = velocity_dft / (m * density);
                         for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                             if (TAMask[i1*W1+i2])  {
                                 temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                             }
                         }
+                        if ( isDeltaF )
+                            temp_loc += NM[i1] * (fm2 - 2.0 * m * velocity_dft * fm1 + pow(m * velocity_dft, 2) * fm0);
                         temp_loc = temp_loc / (m * kb * density);
                         for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                             if (TAMask[i1*W1+i2]){
@@ -1396,6 +1794,13 @@ void KleinKramers2d::Evolve()
                     Density[i1] = density;
                     Velocity[i1] = velocity_dft;
                     Temperature[i1] = temp_loc;
+                    // Delta-f: g relaxes to feq - f_M
+                    if ( isDeltaF )  {
+                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+                            if (TAMask[i1*W1+i2])
+                                Feq_loc[i1*W1+i2] -= NM[i1] * MM[i2];
+                        }
+                    }
                 }
 
                 // Boundary Condition in Momentum Space.
@@ -1454,6 +1859,8 @@ void KleinKramers2d::Evolve()
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                         xx2 = Box[2] + i2 * H[1];
                         F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+                        if ( isDeltaF )
+                            F[i1*W1+i2] -= NM[i1] * MM[i2];
                     }
                 }
                 for (int i1 = BoxShape[0]-EDGE; i1 < BoxShape[0]; i1 ++)  {
@@ -1462,6 +1869,8 @@ void KleinKramers2d::Evolve()
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                         xx2 = Box[2] + i2 * H[1];
                         F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+                        if ( isDeltaF )
+                            F[i1*W1+i2] -= NM[i1] * MM[i2];
                     }
                 }
 
@@ -1473,159 +1882,77 @@ void KleinKramers2d::Evolve()
                     {
                         t_1_begin = omp_get_wtime();
                     }
-                    #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,feq,dfx,dfp,elecfield)
+                    #pragma omp for
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
-                                xx1 = Box[0] + i1 * H[0];
-                                xx2 = Box[2] + i2 * H[1];
-                                f0 = F[i1*W1+i2];
-                                f1p1 = F[(i1+1)*W1+i2];
-                                f1m1 = F[(i1-1)*W1+i2];
-                                f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                                f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                                feq = Feq_loc[i1*W1+i2];
-                                elecfield = Efield[i1];
-                                dfx = (xx2 >= 0.0) ? f0 - f1m1 : f1p1 - f0;
-                                dfp = (elecfield <= 0.0) ? f0 - f2m1 : f2p1 - f0;
-
-                                KK1[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                                +kh1 * charge * elecfield * dfp +
-                                                kgamma * (feq - f0);
-
-                                FF[i1*W1+i2] = F[i1*W1+i2] + KK1[i1*W1+i2] / 6.0;
-                            }
-                        }
+                        UpwindStage<1>(i1, x2_min, x2_max + 1, TAMask, F, nullptr, KK1, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<1>(i1, x2_min, x2_max + 1, TAMask, KK1, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                     #pragma omp single nowait
                     {
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-2
-                    #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield) schedule(runtime)
+                    #pragma omp for schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
-                                xx1 = Box[0] + i1 * H[0];
-                                xx2 = Box[2] + i2 * H[1];
-                                f0 = F[i1*W1+i2];
-                                f1p1 = F[(i1+1)*W1+i2];
-                                f1m1 = F[(i1-1)*W1+i2];
-                                f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                                f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                                kk0 = KK1[i1*W1+i2];
-                                kk1p1 = KK1[(i1+1)*W1+i2];
-                                kk1m1 = KK1[(i1-1)*W1+i2];
-                                kk2p1 = KK1[i1*W1+(i2+1)];
-                                kk2m1 = KK1[i1*W1+(i2-1)];
-                                feq = Feq_loc[i1*W1+i2];
-                                elecfield = Efield[i1];
-                                dfx = (xx2 >= 0.0) ? (f0+0.5*kk0) - (f1m1+0.5*kk1m1) : (f1p1+0.5*kk1p1) - (f0+0.5*kk0);
-                                dfp = (elecfield <= 0.0) ? (f0+0.5*kk0) - (f2m1+0.5*kk2m1) : (f2p1+0.5*kk2p1) - (f0+0.5*kk0);
-
-                                KK2[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                                kh1 * charge * elecfield * dfp +
-                                                kgamma * (feq - f0 - 0.5 * kk0);
-
-                                FF[i1*W1+i2] += KK2[i1*W1+i2] / 3.0;
-                            }
-                        }
+                        UpwindStage<2>(i1, x2_min, x2_max + 1, TAMask, F, KK1, KK2, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<2>(i1, x2_min, x2_max + 1, TAMask, KK2, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                     #pragma omp single nowait
                     {
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-3
-                    #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield) schedule(runtime)
+                    #pragma omp for schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
-                                xx1 = Box[0] + i1 * H[0];
-                                xx2 = Box[2] + i2 * H[1];
-                                f0 = F[i1*W1+i2];
-                                f1p1 = F[(i1+1)*W1+i2];
-                                f1m1 = F[(i1-1)*W1+i2];
-                                f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                                f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                                kk0 = KK2[i1*W1+i2];
-                                kk1p1 = KK2[(i1+1)*W1+i2];
-                                kk1m1 = KK2[(i1-1)*W1+i2];
-                                kk2p1 = KK2[i1*W1+(i2+1)];
-                                kk2m1 = KK2[i1*W1+(i2-1)];
-                                feq = Feq_loc[i1*W1+i2];
-                                elecfield = Efield[i1];
-                                dfx = (xx2 >= 0.0) ? (f0+0.5*kk0) - (f1m1+0.5*kk1m1) : (f1p1+0.5*kk1p1) - (f0+0.5*kk0);
-                                dfp = (elecfield <= 0.0) ? (f0+0.5*kk0) - (f2m1+0.5*kk2m1) : (f2p1+0.5*kk2p1) - (f0+0.5*kk0);
-
-                                KK3[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                                kh1 * charge * elecfield * dfp +
-                                                kgamma * (feq - f0 - 0.5 * kk0);
-
-                                FF[i1*W1+i2] += KK3[i1*W1+i2] / 3.0;   
-                            }
-                        }            
+                        UpwindStage<3>(i1, x2_min, x2_max + 1, TAMask, F, KK2, KK3, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<3>(i1, x2_min, x2_max + 1, TAMask, KK3, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                     #pragma omp single nowait
                     {
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
 
                     // RK4-4
-                    #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield) schedule(runtime)
+                    #pragma omp for schedule(runtime)
                     for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                        for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                            if (TAMask[i1*W1+i2])  {
-                                xx1 = Box[0] + i1 * H[0];
-                                xx2 = Box[2] + i2 * H[1];
-                                f0 = F[i1*W1+i2];
-                                f1p1 = F[(i1+1)*W1+i2];
-                                f1m1 = F[(i1-1)*W1+i2];
-                                f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                                f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];                             
-                                kk0 = KK3[i1*W1+i2];
-                                kk1p1 = KK3[(i1+1)*W1+i2];
-                                kk1m1 = KK3[(i1-1)*W1+i2];
-                                kk2p1 = KK3[i1*W1+(i2+1)];
-                                kk2m1 = KK3[i1*W1+(i2-1)];
-                                feq = Feq_loc[i1*W1+i2];
-                                elecfield = Efield[i1];
-                                dfx = (xx2 >= 0.0) ? (f0+kk0) - (f1m1+kk1m1) : (f1p1+kk1p1) - (f0+kk0);
-                                dfp = (elecfield <= 0.0) ? (f0+kk0) - (f2m1+kk2m1) : (f2p1+kk2p1) - (f0+kk0);
-
-                                KK4[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                                kh1 * charge * elecfield * dfp +
-                                                kgamma * (feq - f0 - kk0);
-
-                                FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0; 
-                           }
-                        }
+                        UpwindStage<4>(i1, x2_min, x2_max + 1, TAMask, F, KK3, KK4, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<4>(i1, x2_min, x2_max + 1, TAMask, KK4, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                     #pragma omp single nowait
                     {
                         t_1_end = omp_get_wtime();
                         t_1_elapsed = t_1_end - t_1_begin;
                         t_truncate += t_1_elapsed;
-                        if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
+                        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
                         t_1_begin = omp_get_wtime();
                     }
                 } // OMP PARALLEL
 
                 isFirstExtrp = false;
 
+                if ( isAutoGrid )  {
+                    t_auto_core += omp_get_wtime() - t_auto_begin;
+                    core_points += ta_size;
+                }
+
             } // if ( isFirstExtrp )
             else if (ExFF.size() == 0)  {
 
@@ -1666,6 +1993,8 @@ void KleinKramers2d::Evolve()
 
                         g1 = (int)(tmpVec[i] / M1); 
                         g2 = (int)(tmpVec[i] % M1);
+                        if (!TAMask[tmpVec[i]])
+                            ta_size += 1;
                         TAMask[tmpVec[i]] = 1;
 
                         // Update TA box
@@ -1705,7 +2034,7 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-cx-1: CASE 1 ExBD) = %lf sec\n", t_1_elapsed); 
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-cx-1: CASE 1 ExBD) = %lf sec\n", t_1_elapsed); 
                 } // if ExFF.size() > 0
 
                 // Update the local Maxwellian before time integration.
@@ -1722,6 +2051,8 @@ void KleinKramers2d::Evolve()
                     else{
                         Feq_loc[g1*W1+g2] = 0.0;
                     }
+                    if ( isDeltaF )
+                        Feq_loc[g1*W1+g2] -= NM[g1] * MM[g2];
                 }
                 /*
                 //Remove all radicals by averaging over their nearest neighbors.
@@ -1765,12 +2096,15 @@ void KleinKramers2d::Evolve()
                                     kh1 * charge * elecfield * dfp +
                                     kgamma * (feq - f0);
 
+                    if ( isDeltaF )
+                        KK1[g1*W1+g2] += Source(g1, g2, NM, MM, elecfield, kh0m, khq);
+
                     FF[g1*W1+g2] = F[g1*W1+g2] + KK1[g1*W1+g2] / 6.0;
                 }
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-11: CASE 1 KK1) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-2
@@ -1800,12 +2134,15 @@ void KleinKramers2d::Evolve()
                                     kh1 * charge * elecfield * dfp +
                                     kgamma * (feq - f0 - 0.5 * kk0);
 
+                    if ( isDeltaF )
+                        KK2[g1*W1+g2] += Source(g1, g2, NM, MM, elecfield, kh0m, khq);
+
                     FF[g1*W1+g2] += KK2[g1*W1+g2] / 3.0;
                 }
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-12: CASE 1 KK2) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-3
@@ -1835,12 +2172,15 @@ void KleinKramers2d::Evolve()
                                     kh1 * charge * elecfield * dfp +
                                     kgamma * (feq - f0 - 0.5 * kk0);
 
+                    if ( isDeltaF )
+                        KK3[g1*W1+g2] += Source(g1, g2, NM, MM, elecfield, kh0m, khq);
+
                     FF[g1*W1+g2] += KK3[g1*W1+g2] / 3.0;   
                 }
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-13: CASE 1 KK3) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
 
                 // RK4-4
@@ -1870,12 +2210,15 @@ void KleinKramers2d::Evolve()
                                     kh1 * charge * elecfield * dfp +
                                     kgamma * (feq - f0 - kk0);
 
+                    if ( isDeltaF )
+                        KK4[g1*W1+g2] += Source(g1, g2, NM, MM, elecfield, kh0m, khq);
+
                     FF[g1*W1+g2] += KK4[g1*W1+g2] / 6.0; 
                 }
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-kkx-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kkx-14: CASE 1 KK4) = %lf sec\n", t_1_elapsed);
                 t_1_begin = omp_get_wtime();
             } // isFirstExtrp == false and ExFF.size() > 0
 
@@ -1906,7 +2249,7 @@ void KleinKramers2d::Evolve()
 
                         f0 = FF[g1*W1+g2];
 
-                        b1 = f0 >= TolH;
+                        b1 = Level(f0) >= TolH;
                         b2 = ((nx1 == 0) ? 0.0 : pow(std::abs(f1p - f1m)/(nx1*H[0]),2)) + \
                             ((nx2 == 0) ? 0.0 : pow(std::abs(f2p - f2m)/(nx2*H[1]),2)) >= TolHd_sq;
                         b3 = g2 > EDGE && g2 > EDGE;
@@ -1945,7 +2288,7 @@ void KleinKramers2d::Evolve()
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin;
                 t_overhead += t_1_elapsed;
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-c-3 CASE 1 TBL) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-c-3 CASE 1 TBL) = %lf sec\n", t_1_elapsed); 
             }
         } // TBL.size() != 0 && !isFullGrid && Excount < ExLimit
 
@@ -1953,10 +2296,15 @@ void KleinKramers2d::Evolve()
 
         // CASE 2: Truncating without extrapolation
 
+        t_auto_begin = omp_get_wtime();
+
         if ( !isExtrapolate && !isFullGrid )
         {
             // Update the 3 Momentum Moments before time integration.
-            for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+            r1_min = isDeltaF ? EDGE : x1_min;
+            r1_max = isDeltaF ? BoxShape[0] - EDGE - 1 : x1_max;
+
+            for (int i1 = r1_min; i1 <= r1_max; i1 ++)  {
                 density = 0.0;
                 velocity_dft = 0.0;
                 temp_loc = 0.0;
@@ -1965,6 +2313,8 @@ void KleinKramers2d::Evolve()
                         density += F[i1*W1+i2] * H[1];
                     }
                 }
+                if ( isDeltaF )
+                    density += NM[i1] * fm0;
                 if (density <= 0.0) {
                     density = 0.0;
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
@@ -1991,6 +2341,8 @@ void KleinKramers2d::Evolve()
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        velocity_dft += NM[i1] * fm1;
                     velocity_dft = velocity_dft / (m * density);
                     temp_loc = temp;
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
@@ -2007,12 +2359,16 @@ void KleinKramers2d::Evolve()
                             velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        velocity_dft += NM[i1] * fm1;
                     velocity_dft = velocity_dft / (m * density);
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                         if (TAMask[i1*W1+i2])  {
                             temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
                         }
                     }
+                    if ( isDeltaF )
+                        temp_loc += NM[i1] * (fm2 - 2.0 * m * velocity_dft * fm1 + pow(m * velocity_dft, 2) * fm0);
                     temp_loc = temp_loc / (m * kb * density);
                     for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                         if (TAMask[i1*W1+i2]){
@@ -2024,6 +2380,13 @@ void KleinKramers2d::Evolve()
                 Density[i1] = density;
                 Velocity[i1] = velocity_dft;
                 Temperature[i1] = temp_loc;
+                // Delta-f: g relaxes to feq - f_M
+                if ( isDeltaF )  {
+                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+                        if (TAMask[i1*W1+i2])
+                            Feq_loc[i1*W1+i2] -= NM[i1] * MM[i2];
+                    }
+                }
             }
             /*
             //Remove all radicals by averaging over their nearest neighbors.
@@ -2099,6 +2462,8 @@ void KleinKramers2d::Evolve()
                 for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                     xx2 = Box[2] + i2 * H[1];
                     F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+                    if ( isDeltaF )
+                        F[i1*W1+i2] -= NM[i1] * MM[i2];
                 }
             }
             for (int i1 = BoxShape[0]-EDGE; i1 < BoxShape[0]; i1 ++)  {
@@ -2107,6 +2472,8 @@ void KleinKramers2d::Evolve()
                 for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
                     xx2 = Box[2] + i2 * H[1];
                     F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+                    if ( isDeltaF )
+                        F[i1*W1+i2] -= NM[i1] * MM[i2];
                 }
             }
 
@@ -2117,153 +2484,66 @@ void KleinKramers2d::Evolve()
                 {
                     t_1_begin = omp_get_wtime();
                 }
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,feq,dfx,dfp,elecfield)
+                #pragma omp for
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
-                            xx1 = Box[0] + i1 * H[0];
-                            xx2 = Box[2] + i2 * H[1];
-                            f0 = F[i1*W1+i2];
-                            f1p1 = F[(i1+1)*W1+i2];
-                            f1m1 = F[(i1-1)*W1+i2];
-                            f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                            f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                            feq = Feq_loc[i1*W1+i2];
-                            elecfield = Efield[i1];
-                            dfx = (xx2 >= 0.0) ? f0 - f1m1 : f1p1 - f0;
-                            dfp = (elecfield <= 0.0) ? f0 - f2m1 : f2p1 - f0;
-
-                            KK1[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                            kh1 * charge * elecfield * dfp +
-                                            kgamma * (feq - f0);
-
-                            FF[i1*W1+i2] = F[i1*W1+i2] + KK1[i1*W1+i2] / 6.0;
-                        }
-                    }
+                    UpwindStage<1>(i1, x2_min, x2_max + 1, TAMask, F, nullptr, KK1, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                    if ( isDeltaF )
+                        AddSource<1>(i1, x2_min, x2_max + 1, TAMask, KK1, FF, NM, MM, Efield[i1], kh0m, khq);
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-21: CASE 2 KK1) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-21: CASE 2 KK1) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-2
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield)
+                #pragma omp for
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
-                            xx1 = Box[0] + i1 * H[0];
-                            xx2 = Box[2] + i2 * H[1];
-                            f0 = F[i1*W1+i2];
-                            f1p1 = F[(i1+1)*W1+i2];
-                            f1m1 = F[(i1-1)*W1+i2];
-                            f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                            f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                            kk0 = KK1[i1*W1+i2];
-                            kk1p1 = KK1[(i1+1)*W1+i2];
-                            kk1m1 = KK1[(i1-1)*W1+i2];
-                            kk2p1 = KK1[i1*W1+(i2+1)];
-                            kk2m1 = KK1[i1*W1+(i2-1)];
-                            feq = Feq_loc[i1*W1+i2];
-                            elecfield = Efield[i1];
-                            dfx = (xx2 >= 0.0) ? (f0+0.5*kk0) - (f1m1+0.5*kk1m1) : (f1p1+0.5*kk1p1) - (f0+0.5*kk0);
-                            dfp = (elecfield <= 0.0) ? (f0+0.5*kk0) - (f2m1+0.5*kk2m1) : (f2p1+0.5*kk2p1) - (f0+0.5*kk0);
-
-                            KK2[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                            kh1 * charge * elecfield * dfp +
-                                            kgamma * (feq - f0 - 0.5 * kk0);
-
-                            FF[i1*W1+i2] += KK2[i1*W1+i2] / 3.0;
-                        }
-                    }
+                    UpwindStage<2>(i1, x2_min, x2_max + 1, TAMask, F, KK1, KK2, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                    if ( isDeltaF )
+                        AddSource<2>(i1, x2_min, x2_max + 1, TAMask, KK2, FF, NM, MM, Efield[i1], kh0m, khq);
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-22: CASE 2 KK2) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-22: CASE 2 KK2) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-3
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield)
+                #pragma omp for
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
-                            xx1 = Box[0] + i1 * H[0];
-                            xx2 = Box[2] + i2 * H[1];
-                            f0 = F[i1*W1+i2];
-                            f1p1 = F[(i1+1)*W1+i2];
-                            f1m1 = F[(i1-1)*W1+i2];
-                            f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                            f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                            kk0 = KK2[i1*W1+i2];
-                            kk1p1 = KK2[(i1+1)*W1+i2];
-                            kk1m1 = KK2[(i1-1)*W1+i2];
-                            kk2p1 = KK2[i1*W1+(i2+1)];
-                            kk2m1 = KK2[i1*W1+(i2-1)];
-                            feq = Feq_loc[i1*W1+i2];
-                            elecfield = Efield[i1];
-                            dfx = (xx2 >= 0.0) ? (f0+0.5*kk0) - (f1m1+0.5*kk1m1) : (f1p1+0.5*kk1p1) - (f0+0.5*kk0);
-                            dfp = (elecfield <= 0.0) ? (f0+0.5*kk0) - (f2m1+0.5*kk2m1) : (f2p1+0.5*kk2p1) - (f0+0.5*kk0);
-
-                            KK3[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                            kh1 * charge * elecfield * dfp +
-                                            kgamma * (feq - f0 - 0.5 * kk0);
-
-                            FF[i1*W1+i2] += KK3[i1*W1+i2] / 3.0;   
-                        }
-                    }
+                    UpwindStage<3>(i1, x2_min, x2_max + 1, TAMask, F, KK2, KK3, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                    if ( isDeltaF )
+                        AddSource<3>(i1, x2_min, x2_max + 1, TAMask, KK3, FF, NM, MM, Efield[i1], kh0m, khq);
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-23: CASE 2 KK3) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-23: CASE 2 KK3) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-4
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield)
+                #pragma omp for
                 for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
-                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
-                        if (TAMask[i1*W1+i2])  {
-                            xx1 = Box[0] + i1 * H[0];
-                            xx2 = Box[2] + i2 * H[1];
-                            f0 = F[i1*W1+i2];
-                            f1p1 = F[(i1+1)*W1+i2];
-                            f1m1 = F[(i1-1)*W1+i2];
-                            f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                            f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];                          
-                            kk0 = KK3[i1*W1+i2];
-                            kk1p1 = KK3[(i1+1)*W1+i2];
-                            kk1m1 = KK3[(i1-1)*W1+i2];
-                            kk2p1 = KK3[i1*W1+(i2+1)];
-                            kk2m1 = KK3[i1*W1+(i2-1)];
-                            feq = Feq_loc[i1*W1+i2];
-                            elecfield = Efield[i1];
-                            dfx = (xx2 >= 0.0) ? (f0+kk0) - (f1m1+kk1m1) : (f1p1+kk1p1) - (f0+kk0);
-                            dfp = (elecfield <= 0.0) ? (f0+kk0) - (f2m1+kk2m1) : (f2p1+kk2p1) - (f0+kk0);
-
-                            KK4[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                            kh1 * charge * elecfield * dfp +
-                                            kgamma * (feq - f0 - kk0);
-
-                            FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0; 
-                        }
-                    }                
+                    UpwindStage<4>(i1, x2_min, x2_max + 1, TAMask, F, KK3, KK4, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                    if ( isDeltaF )
+                        AddSource<4>(i1, x2_min, x2_max + 1, TAMask, KK4, FF, NM, MM, Efield[i1], kh0m, khq);
                 }
                 #pragma omp single nowait
                 {
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_overhead += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-24: CASE 2 KK4) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-24: CASE 2 KK4) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
             } // OMP PARALLEL
@@ -2273,60 +2553,80 @@ void KleinKramers2d::Evolve()
             // .........................................................................................
 
             // CASE 3: Full grid
+            // Every sweep runs slab by slab over the out-of-core arrays, a
+            // single slab when they are in memory.
             // Update the 3 Momentum Moments before time integration.
             // The boundary condition of thermalisation in momentum space is included.
-            for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
-                density = 0.0;
-                velocity_dft = 0.0;
-                temp_loc = 0.0;
-                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                    density += F[i1*W1+i2] * H[1];
-                }
-                if (density <= 0.0) {
+            for (int s1 = EDGE, e1; s1 < BoxShape[0]-EDGE; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]-EDGE);
+                ooc.Stream(s1, BoxShape[0]-EDGE, {F, Feq_loc});
+                for (int i1 = s1; i1 < e1; i1 ++)  {
                     density = 0.0;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  { 
-                        Feq_loc[i1*W1+i2] = 0.0;
-                    }
-                }
-                else if (isLinearizedCollision)
-                {
                     velocity_dft = 0.0;
-                    temp_loc = temp;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
-                    }
-                }
-                else if (isIsothermal)
-                {
+                    temp_loc = 0.0;
                     for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                        density += F[i1*W1+i2] * H[1];
                     }
-                    velocity_dft = velocity_dft / (m * density);
-                    temp_loc = temp;
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                    if ( isDeltaF )
+                        density += NM[i1] * fm0;
+                    if (density <= 0.0) {
+                        density = 0.0;
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  { 
+                            Feq_loc[i1*W1+i2] = 0.0;
+                        }
                     }
-                }   
-                else
-                {
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                    else if (isLinearizedCollision)
+                    {
+                        velocity_dft = 0.0;
+                        temp_loc = temp;
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow((Box[2] + i2 * H[1]), 2)/(2*m*kb*temp));
+                            Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        }
                     }
-                    velocity_dft = velocity_dft / (m * density);
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
+                    else if (isIsothermal)
+                    {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                        }
+                        if ( isDeltaF )
+                            velocity_dft += NM[i1] * fm1;
+                        velocity_dft = velocity_dft / (m * density);
+                        temp_loc = temp;
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            feq = density * sqrt(1/(2*PI*m*kb*temp)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp));
+                            Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        }
+                    }   
+                    else
+                    {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            velocity_dft += (Box[2] + i2 * H[1]) * F[i1*W1+i2] * H[1];
+                        }
+                        if ( isDeltaF )
+                            velocity_dft += NM[i1] * fm1;
+                        velocity_dft = velocity_dft / (m * density);
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            temp_loc += pow((Box[2] + i2 * H[1] - m * velocity_dft), 2) * F[i1*W1+i2] * H[1];
+                        }
+                        if ( isDeltaF )
+                            temp_loc += NM[i1] * (fm2 - 2.0 * m * velocity_dft * fm1 + pow(m * velocity_dft, 2) * fm0);
+                        temp_loc = temp_loc / (m * kb * density);
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
+                            Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                        }
                     }
-                    temp_loc = temp_loc / (m * kb * density);
-                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                        feq = density * sqrt(1/(2*PI*m*kb*temp_loc)) * exp(-pow(((Box[2] + i2 * H[1]) - m*velocity_dft), 2)/(2*m*kb*temp_loc));
-                        Feq_loc[i1*W1+i2] = (feq > 1/(H[0]*H[1]) || !isfinite(feq)) ? 0 : feq;
+                    Density[i1] = density;
+                    Velocity[i1] = velocity_dft;
+                    Temperature[i1] = temp_loc;
+                    // Delta-f: g relaxes to feq - f_M
+                    if ( isDeltaF )  {
+                        for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                            Feq_loc[i1*W1+i2] -= NM[i1] * MM[i2];
+                        }
                     }
                 }
-                Density[i1] = density;
-                Velocity[i1] = velocity_dft;
-                Temperature[i1] = temp_loc;
             }
 
             // Coupled 1D Poisson Solver
@@ -2345,20 +2645,32 @@ void KleinKramers2d::Evolve()
             }
             
             // Boundary Condition in Coordinate Space: Linear Response.
-            for (int i1 = 0; i1 < EDGE; i1 ++)  {
-                density = Doping[i1];
-                elecfield = Efield[i1];
-                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                    xx2 = Box[2] + i2 * H[1];
-                    F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+            for (int s1 = 0, e1; s1 < EDGE; s1 = e1)  {
+                e1 = ooc.End(s1, EDGE);
+                ooc.Stream(s1, EDGE, {F});
+                for (int i1 = s1; i1 < e1; i1 ++)  {
+                    density = Doping[i1];
+                    elecfield = Efield[i1];
+                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                        xx2 = Box[2] + i2 * H[1];
+                        F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+                        if ( isDeltaF )
+                            F[i1*W1+i2] -= NM[i1] * MM[i2];
+                    }
                 }
             }
-            for (int i1 = BoxShape[0]-EDGE; i1 < BoxShape[0]; i1 ++)  {
-                density = Doping[i1];
-                elecfield = Efield[i1];
-                for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
-                    xx2 = Box[2] + i2 * H[1];
-                    F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+            for (int s1 = BoxShape[0]-EDGE, e1; s1 < BoxShape[0]; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]);
+                ooc.Stream(s1, BoxShape[0], {F});
+                for (int i1 = s1; i1 < e1; i1 ++)  {
+                    density = Doping[i1];
+                    elecfield = Efield[i1];
+                    for (int i2 = 0; i2 < BoxShape[1]; i2 ++)  {
+                        xx2 = Box[2] + i2 * H[1];
+                        F[i1*W1+i2] = density * sqrt(1/(2*PI*mkT)) * exp(-pow(xx2, 2)/(2*mkT)) * (1 - xx2*charge*elecfield/(gamma*mkT));
+                        if ( isDeltaF )
+                            F[i1*W1+i2] -= NM[i1] * MM[i2];
+                    }
                 }
             }
             
@@ -2370,26 +2682,17 @@ void KleinKramers2d::Evolve()
                 }
 
                 // RK4-1
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,feq,dfx,dfp,elecfield) schedule(runtime)
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = F[(i1+1)*W1+i2];
-                        f1m1 = F[(i1-1)*W1+i2];
-                        f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                        f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-                        elecfield = Efield[i1];
-                        dfx = (xx2 >= 0.0) ? f0 - f1m1 : f1p1 - f0;
-                        dfp = (elecfield <= 0.0) ? f0 - f2m1 : f2p1 - f0;
-
-                        KK1[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                        kh1 * charge * elecfield * dfp +
-                                        kgamma * (feq - f0);
-
-                        FF[i1*W1+i2] = F[i1*W1+i2] + KK1[i1*W1+i2] / 6.0;
+                for (int s1 = EDGE, e1; s1 < BoxShape[0] - EDGE; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0] - EDGE);
+                    #pragma omp single nowait
+                    {
+                        ooc.Stream(s1, BoxShape[0] - EDGE, {F, Feq_loc, KK1, FF});
+                    }
+                    #pragma omp for schedule(runtime)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        UpwindStage<1>(i1, EDGE, BoxShape[1] - EDGE, nullptr, F, nullptr, KK1, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<1>(i1, EDGE, BoxShape[1] - EDGE, nullptr, KK1, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                 }
                 #pragma omp single nowait
@@ -2397,36 +2700,22 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-31: CASE 3 KK1) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-31: CASE 3 KK1) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-2
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield) schedule(runtime)
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = F[(i1+1)*W1+i2];
-                        f1m1 = F[(i1-1)*W1+i2];
-                        f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                        f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                        kk0 = KK1[i1*W1+i2];
-                        kk1p1 = KK1[(i1+1)*W1+i2];
-                        kk1m1 = KK1[(i1-1)*W1+i2];
-                        kk2p1 = KK1[i1*W1+(i2+1)];
-                        kk2m1 = KK1[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-                        elecfield = Efield[i1];
-                        dfx = (xx2 >= 0.0) ? (f0+0.5*kk0) - (f1m1+0.5*kk1m1) : (f1p1+0.5*kk1p1) - (f0+0.5*kk0);
-                        dfp = (elecfield <= 0.0) ? (f0+0.5*kk0) - (f2m1+0.5*kk2m1) : (f2p1+0.5*kk2p1) - (f0+0.5*kk0);
-
-                        KK2[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                        kh1 * charge * elecfield * dfp +
-                                        kgamma * (feq - f0 - 0.5 * kk0);
-
-                        FF[i1*W1+i2] += KK2[i1*W1+i2] / 3.0;
+                for (int s1 = EDGE, e1; s1 < BoxShape[0] - EDGE; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0] - EDGE);
+                    #pragma omp single nowait
+                    {
+                        ooc.Stream(s1, BoxShape[0] - EDGE, {F, Feq_loc, KK1, KK2, FF});
+                    }
+                    #pragma omp for schedule(runtime)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        UpwindStage<2>(i1, EDGE, BoxShape[1] - EDGE, nullptr, F, KK1, KK2, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<2>(i1, EDGE, BoxShape[1] - EDGE, nullptr, KK2, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                 }
                 #pragma omp single nowait
@@ -2434,36 +2723,22 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-32: CASE 3 KK2) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-32: CASE 3 KK2) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-3
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield) schedule(runtime)
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = F[(i1+1)*W1+i2];
-                        f1m1 = F[(i1-1)*W1+i2];
-                        f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                        f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];
-                        kk0 = KK2[i1*W1+i2];
-                        kk1p1 = KK2[(i1+1)*W1+i2];
-                        kk1m1 = KK2[(i1-1)*W1+i2];
-                        kk2p1 = KK2[i1*W1+(i2+1)];
-                        kk2m1 = KK2[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-                        elecfield = Efield[i1];
-                        dfx = (xx2 >= 0.0) ? (f0+0.5*kk0) - (f1m1+0.5*kk1m1) : (f1p1+0.5*kk1p1) - (f0+0.5*kk0);
-                        dfp = (elecfield <= 0.0) ? (f0+0.5*kk0) - (f2m1+0.5*kk2m1) : (f2p1+0.5*kk2p1) - (f0+0.5*kk0);
-
-                        KK3[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                        kh1 * charge * elecfield * dfp +
-                                        kgamma * (feq - f0 - 0.5 * kk0);
-
-                        FF[i1*W1+i2] += KK3[i1*W1+i2] / 3.0;              
+                for (int s1 = EDGE, e1; s1 < BoxShape[0] - EDGE; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0] - EDGE);
+                    #pragma omp single nowait
+                    {
+                        ooc.Stream(s1, BoxShape[0] - EDGE, {F, Feq_loc, KK2, KK3, FF});
+                    }
+                    #pragma omp for schedule(runtime)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        UpwindStage<3>(i1, EDGE, BoxShape[1] - EDGE, nullptr, F, KK2, KK3, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<3>(i1, EDGE, BoxShape[1] - EDGE, nullptr, KK3, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                 }
                 #pragma omp single nowait
@@ -2471,36 +2746,22 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-33: CASE 3 KK3) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-33: CASE 3 KK3) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
 
                 // RK4-4
-                #pragma omp for private(xx1,xx2,f0,f1p1,f1m1,f2p1,f2m1,kk0,kk1p1,kk1m1,kk2p1,kk2m1,feq,dfx,dfp,elecfield) schedule(runtime)
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        xx1 = Box[0] + i1 * H[0];
-                        xx2 = Box[2] + i2 * H[1];
-                        f0 = F[i1*W1+i2];
-                        f1p1 = F[(i1+1)*W1+i2];
-                        f1m1 = F[(i1-1)*W1+i2];
-                        f2p1 = (i2+1 >= BoxShape[1]-EDGE) ? Feq_loc[i1*W1+(i2+1)] : F[i1*W1+(i2+1)];
-                        f2m1 = (i2-1 <              EDGE) ? Feq_loc[i1*W1+(i2-1)] : F[i1*W1+(i2-1)];                         
-                        kk0 = KK3[i1*W1+i2];
-                        kk1p1 = KK3[(i1+1)*W1+i2];
-                        kk1m1 = KK3[(i1-1)*W1+i2];
-                        kk2p1 = KK3[i1*W1+(i2+1)];
-                        kk2m1 = KK3[i1*W1+(i2-1)];
-                        feq = Feq_loc[i1*W1+i2];
-                        elecfield = Efield[i1];
-                        dfx = (xx2 >= 0.0) ? (f0+kk0) - (f1m1+kk1m1) : (f1p1+kk1p1) - (f0+kk0);
-                        dfp = (elecfield <= 0.0) ? (f0+kk0) - (f2m1+kk2m1) : (f2p1+kk2p1) - (f0+kk0);
-
-                        KK4[i1*W1+i2] = -kh0m * xx2 * dfx + 
-                                        kh1 * charge * elecfield * dfp +
-                                        kgamma * (feq - f0 - kk0);
-
-                        FF[i1*W1+i2] += KK4[i1*W1+i2] / 6.0;                             
+                for (int s1 = EDGE, e1; s1 < BoxShape[0] - EDGE; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0] - EDGE);
+                    #pragma omp single nowait
+                    {
+                        ooc.Stream(s1, BoxShape[0] - EDGE, {F, Feq_loc, KK3, KK4, FF});
+                    }
+                    #pragma omp for schedule(runtime)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        UpwindStage<4>(i1, EDGE, BoxShape[1] - EDGE, nullptr, F, KK3, KK4, FF, Feq_loc, KRate, Efield[i1], kh0m, khq);
+                        if ( isDeltaF )
+                            AddSource<4>(i1, EDGE, BoxShape[1] - EDGE, nullptr, KK4, FF, NM, MM, Efield[i1], kh0m, khq);
                     }
                 }
                 #pragma omp single nowait
@@ -2508,20 +2769,26 @@ void KleinKramers2d::Evolve()
                     t_1_end = omp_get_wtime();
                     t_1_elapsed = t_1_end - t_1_begin;
                     t_full += t_1_elapsed;
-                    if (!QUIET && TIMING) log->log("Elapsed time (omp-kk-34: CASE 3 KK4) = %lf sec\n", t_1_elapsed);
+                    if (!QUIET && TIMING) tlog.log("Elapsed time (omp-kk-34: CASE 3 KK4) = %lf sec\n", t_1_elapsed);
                     t_1_begin = omp_get_wtime();
                 }
             }
         }
+        if ( isAutoGrid && !isExtrapolate )  {
+            t_auto_core += omp_get_wtime() - t_auto_begin;
+            core_points += isFullGrid ? n_interior : ta_size;
+        }
         // .........................................................................................
 
         // NORMALIZATION AND TRUNCATION
 
         t_1_begin = omp_get_wtime();
+        t_auto_begin = t_1_begin;
 
         // Normalization
 
         norm = 0.0;
+        norm_fm = mass_fm;
 
         if (!isFullGrid)  {
 
@@ -2532,28 +2799,52 @@ void KleinKramers2d::Evolve()
                         norm += FF[i1*W1+i2];
                 }
             }
+
+            // Delta-f: only the f_M under the TA is rescaled with g
+            if ( isDeltaF )  {
+                norm_fm = 0.0;
+
+                #pragma omp parallel for reduction (+:norm_fm)
+                for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
+                    for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
+                        if (TAMask[i1*W1+i2])
+                            norm_fm += NM[i1] * MM[i2];
+                    }
+                }
+                norm_fm *= H[0] * H[1];
+            }
         }  
         else  {
 
-            #pragma omp parallel for reduction (+:norm) 
-            for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
-                for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
-                    norm += FF[i1*W1+i2];
+            for (int s1 = EDGE, e1; s1 < BoxShape[0]-EDGE; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]-EDGE);
+                ooc.Stream(s1, BoxShape[0]-EDGE, {FF});
+                #pragma omp parallel for reduction (+:norm) 
+                for (int i1 = s1; i1 < e1; i1 ++)  {
+                    for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
+                        norm += FF[i1*W1+i2];
+                    }
                 }
             }
         }
         norm *= H[0] * H[1];
+        mass_step = isDeltaF ? norm + mass_fm : norm;
 
         if ( (tt + 1) % PERIOD == 0 )
-            log->log("[KleinKramers2d] Normalization factor = %.16e\n",norm);
+            log->log("[KleinKramers2d] Normalization factor = %.16e\n",mass_step);
         
-        norm = norm_initial / norm; 
+        if ( !isDeltaF )
+            norm = norm_initial / norm; 
+        else  {
+            // Scale f = g + f_M on the TA, f_M off the TA is left as it is
+            norm = ( norm + norm_fm > 0.0 ) ? (norm_initial - mass_fm + norm_fm) / (norm + norm_fm) : 1.0;
+        }
         
         t_1_end = omp_get_wtime();
         t_1_elapsed = t_1_end - t_1_begin;
         t_full += t_1_elapsed;
         t_truncate += t_1_elapsed;
-        if (!QUIET && TIMING) log->log("Elapsed time (omp-e-1-1 Norm) = %lf sec\n", t_1_elapsed);
+        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-1-1 Norm) = %lf sec\n", t_1_elapsed);
         t_1_begin = omp_get_wtime();
 
         if (!isFullGrid)  {
@@ -2561,7 +2852,7 @@ void KleinKramers2d::Evolve()
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                     if (TAMask[i1*W1+i2])  {
-                        val = norm * FF[i1*W1+i2];
+                        val = isDeltaF ? norm * FF[i1*W1+i2] + (norm - 1.0) * NM[i1] * MM[i2] : norm * FF[i1*W1+i2];
                         FF[i1*W1+i2] = val;
                         F[i1*W1+i2] = val;
                         PF[i1*W1+i2] = val;
@@ -2570,13 +2861,17 @@ void KleinKramers2d::Evolve()
             }
         }  
         else  {
-            #pragma omp parallel for private(val) 
-            for (int i1 = EDGE; i1 < BoxShape[0]-EDGE; i1 ++)  {
-                for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
-                    val = norm * FF[i1*W1+i2];
-                    FF[i1*W1+i2] = val;
-                    F[i1*W1+i2] = val;
-                    PF[i1*W1+i2] = val;
+            for (int s1 = EDGE, e1; s1 < BoxShape[0]-EDGE; s1 = e1)  {
+                e1 = ooc.End(s1, BoxShape[0]-EDGE);
+                ooc.Stream(s1, BoxShape[0]-EDGE, {FF, F, PF});
+                #pragma omp parallel for private(val) 
+                for (int i1 = s1; i1 < e1; i1 ++)  {
+                    for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)  {
+                        val = isDeltaF ? norm * FF[i1*W1+i2] + (norm - 1.0) * NM[i1] * MM[i2] : norm * FF[i1*W1+i2];
+                        FF[i1*W1+i2] = val;
+                        F[i1*W1+i2] = val;
+                        PF[i1*W1+i2] = val;
+                    }
                 }
             }
         }
@@ -2584,7 +2879,12 @@ void KleinKramers2d::Evolve()
         t_1_elapsed = t_1_end - t_1_begin;
         t_full += t_1_elapsed;
         t_truncate += t_1_elapsed;
-        if (!QUIET && TIMING) log->log("Elapsed time (omp-e-1-2 FF) = %lf sec\n", t_1_elapsed); 
+        if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-1-2 FF) = %lf sec\n", t_1_elapsed); 
+
+        if ( isAutoGrid )  {
+            t_auto_norm += omp_get_wtime() - t_auto_begin;
+            norm_points += isFullGrid ? n_interior : ta_size;
+        }
 
         if ( (tt + 1) % PERIOD == 0 )
         {
@@ -2606,31 +2906,41 @@ void KleinKramers2d::Evolve()
                     }
                 }
                 else  {
-                    #pragma omp parallel for reduction (+:pftrans)
-                    for (int i1 = idx_x0; i1 < BoxShape[0]-EDGE; i1 ++)  {
-                        for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
-                            pftrans+=PF[i1*W1+i2];
+                    for (int s1 = idx_x0, e1; s1 < BoxShape[0]-EDGE; s1 = e1)  {
+                        e1 = ooc.End(s1, BoxShape[0]-EDGE);
+                        ooc.Stream(s1, BoxShape[0]-EDGE, {PF});
+                        #pragma omp parallel for reduction (+:pftrans)
+                        for (int i1 = s1; i1 < e1; i1 ++)  {
+                            for (int i2 = EDGE; i2 < BoxShape[1]-EDGE; i2 ++)
+                                pftrans+=PF[i1*W1+i2];
+                        }
                     }
                 }
                 pftrans *= H[0] * H[1];
+                if ( isDeltaF )
+                    pftrans += trans_fm;
                 PF_trans.push_back(pftrans);
                 log->log("[KleinKramers2d] idx_x0 = %d\n", idx_x0);
                 log->log("[KleinKramers2d] Time %lf, Trans = %.16e\n", ( tt + 1 ) * kk, pftrans);
                 t_1_end = omp_get_wtime();
                 t_1_elapsed = t_1_end - t_1_begin; 
-                if (!QUIET && TIMING) log->log("Elapsed time (omp-x-2 trans) = %lf sec\n", t_1_elapsed); 
+                if (!QUIET && TIMING) tlog.log("Elapsed time (omp-x-2 trans) = %lf sec\n", t_1_elapsed); 
             }
 
             if (isCorr)  {
 
                 // Density
-                #pragma omp parallel for private(density)
-                for (int i1 = EDGE; i1 < BoxShape[0] - EDGE; i1 ++)  {
-                    density = 0.0;
-                    for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
-                        density += PF[i1*W1+i2]; 
+                for (int s1 = EDGE, e1; s1 < BoxShape[0] - EDGE; s1 = e1)  {
+                    e1 = ooc.End(s1, BoxShape[0] - EDGE);
+                    ooc.Stream(s1, BoxShape[0] - EDGE, {PF});
+                    #pragma omp parallel for private(density)
+                    for (int i1 = s1; i1 < e1; i1 ++)  {
+                        density = 0.0;
+                        for (int i2 = EDGE; i2 < BoxShape[1] - EDGE; i2 ++)  {
+                            density += PF[i1*W1+i2]; 
+                        }
+                        Ft[i1] = isDeltaF ? density * H[1] + NM[i1] * fm0 : density * H[1];
                     }
-                    Ft[i1] = density * H[1];
                 }
 
                 corr = 0.0;
@@ -2650,12 +2960,14 @@ void KleinKramers2d::Evolve()
         {
             t_1_begin = omp_get_wtime();
 
-            #pragma omp parallel for private(b1,nx1,nx2,\
+            #pragma omp parallel for reduction(+: mass_cut) private(b1,nx1,nx2,\
                                             f1p,f1m,f2p,f2m) 
             for (int i1 = x1_min; i1 <= x1_max; i1 ++)  {
                 for (int i2 = x2_min; i2 <= x2_max; i2 ++)  {
                     if (TAMask[i1*W1+i2])  {
-                        if (PF[i1*W1+i2] < TolH)  {
+                        // Delta-f: keep the points the source of f_M feeds
+                        if (Level(PF[i1*W1+i2]) < TolH && \
+                            !(isDeltaF && std::abs(Source(i1, i2, NM, MM, Efield[i1], kh0m, khq)) > TolH * KRate[i2]))  {
 
                             nx1 = int(TAMask[(i1+1)*W1+i2]) + int(TAMask[(i1-1)*W1+i2]);
                             nx2 = int(TAMask[i1*W1+(i2+1)]) + int(TAMask[i1*W1+(i2-1)]);
@@ -2668,8 +2980,10 @@ void KleinKramers2d::Evolve()
                             b1 = ((nx1 == 0) ? 0.0 : pow(std::abs(f1p - f1m)/(nx1*H[0]),2)) + \
                                  ((nx2 == 0) ? 0.0 : pow(std::abs(f2p - f2m)/(nx2*H[1]),2)) < TolHd_sq;
 
-                            if (b1)
+                            if (b1)  {
+                                mass_cut += PF[i1*W1+i2];
                                 PF[i1*W1+i2] = 0.0;
+                            }
                         }
                     }
                 }
@@ -2677,7 +2991,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-3-1 TA) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-3-1 TA) = %.4e sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
             #pragma omp parallel for 
@@ -2696,10 +3010,14 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-3-2 TA) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-3-2 TA) = %.4e sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
 
+            // Delta-f: seed the TA with the support of the source
+            if ( isDeltaF )
+                SeedSource(TAMask, NM, MM, KRate, Efield, kh0m, khq);
+
             // Rebuild TA box
 
             t_1_begin = omp_get_wtime();
@@ -2728,7 +3046,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-4 TA rebuild) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-4 TA rebuild) = %.4e sec\n", t_1_elapsed);
 
             // TB
             t_1_begin = omp_get_wtime();
@@ -2755,7 +3073,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-5 TB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-5 TB) = %lf sec\n", t_1_elapsed);
 
             // `````````````````````````````````````````````````````````````````
 
@@ -2781,7 +3099,7 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-6 TAEX-A) = %.4e sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-6 TAEX-A) = %.4e sec\n", t_1_elapsed);
             t_1_begin = omp_get_wtime();
 
             #pragma omp parallel for reduction(min: x1_min, x2_min) \
@@ -2811,9 +3129,35 @@ void KleinKramers2d::Evolve()
             t_1_end = omp_get_wtime();
             t_1_elapsed = t_1_end - t_1_begin;
             t_overhead += t_1_elapsed;
-            if (!QUIET && TIMING) log->log("Elapsed time (omp-e-7 TARB) = %lf sec\n", t_1_elapsed);
+            if (!QUIET && TIMING) tlog.log("Elapsed time (omp-e-7 TARB) = %lf sec\n", t_1_elapsed);
         }
 
+        if ( isAutoGrid )  {
+            t_auto_step += omp_get_wtime() - t_0_begin;
+            auto_points += isFullGrid ? n_interior : ta_size;
+            auto_steps += 1;
+        }
+
+        // Cell updates counted as in the auto-grid cost model
+        if ( meter.isEnabled() )  {
+            meter.update();
+            cell_updates += isFullGrid ? n_interior : ta_size;
+        }
+
+        // Truncation telemetry (no TA box in full-grid rows, written as -1)
+
+        if ( pfile_telemetry != NULL && (tt + 1) % TELEMETRY_PERIOD == 0 )  {
+            fprintf(pfile_telemetry, "%d,%.6e,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.16e,%.6e,%.6e,%.6e,%.6e,%.6e\n",
+                    tt + 1, ( tt + 1 ) * kk, (int) isFullGrid,
+                    isFullGrid ? GRIDS_TOT : ta_size, isFullGrid ? 0 : (int) TB.size(), tbl_points, ex_points,
+                    isFullGrid ? -1 : x1_min, isFullGrid ? -1 : x1_max, isFullGrid ? -1 : x2_min, isFullGrid ? -1 : x2_max, Excount,
+                    mass_step, mass_cut * H[0] * H[1], mass_ex * H[0] * H[1],
+                    isFullGrid ? t_full : t_truncate, isFullGrid ? 0.0 : t_overhead, omp_get_wtime() - t_0_begin);
+            fflush(pfile_telemetry);
+        }
+
+        tlog.flush();
+
         if ( (tt + 1) % PERIOD == 0 )
         {   
             t_0_end = omp_get_wtime();
@@ -2834,25 +3178,48 @@ void KleinKramers2d::Evolve()
 
                 log->log("[KleinKramers2d] Core computation time = %lf\n", t_full);
             }
+            if ( meter.isEnabled() && !QUIET )  {
+                log->log("[KleinKramers2d] Energy = %lf J, %.4e J/step\n", meter.total() - energy_period, (meter.total() - energy_period) / PERIOD);
+                energy_period = meter.total();
+            }
             if ( !QUIET ) log->log("\n........................................................\n\n");
         }         
     } // Time iteration 
 
-    delete F;
-    delete Feq_loc;
-    delete FF;
-    delete PF;
-    delete KK1;
-    delete KK2;
-    delete KK3;
-    delete KK4;
+    if ( pfile_telemetry != NULL )
+        fclose(pfile_telemetry);
+
+    ooc.free(F);
+    ooc.free(Feq_loc);
+    ooc.free(FF);
+    ooc.free(PF);
+    ooc.free(KK1);
+    ooc.free(KK2);
+    ooc.free(KK3);
+    ooc.free(KK4);
     delete Density;
     delete Velocity;
     delete Temperature;
+    delete KRate;
 
-    if ( !isFullGrid )
+    if ( isDeltaF )  {
+        delete NM;
+        delete MM;
+    }
+
+    if ( !isFullGrid || isAutoGrid )
         delete TAMask;
 
+    if ( meter.isEnabled() )  {
+        meter.update();
+        const int nsteps_energy = (int)(TIME / kk);
+        const double energy_loop = meter.total() - energy_iter;
+        log->log("[KleinKramers2d] Energy: initialization %lf J, time iteration %lf J\n", energy_iter, energy_loop);
+        log->log("[KleinKramers2d] Energy: package %lf J, DRAM %lf J\n", meter.package(), meter.dram());
+        if ( nsteps_energy > 0 && cell_updates > 0.0 )
+            log->log("[KleinKramers2d] Energy per step = %.4e J, per cell update = %.4e J\n", energy_loop / nsteps_energy, energy_loop / cell_updates);
+    }
+
     log->log("[KleinKramers2d] Evolve done.\n");
 }
 /* =============================================================================== */
@@ -2984,3 +3351,266 @@ inline int KleinKramers2d::GridToIdx(int x1, int x2)
     return (int)(x1 * M1 + x2);
 }
 /* ------------------------------------------------------------------------------- */
+
+template <int STAGE, bool XUP, bool PUP>
+inline void KleinKramers2d::UpwindKernel(int i1, int j0, int j1, const double *Fp, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // One RK4 stage over columns [j0, j1) of row i1. The upwind directions are
+    // fixed by XUP (p >= 0) and PUP (E <= 0), so the loop body has no branches.
+    // Fp is the source of the momentum neighbour: Feq_loc on the peeled edge
+    // columns, F elsewhere.
+    const double c = (STAGE == 4) ? 1.0 : 0.5;
+    const double b2 = Box[2];
+    const double h2 = H[1];
+    const int o = i1 * W1;
+    const int sx = XUP ? -W1 : W1;
+    const int sp = PUP ? -1 : 1;
+    double xx2, f0, f1, f2, kk0, kk1, kk2, feq, dfx, dfp, kknew;
+
+    #pragma omp simd private(xx2,f0,f1,f2,kk0,kk1,kk2,feq,dfx,dfp,kknew)
+    for (int i2 = j0; i2 < j1; i2 ++)  {
+        xx2 = b2 + i2 * h2;
+        f0 = F[o+i2];
+        f1 = F[o+sx+i2];
+        f2 = Fp[o+sp+i2];
+        feq = Feq_loc[o+i2];
+
+        if (STAGE == 1)  {
+            dfx = XUP ? f0 - f1 : f1 - f0;
+            dfp = PUP ? f0 - f2 : f2 - f0;
+
+            kknew = -kh0m * xx2 * dfx + 
+                    khq * elecfield * dfp +
+                    KRate[i2] * (feq - f0);
+
+            KKout[o+i2] = kknew;
+            FF[o+i2] = f0 + kknew / 6.0;
+        }
+        else  {
+            kk0 = KKin[o+i2];
+            kk1 = KKin[o+sx+i2];
+            kk2 = KKin[o+sp+i2];
+            dfx = XUP ? (f0+c*kk0) - (f1+c*kk1) : (f1+c*kk1) - (f0+c*kk0);
+            dfp = PUP ? (f0+c*kk0) - (f2+c*kk2) : (f2+c*kk2) - (f0+c*kk0);
+
+            kknew = -kh0m * xx2 * dfx + 
+                    khq * elecfield * dfp +
+                    KRate[i2] * (feq - f0 - c * kk0);
+
+            KKout[o+i2] = kknew;
+            FF[o+i2] += (STAGE == 4) ? kknew / 6.0 : kknew / 3.0;
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+template <int STAGE, bool PUP>
+inline void KleinKramers2d::UpwindSpan(int i1, int j0, int j1, const double *Fp, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // Split [j0, j1) at the sign change of p
+    int jp = std::min(std::max(IDX_P0, j0), j1);
+
+    if (j0 < jp)
+        UpwindKernel<STAGE,false,PUP>(i1, j0, jp, Fp, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    if (jp < j1)
+        UpwindKernel<STAGE,true,PUP>(i1, jp, j1, Fp, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+}
+/* ------------------------------------------------------------------------------- */
+
+template <int STAGE>
+inline void KleinKramers2d::UpwindRow(int i1, int j0, int j1, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // Peel the columns whose upwind momentum neighbour lies in the edge,
+    // where Feq_loc stands in for F.
+    int je;
+
+    if (elecfield <= 0.0)  {
+        je = std::min(std::max(EDGE + 1, j0), j1);
+        UpwindSpan<STAGE,true>(i1, j0, je, Feq_loc, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+        UpwindSpan<STAGE,true>(i1, je, j1, F, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    }
+    else  {
+        je = std::min(std::max(BoxShape[1] - EDGE - 1, j0), j1);
+        UpwindSpan<STAGE,false>(i1, j0, je, F, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+        UpwindSpan<STAGE,false>(i1, je, j1, Feq_loc, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+template <int STAGE>
+inline void KleinKramers2d::UpwindMaskedRow(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // Run the row kernel over each contiguous TA run in [j0, j1)
+    const bool *mask = TAMask + i1 * W1;
+    int i2 = j0;
+    int r0;
+
+    while (i2 < j1)  {
+        while (i2 < j1 && !mask[i2]) i2 ++;
+        r0 = i2;
+        while (i2 < j1 && mask[i2]) i2 ++;
+        if (r0 < i2)
+            UpwindRow<STAGE>(i1, r0, i2, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+template <int STAGE>
+inline void KleinKramers2d::AddSource(int i1, int j0, int j1, const bool *TAMask, double *KKout, double *FF, const double *NM, const double *MM, double elecfield, double kh0m, double khq)
+{
+    // The source does not depend on g, so every stage of row i1 adds the
+    // same value on the TA points of [j0, j1)
+    const int o = i1 * W1;
+    double src;
+
+    for (int i2 = j0; i2 < j1; i2 ++)  {
+        if (TAMask && !TAMask[o+i2])
+            continue;
+        src = Source(i1, i2, NM, MM, elecfield, kh0m, khq);
+        KKout[o+i2] += src;
+        FF[o+i2] += (STAGE == 1 || STAGE == 4) ? src / 6.0 : src / 3.0;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+inline double KleinKramers2d::Source(int i1, int i2, const double *NM, const double *MM, double elecfield, double kh0m, double khq)
+{
+    // Drift and field terms of the stage operator on f_M, upwinded as in
+    // UpwindKernel. MM is zero on the edge columns, where Feq_loc stands in.
+    const double xx2 = Box[2] + i2 * H[1];
+    const double dfx = (xx2 >= 0.0) ? NM[i1] - NM[i1-1] : NM[i1+1] - NM[i1];
+    const double dfp = (elecfield <= 0.0) ? MM[i2] - MM[i2-1] : MM[i2+1] - MM[i2];
+
+    return -kh0m * xx2 * dfx * MM[i2] + khq * elecfield * NM[i1] * dfp;
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::SeedSource(bool *TAMask, const double *NM, const double *MM, const double *KRate, const double *Efield, double kh0m, double khq)
+{
+    // Add the points where the source alone holds |g| above TolH over a
+    // relaxation time
+    #pragma omp parallel for
+    for (int i1 = EDGE + 1; i1 < BoxShape[0] - EDGE - 1; i1 ++)  {
+        for (int i2 = EDGE + 1; i2 < BoxShape[1] - EDGE - 1; i2 ++)  {
+            if ( std::abs(Source(i1, i2, NM, MM, Efield[i1], kh0m, khq)) > TolH * KRate[i2] )
+                TAMask[i1*W1+i2] = 1;
+        }
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+inline double KleinKramers2d::Level(double f)
+{
+    // g changes sign, the tolerances then apply to |g|
+    return isDeltaF ? std::abs(f) : f;
+}
+/* ------------------------------------------------------------------------------- */
+
+inline double KleinKramers2d::Extrapolate(double f1, double f2)
+{
+    // Log-linear tail through f2, f1. For g both have to share a sign,
+    // NAN otherwise, which the callers drop.
+    if ( !isDeltaF )
+        return exp( 2.0 * std::log(f1) - std::log(f2) );
+
+    return (f1 * f2 > 0.0) ? std::copysign(exp( 2.0 * std::log(std::abs(f1)) - std::log(std::abs(f2)) ), f1) : NAN;
+}
+/* ------------------------------------------------------------------------------- */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+template <int STAGE>
+__attribute__((target("sse4.2"), optimize("fp-contract=off"), flatten))
+void KleinKramers2d::UpwindStageSSE42(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // Row stage with the kernels inlined and compiled for SSE4.2
+    if (TAMask)
+        UpwindMaskedRow<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    else
+        UpwindRow<STAGE>(i1, j0, j1, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+}
+/* ------------------------------------------------------------------------------- */
+
+template <int STAGE>
+__attribute__((target("avx2"), optimize("fp-contract=off"), flatten))
+void KleinKramers2d::UpwindStageAVX2(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // Row stage for AVX2. FMA is left out so every variant rounds alike.
+    if (TAMask)
+        UpwindMaskedRow<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    else
+        UpwindRow<STAGE>(i1, j0, j1, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+}
+/* ------------------------------------------------------------------------------- */
+
+template <int STAGE>
+__attribute__((target("avx512f"), optimize("fp-contract=off"), flatten))
+void KleinKramers2d::UpwindStageAVX512(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    // Row stage for AVX-512
+    if (TAMask)
+        UpwindMaskedRow<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    else
+        UpwindRow<STAGE>(i1, j0, j1, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+}
+/* ------------------------------------------------------------------------------- */
+
+#endif
+
+template <int STAGE>
+inline void KleinKramers2d::UpwindStage(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq)
+{
+    switch (KERNEL_ISA)  {
+#if defined(__x86_64__) && defined(__GNUC__)
+        case KISA_AVX512:
+            UpwindStageAVX512<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+            return;
+        case KISA_AVX2:
+            UpwindStageAVX2<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+            return;
+        case KISA_SSE42:
+            UpwindStageSSE42<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+            return;
+#endif
+        default:
+            if (TAMask)
+                UpwindMaskedRow<STAGE>(i1, j0, j1, TAMask, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+            else
+                UpwindRow<STAGE>(i1, j0, j1, F, KKin, KKout, FF, Feq_loc, KRate, elecfield, kh0m, khq);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void KleinKramers2d::SelectKernelISA(std::string request)
+{
+    // Best variant the CPU and OS support, or the one requested if it is
+    // supported. Anything else falls back to the baseline build.
+    const char *names[] = {"base", "sse4.2", "avx2", "avx512"};
+    int best = KISA_BASE;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        best = KISA_AVX512;
+    else if (__builtin_cpu_supports("avx2"))
+        best = KISA_AVX2;
+    else if (__builtin_cpu_supports("sse4.2"))
+        best = KISA_SSE42;
+#endif
+
+    KERNEL_ISA = best;
+
+    if ( request != "auto" )  {
+        int want = -1;
+        for (int i = KISA_BASE; i <= KISA_AVX512; i ++)  {
+            if ( request == names[i] )
+                want = i;
+        }
+        if ( want < 0 || want > best )
+            log->log("[KleinKramers2d] Kernel ISA %s is not available\n", request.c_str());
+        else
+            KERNEL_ISA = want;
+    }
+    log->log("[KleinKramers2d] Kernel ISA: %s (CPU supports %s)\n", names[KERNEL_ISA], names[best]);
+}
+/* ------------------------------------------------------------------------------- */
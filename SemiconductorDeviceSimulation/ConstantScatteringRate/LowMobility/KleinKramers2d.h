@@ -16,6 +16,7 @@
 #define QTR_KLEINKRAMERS2D_H
 
 #include <complex>
+#include <string>
 
 #include "Containers.h"
 #include "Eigen.h"
@@ -49,6 +50,40 @@ namespace QTR_NS {
     private:
 
         void            init();
+        void            AutoBox();
+        void            SnapBox(int dim, double lo, double hi);
+
+        // Upwind RK4 stage kernels, split by the sign of p and E
+        template <int STAGE, bool XUP, bool PUP>
+        inline void     UpwindKernel(int i1, int j0, int j1, const double *Fp, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        template <int STAGE, bool PUP>
+        inline void     UpwindSpan(int i1, int j0, int j1, const double *Fp, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        template <int STAGE>
+        inline void     UpwindRow(int i1, int j0, int j1, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        template <int STAGE>
+        inline void     UpwindMaskedRow(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+
+        // Delta-f: the stage operator on f_M added to a row stage on the TA,
+        // its support, and the truncation value and tail extrapolation of g
+        template <int STAGE>
+        inline void     AddSource(int i1, int j0, int j1, const bool *TAMask, double *KKout, double *FF, const double *NM, const double *MM, double elecfield, double kh0m, double khq);
+        inline double   Source(int i1, int i2, const double *NM, const double *MM, double elecfield, double kh0m, double khq);
+        void            SeedSource(bool *TAMask, const double *NM, const double *MM, const double *KRate, const double *Efield, double kh0m, double khq);
+        inline double   Level(double f);
+        inline double   Extrapolate(double f1, double f2);
+
+        // ISA variants of a row stage, TAMask == nullptr for the full row.
+        // UpwindStage calls the one picked by SelectKernelISA().
+        enum { KISA_BASE, KISA_SSE42, KISA_AVX2, KISA_AVX512 };
+        template <int STAGE>
+        inline void     UpwindStage(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        template <int STAGE>
+        void            UpwindStageSSE42(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        template <int STAGE>
+        void            UpwindStageAVX2(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        template <int STAGE>
+        void            UpwindStageAVX512(int i1, int j0, int j1, const bool *TAMask, const double *F, const double *KKin, double *KKout, double *FF, const double *Feq_loc, const double *KRate, double elecfield, double kh0m, double khq);
+        void            SelectKernelISA(std::string request);
         QTR             *qtr;
         Error           *err;
         Log             *log;
@@ -62,10 +97,19 @@ namespace QTR_NS {
         int             PERIOD;
         int             SORT_PERIOD;
         int             PRINT_PERIOD;
+        int             TELEMETRY_PERIOD; // steps between telemetry.csv records, 0 if disabled
         int             PRINT_WAVEFUNC_PERIOD;
+        int             AUTO_GRID_PERIOD;
+        int             OOC_SLAB;       // x1 rows per out-of-core slab
+        std::string     OOC_DIR;        // scratch directory of the mapped arrays, empty if in memory
+        int             SHM_PERIOD;
+        int             SHM_SLOTS;
+        std::string     SHM_NAME;       // shared-memory moment ring, empty if disabled
         int             GRIDS_TOT;
         bool            QUIET;
         bool            TIMING;
+        std::string     TIMING_LOG;  // file of the per-region timing lines, empty for the log
+        bool            ENERGY;      // RAPL energy of the time iteration
         double          TIME;   
         double          PI_INV;  // 1/pi
         double          HBSQ_INV; // (1/hb)^2
@@ -83,6 +127,8 @@ namespace QTR_NS {
         int             M1;
         int             W1;
         int             O1;
+        int             IDX_P0;  // first momentum index with p >= 0
+        int             KERNEL_ISA;  // KISA_* variant of the stage kernels
 
         // Potential parameters
         int             idx_x0; 
@@ -110,6 +156,8 @@ namespace QTR_NS {
 
         // Truncate parameters
         bool            isFullGrid; 
+        bool            isAutoGrid;    // switch between TG and FG at runtime
+        bool            isAutoBox;     // derive the box from the physics, user box as bound
         bool            isExtrapolate;  
         bool            isTouchBoundary;       
         double          TolH;
@@ -117,6 +165,8 @@ namespace QTR_NS {
         double          TolHd;
         double          TolLd;
         double          ExReduce;
+        double          AutoGridThreshold;
+        double          AutoBoxTol;
         int             ExLimit;
 
         // Domains
@@ -143,6 +193,9 @@ namespace QTR_NS {
         // Condition for Local Maxwellian
         bool            isIsothermal;
         bool            isLinearizedCollision;
+
+        // Delta-f: F holds g = f - f_M, f_M the doping times the Maxwellian
+        bool            isDeltaF;
     };
 }
 
@@ -105,6 +105,8 @@ int Parameters::load(FILE *file){
         writeLog    = ini.GetValueB("MAIN", "write_log", writeLog);
         // SCATTERXD //
         scxd_isFullGrid = ini.GetValueB("SCATTERXD", "isFullGrid", 1);  
+        scxd_isAutoGrid = ini.GetValueB("SCATTERXD", "isAutoGrid", 0);
+        scxd_isAutoBox  = ini.GetValueB("SCATTERXD", "isAutoBox", 0);
         scxd_isTrans    = ini.GetValueB("SCATTERXD", "isTrans", 1);
         scxd_isAcf      = ini.GetValueB("SCATTERXD", "isAcf", 1);
         scxd_isPrintEdge = ini.GetValueB("SCATTERXD", "isPrintEdge", 0);
@@ -116,14 +118,20 @@ int Parameters::load(FILE *file){
         scxd_isPrintWavefunc = ini.GetValueB("SCATTERXD", "isPrintWavefunc", 0);
         scxd_isIsothermal = ini.GetValueB("SCATTERXD", "isIsothermal", 0);
         scxd_isLinearizedCollision = ini.GetValueB("SCATTERXD", "isLinearizedCollision", 0);
+        scxd_isDeltaF = ini.GetValueB("SCATTERXD", "isDeltaF", 0);
         scxd_isDensityMatrix = ini.GetValueB("SCATTERXD", "isDensityMatrix", 0);
         scxd_isModCL         = ini.GetValueB("SCATTERXD", "isModCL", 0);
         scxd_isDampX1        = ini.GetValueB("SCATTERXD", "isDampX1", 0);
         scxd_isDampX2        = ini.GetValueB("SCATTERXD", "isDampX2", 0);
         scxd_dimensions = ini.GetValueI("SCATTERXD", "dimensions", 3);  
         scxd_period = ini.GetValueI("SCATTERXD", "period", 100);
+        scxd_autogridperiod = ini.GetValueI("SCATTERXD", "autogridperiod", 100);
+        scxd_oocslab = ini.GetValueI("SCATTERXD", "oocslab", 64);
+        scxd_shmperiod = ini.GetValueI("SCATTERXD", "shmperiod", 100);
+        scxd_shmslots = ini.GetValueI("SCATTERXD", "shmslots", 8);
         scxd_sortperiod = ini.GetValueI("SCATTERXD", "sortperiod", 100);
         scxd_printperiod = ini.GetValueI("SCATTERXD", "printperiod", 100);
+        scxd_telemetryperiod = ini.GetValueI("SCATTERXD", "telemetryperiod", 0);
         scxd_printwavefuncperiod = ini.GetValueI("SCATTERXD", "printwavefuncperiod", 100);
         scxd_cfactor = ini.GetValueI("SCATTERXD", "cfactor", 1);
         scxd_skin    = ini.GetValueI("SCATTERXD", "skin", 5);
@@ -171,6 +179,8 @@ int Parameters::load(FILE *file){
         scxd_TolHd    = ini.GetValueF("SCATTERXD", "TolHd", 0);
         scxd_TolLd    = ini.GetValueF("SCATTERXD", "TolLd", 0);
         scxd_ExReduce = ini.GetValueF("SCATTERXD", "ExReduce", 0);
+        scxd_AutoGridThreshold = ini.GetValueF("SCATTERXD", "AutoGridThreshold", 0.2);
+        scxd_AutoBoxTol = ini.GetValueF("SCATTERXD", "AutoBoxTol", 1e-8);
         scxd_Vmode_1  = ini.GetValueI("SCATTERXD", "Vmode_1", 0);
         scxd_Vmode_2  = ini.GetValueI("SCATTERXD", "Vmode_2", 0);
         scxd_Vmode_3  = ini.GetValueI("SCATTERXD", "Vmode_3", 0);
@@ -205,6 +215,11 @@ int Parameters::load(FILE *file){
         scxd_omega  = ini.GetValueF("SCATTERXD", "omega", 1.0);       // Phase
         scxd_trans_x0 = ini.GetValueF("SCATTERXD", "trans_x0", 0.0);    
         scxd_quantumness = ini.GetValueF("SCATTERXD", "quantumness", 1.0);    
+        scxd_oocdir = ini.GetValue("SCATTERXD", "oocdir", "");
+        scxd_shmname = ini.GetValue("SCATTERXD", "shmname", "");
+        scxd_kernelisa = toLowerCase(ini.GetValue("SCATTERXD", "kernelisa", "auto"));
+        scxd_timinglog = ini.GetValue("SCATTERXD", "timinglog", "");
+        scxd_energy = ini.GetValueB("SCATTERXD", "energy", false);
         scxd_edge   = ini.GetValueI("SCATTERXD", "edge", 2);          // Edge size
        
         // RANDOM //
@@ -0,0 +1,196 @@
+// ==============================================================================
+//
+//  EnergyMeter.cpp
+//  QTR
+//
+//  Note: The counter files stay open and are re-read with pread, so an
+//        update() is a few system calls. Top-level zones that are not a
+//        package (psys) are skipped: they cover the packages and would count
+//        them twice.
+//
+// ==============================================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "EnergyMeter.h"
+
+using namespace QTR_NS;
+using std::string;
+
+#define RAPL_ROOT  "/sys/class/powercap/intel-rapl:"
+#define RAPL_ZONES 64
+
+/* ------------------------------------------------------------------------------- */
+
+EnergyMeter::EnergyMeter()
+{
+    return;
+}
+/* ------------------------------------------------------------------------------- */
+
+EnergyMeter::~EnergyMeter()
+{
+    close();
+}
+/* ------------------------------------------------------------------------------- */
+
+int EnergyMeter::open()
+{
+    char dir[128];
+    string name;
+
+    close();
+
+    for (int n = 0; n < RAPL_ZONES; n ++)  {
+
+        snprintf(dir, sizeof(dir), RAPL_ROOT "%d", n);
+        name = ReadLine(string(dir) + "/name");
+
+        if ( name.compare(0, 7, "package") != 0 )
+            continue;
+
+        AddZone(dir, false);
+
+        for (int s = 0; s < RAPL_ZONES; s ++)  {
+            snprintf(dir, sizeof(dir), RAPL_ROOT "%d:%d", n, s);
+            name = ReadLine(string(dir) + "/name");
+            if ( name.length() == 0 )
+                break;
+            if ( name == "dram" )
+                AddZone(dir, true);
+        }
+    }
+    return (int) Zones.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+bool EnergyMeter::isEnabled()
+{
+    return Zones.size() > 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnergyMeter::update()
+{
+    uint64_t v, delta;
+
+    for (unsigned int i = 0; i < Zones.size(); i ++)  {
+
+        Zone &z = Zones[i];
+
+        if ( !ReadU64(z.fd, v) )
+            continue;
+
+        if ( v >= z.last )
+            delta = v - z.last;
+        else
+            delta = ( z.range > z.last ) ? z.range - z.last + v : v;
+
+        z.joules += delta * 1.0e-6;
+        z.last = v;
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+double EnergyMeter::package()
+{
+    double e = 0.0;
+
+    for (unsigned int i = 0; i < Zones.size(); i ++)
+        if ( !Zones[i].isDram )
+            e += Zones[i].joules;
+    return e;
+}
+/* ------------------------------------------------------------------------------- */
+
+double EnergyMeter::dram()
+{
+    double e = 0.0;
+
+    for (unsigned int i = 0; i < Zones.size(); i ++)
+        if ( Zones[i].isDram )
+            e += Zones[i].joules;
+    return e;
+}
+/* ------------------------------------------------------------------------------- */
+
+double EnergyMeter::total()
+{
+    return package() + dram();
+}
+/* ------------------------------------------------------------------------------- */
+
+string EnergyMeter::zones()
+{
+    string s;
+
+    for (unsigned int i = 0; i < Zones.size(); i ++)
+        s += ( i > 0 ? ", " : "" ) + Zones[i].name;
+    return s;
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnergyMeter::close()
+{
+    for (unsigned int i = 0; i < Zones.size(); i ++)
+        ::close(Zones[i].fd);
+    Zones.clear();
+}
+/* ------------------------------------------------------------------------------- */
+
+void EnergyMeter::AddZone(string dir, bool isDram)
+{
+    Zone z;
+
+    z.fd = ::open((dir + "/energy_uj").c_str(), O_RDONLY);
+
+    if ( z.fd < 0 )
+        return;
+
+    if ( !ReadU64(z.fd, z.last) )  {
+        ::close(z.fd);
+        return;
+    }
+    z.range = strtoull(ReadLine(dir + "/max_energy_range_uj").c_str(), NULL, 10);
+    z.name = dir.substr(dir.rfind('/') + 1) + ( isDram ? " (dram)" : " (package)" );
+    z.isDram = isDram;
+    z.joules = 0.0;
+    Zones.push_back(z);
+}
+/* ------------------------------------------------------------------------------- */
+
+bool EnergyMeter::ReadU64(int fd, uint64_t &v)
+{
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+
+    if ( n <= 0 )
+        return false;
+
+    buf[n] = '\0';
+    v = strtoull(buf, NULL, 10);
+    return true;
+}
+/* ------------------------------------------------------------------------------- */
+
+string EnergyMeter::ReadLine(string path)
+{
+    char buf[64];
+    string s;
+    FILE *pfile = fopen(path.c_str(), "r");
+
+    if ( pfile == NULL )
+        return s;
+
+    if ( fgets(buf, sizeof(buf), pfile) != NULL )  {
+        s = buf;
+        while ( s.length() > 0 && ( s[s.length()-1] == '\n' || s[s.length()-1] == ' ' ) )
+            s.erase(s.length() - 1);
+    }
+    fclose(pfile);
+    return s;
+}
+/* ------------------------------------------------------------------------------- */
@@ -0,0 +1,159 @@
+// ==============================================================================
+//
+//  OutOfCore.cpp
+//  QTR
+//
+//  Note: Scratch files are unlinked right after mapping, so they disappear
+//        with the process. MAP_SHARED keeps dropped pages in the file.
+//
+// ==============================================================================
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "OutOfCore.h"
+
+using namespace QTR_NS;
+using std::string;
+
+/* ------------------------------------------------------------------------------- */
+
+OutOfCore::OutOfCore()
+{
+    dir = "";
+    rows = 0;
+    width = 0;
+    slab = 0;
+    halo = 0;
+    page = (size_t) sysconf(_SC_PAGESIZE);
+}
+/* ------------------------------------------------------------------------------- */
+
+OutOfCore::~OutOfCore()
+{
+    for (unsigned int i = 0; i < Maps.size(); i ++)
+        munmap(Maps[i].ptr, Maps[i].bytes);
+}
+/* ------------------------------------------------------------------------------- */
+
+void OutOfCore::open(string dir_in, int rows_in, int width_in, int slab_in, int halo_in)
+{
+    dir = dir_in;
+    rows = rows_in;
+    width = width_in;
+    halo = halo_in;
+    slab = ( dir.length() > 0 && slab_in > 0 ) ? slab_in : 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+bool OutOfCore::isEnabled()
+{
+    return slab > 0;
+}
+/* ------------------------------------------------------------------------------- */
+
+int OutOfCore::mapped()
+{
+    return (int) Maps.size();
+}
+/* ------------------------------------------------------------------------------- */
+
+double *OutOfCore::alloc(size_t n)
+{
+    Mapping map;
+    string path = dir + "/qtr_ooc_XXXXXX";
+    int fd;
+    void *ptr;
+
+    if ( !isEnabled() )
+        return new double[n];
+
+    map.bytes = n * sizeof(double);
+    fd = mkstemp(&path[0]);
+
+    if (fd < 0)
+        return new double[n];
+
+    unlink(path.c_str());
+
+    if ( ftruncate(fd, (off_t) map.bytes) != 0 )  {
+        close(fd);
+        return new double[n];
+    }
+    ptr = mmap(NULL, map.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED)
+        return new double[n];
+
+    madvise(ptr, map.bytes, MADV_SEQUENTIAL);
+    map.ptr = (double *) ptr;
+    Maps.push_back(map);
+
+    return map.ptr;
+}
+/* ------------------------------------------------------------------------------- */
+
+void OutOfCore::free(double *p)
+{
+    for (unsigned int i = 0; i < Maps.size(); i ++)  {
+        if ( Maps[i].ptr == p )  {
+            munmap(Maps[i].ptr, Maps[i].bytes);
+            Maps.erase(Maps.begin() + i);
+            return;
+        }
+    }
+    delete[] p;
+}
+/* ------------------------------------------------------------------------------- */
+
+void OutOfCore::Stream(int s, int r1, std::initializer_list<const double *> arrays)
+{
+    int e = End(s, r1);
+
+    if ( !isEnabled() )
+        return;
+
+    for (const double *p : arrays)  {
+
+        // This slab and the next one with their halo are read ahead
+        Advise(p, s - halo, End(e, r1) + halo, MADV_WILLNEED);
+
+        // The slab behind is out of every stencil but its last halo rows
+        Advise(p, s - slab - halo, s - halo, MADV_DONTNEED);
+    }
+}
+/* ------------------------------------------------------------------------------- */
+
+void OutOfCore::Advise(const double *p, int r0, int r1, int advice)
+{
+    size_t row = (size_t) width * sizeof(double);
+    size_t b0, b1;
+
+    r0 = ( r0 < 0 ) ? 0 : r0;
+    r1 = ( r1 > rows ) ? rows : r1;
+
+    if ( r0 >= r1 )
+        return;
+
+    // Arrays on the heap are left alone
+    for (unsigned int i = 0; i < Maps.size(); i ++)  {
+
+        if ( Maps[i].ptr != p )
+            continue;
+
+        // madvise needs a page-aligned start; a release stops short of the
+        // page that holds row r1
+        b0 = ( r0 * row ) / page * page;
+        b1 = ( r1 * row < Maps[i].bytes ) ? r1 * row : Maps[i].bytes;
+
+        if ( advice == MADV_DONTNEED && b1 < Maps[i].bytes )
+            b1 = b1 / page * page;
+
+        if ( b1 > b0 )
+            madvise((char *) Maps[i].ptr + b0, b1 - b0, advice);
+    }
+}
+/* ------------------------------------------------------------------------------- */
@@ -0,0 +1,53 @@
+// ==============================================================================
+//
+//  SpectralShift.h
+//  QTR
+//
+//  Note: Exact shift f(x) -> f(x - s) of periodic grid functions, done in
+//        Fourier space. Two real sequences share one complex FFT. Lengths
+//        that are not a power of 2 go through Bluestein's algorithm.
+//        Transform exposes the plain complex DFT for other spectral steps.
+//
+// ==============================================================================
+
+#ifndef QTR_SPECTRALSHIFT_H
+#define QTR_SPECTRALSHIFT_H
+
+#include <complex>
+#include <vector>
+
+namespace QTR_NS {
+
+    class SpectralShift {
+
+    public:
+        SpectralShift();
+        ~SpectralShift();
+
+        void            init(int n, double h);
+        int             workSize();
+
+        // Shift a[j*stride] by sa and b[j*stride] by sb; b may be NULL
+        void            Shift2(double *a, double *b, int stride, double sa, double sb,
+                               std::complex<double> *work);
+
+        // DFT of x[j*stride] in place, or its inverse including the 1/n
+        void            Transform(std::complex<double> *x, int stride, bool isInverse,
+                                  std::complex<double> *work);
+        double          Wavenumber(int k);
+
+    private:
+        void            DFT(std::complex<double> *x, std::complex<double> *work);
+        void            Radix2(std::complex<double> *x, int len);
+
+        int             n;
+        int             M;      // radix-2 length, n or the Bluestein padding
+        bool            isPow2;
+        std::vector<double> K;  // wavenumber of each mode
+        std::vector<std::complex<double>> Roots;
+        std::vector<std::complex<double>> Chirp;
+        std::vector<std::complex<double>> ChirpF;
+    };
+}
+
+#endif /* QTR_SPECTRALSHIFT_H */
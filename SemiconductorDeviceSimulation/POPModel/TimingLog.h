@@ -0,0 +1,172 @@
+// ==============================================================================
+//
+//  TimingLog.h
+//  QTR
+//
+//  Note: Deferred log for the per-region timing lines of the time loop.
+//        log() has the call shape of Log::log, but it only stores the format
+//        pointer and up to four arguments in a ring owned by the calling
+//        thread: no formatting, no locks, no system calls. The rings are
+//        drained in call order,
+//          - with a file, by a writer thread every few milliseconds;
+//          - without one, by flush() on the owning thread, into Log.
+//        The format and any string arguments must outlive the record, which
+//        holds for literals. A record that finds its ring full is dropped and
+//        counted.
+//
+// ==============================================================================
+
+#ifndef QTR_TIMINGLOG_H
+#define QTR_TIMINGLOG_H
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+using std::string;
+
+namespace QTR_NS {
+
+    class Log;
+
+    class TimingLog {
+
+    public:
+        TimingLog();
+        ~TimingLog();
+
+        // threads: rings, one per OpenMP thread; capacity: records per ring
+        void            open(Log *log, string path, int threads, int capacity);
+        bool            isEnabled();
+        void            flush();   // drain into Log, no-op with a writer thread
+        void            close();
+
+        template <typename A>
+        inline void     log(const char *fmt, A a)
+        {
+            uint64_t args[MAX_ARGS] = { Pack(a) };
+            Push(fmt, &Format1<A>, args);
+        }
+        template <typename A, typename B>
+        inline void     log(const char *fmt, A a, B b)
+        {
+            uint64_t args[MAX_ARGS] = { Pack(a), Pack(b) };
+            Push(fmt, &Format2<A, B>, args);
+        }
+        template <typename A, typename B, typename C>
+        inline void     log(const char *fmt, A a, B b, C c)
+        {
+            uint64_t args[MAX_ARGS] = { Pack(a), Pack(b), Pack(c) };
+            Push(fmt, &Format3<A, B, C>, args);
+        }
+        template <typename A, typename B, typename C, typename D>
+        inline void     log(const char *fmt, A a, B b, C c, D d)
+        {
+            uint64_t args[MAX_ARGS] = { Pack(a), Pack(b), Pack(c), Pack(d) };
+            Push(fmt, &Format4<A, B, C, D>, args);
+        }
+
+    private:
+        enum { MAX_ARGS = 4, LINE_LEN = 512 };
+
+        typedef int (*Formatter)(char *line, const char *fmt, const uint64_t *args);
+
+        struct Record {
+            uint64_t              seq;
+            const char            *fmt;
+            Formatter             format;
+            uint64_t              args[MAX_ARGS];
+        };
+
+        // Single producer (its thread), single consumer (the drain). The two
+        // counters sit on their own cache lines.
+        struct Ring {
+            std::atomic<uint64_t> head;        // records published
+            char                  pad0[56];
+            std::atomic<uint64_t> tail;        // records drained
+            char                  pad1[56];
+            uint64_t              dropped;
+            Record                *buf;
+        };
+
+        inline void     Push(const char *fmt, Formatter format, const uint64_t *args)
+        {
+            int t = omp_get_thread_num();
+
+            if ( rings == NULL || t >= nrings )  {
+                overflow.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            Ring &r = rings[t];
+            uint64_t head = r.head.load(std::memory_order_relaxed);
+
+            if ( head - r.tail.load(std::memory_order_acquire) >= (uint64_t) capacity )  {
+                r.dropped ++;
+                return;
+            }
+            Record &rec = r.buf[head & (capacity - 1)];
+            rec.fmt = fmt;
+            rec.format = format;
+            memcpy(rec.args, args, sizeof(rec.args));
+            rec.seq = seq.fetch_add(1, std::memory_order_relaxed);
+            r.head.store(head + 1, std::memory_order_release);
+        }
+
+        template <typename T>
+        static inline uint64_t Pack(T v)
+        {
+            static_assert(sizeof(T) <= sizeof(uint64_t), "TimingLog arguments are at most 8 bytes");
+            uint64_t u = 0;
+            memcpy(&u, &v, sizeof(T));
+            return u;
+        }
+        template <typename T>
+        static inline T Unpack(uint64_t u)
+        {
+            T v;
+            memcpy(&v, &u, sizeof(T));
+            return v;
+        }
+
+        template <typename A>
+        static int      Format1(char *line, const char *fmt, const uint64_t *a)
+        {
+            return snprintf(line, LINE_LEN, fmt, Unpack<A>(a[0]));
+        }
+        template <typename A, typename B>
+        static int      Format2(char *line, const char *fmt, const uint64_t *a)
+        {
+            return snprintf(line, LINE_LEN, fmt, Unpack<A>(a[0]), Unpack<B>(a[1]));
+        }
+        template <typename A, typename B, typename C>
+        static int      Format3(char *line, const char *fmt, const uint64_t *a)
+        {
+            return snprintf(line, LINE_LEN, fmt, Unpack<A>(a[0]), Unpack<B>(a[1]), Unpack<C>(a[2]));
+        }
+        template <typename A, typename B, typename C, typename D>
+        static int      Format4(char *line, const char *fmt, const uint64_t *a)
+        {
+            return snprintf(line, LINE_LEN, fmt, Unpack<A>(a[0]), Unpack<B>(a[1]), Unpack<C>(a[2]), Unpack<D>(a[3]));
+        }
+
+        int             Drain();
+        void            Writer();
+
+        Log             *out;
+        FILE            *fp;
+        Ring            *rings;
+        int             nrings;
+        int             capacity;
+        uint64_t        next;      // sequence number of the next line out
+        std::atomic<uint64_t> seq;
+        std::atomic<uint64_t> overflow;
+        std::atomic<bool> running;
+        std::thread     writer;
+    };
+}
+
+#endif /* QTR_TIMINGLOG_H */
@@ -0,0 +1,100 @@
+// ==============================================================================
+//
+//  WignerOperator.cpp
+//  QTR
+//
+// ==============================================================================
+
+#include <cmath>
+#include <cstddef>
+
+#include "WignerOperator.h"
+
+using namespace QTR_NS;
+
+typedef std::complex<double> cplx;
+
+/* ------------------------------------------------------------------------------- */
+
+WignerOperator::WignerOperator()
+{
+    n = 0;
+    M = 0;
+    hb = 1.0;
+}
+/* ------------------------------------------------------------------------------- */
+
+WignerOperator::~WignerOperator()
+{
+    return;
+}
+/* ------------------------------------------------------------------------------- */
+
+void WignerOperator::init(int n_in, double h, double hb_in)
+{
+    n = n_in;
+    hb = hb_in;
+    M = 1;
+
+    while ( M < 2 * n )
+        M *= 2;
+
+    fft.init(M, h);
+
+    // Mode k of the DFT sum_j f_j exp(-2 pi i jk/M) is the transform at
+    // y = -Y(k). dV is odd in y, so the multiplier -i dV(-Y) / hb is
+    // i dV[k] / hb. The Nyquist mode has no partner and is dropped.
+    Yk.resize(M);
+
+    for (int k = 0; k < M; k ++)
+        Yk[k] = ( 2 * k == M ) ? 0.0 : hb * fft.Wavenumber(k);
+}
+/* ------------------------------------------------------------------------------- */
+
+int WignerOperator::modes()
+{
+    return M;
+}
+/* ------------------------------------------------------------------------------- */
+
+int WignerOperator::workSize()
+{
+    return M + fft.workSize();
+}
+/* ------------------------------------------------------------------------------- */
+
+double WignerOperator::Y(int k)
+{
+    return Yk[k];
+}
+/* ------------------------------------------------------------------------------- */
+
+void WignerOperator::Apply2(cplx *x, const double *dVa, const double *dVb)
+{
+    const double hb_inv = 1.0 / hb;
+    cplx za, zb, A, B;
+    int k2;
+
+    for (int j = n; j < M; j ++)
+        x[j] = 0.0;
+
+    fft.Transform(x, 1, false, x + M);
+
+    // Split Z into the spectra of a and b, multiply each by its own i dV / hb
+    // and recombine. Modes k and M-k are conjugate, so they go together; the
+    // products stay Hermitian, so both results are real.
+    for (int k = 0; k <= M / 2; k ++)  {
+
+        k2 = ( M - k ) % M;
+        za = x[k];
+        zb = std::conj(x[k2]);
+        A = 0.5 * (za + zb) * cplx(0.0, dVa[k] * hb_inv);
+        B = cplx(0.0, -0.5) * (za - zb) * cplx(0.0, dVb == NULL ? 0.0 : dVb[k] * hb_inv);
+
+        x[k] = A + cplx(0.0, 1.0) * B;
+        x[k2] = std::conj(A) + cplx(0.0, 1.0) * std::conj(B);
+    }
+
+    fft.Transform(x, 1, true, x + M);
+}
+/* ------------------------------------------------------------------------------- */
@@ -0,0 +1,55 @@
+// ==============================================================================
+//
+//  WignerOperator.h
+//  QTR
+//
+//  Note: Nonlocal potential operator of the Wigner equation on one x row,
+//
+//          Theta f(p) = i/(2 pi hb^2) Int dy dp' dV(y) exp(i (p-p') y/hb) f(p'),
+//          dV(y) = V(x + y/2) - V(x - y/2),
+//
+//        applied as a product in y space: FFT along p, multiply by i dV / hb,
+//        inverse FFT. Two real rows share one complex transform. Rows are
+//        zero-padded to at least twice their length so the convolution in p
+//        does not wrap around. For a smooth V the operator reduces to
+//        V'(x) df/dp. The transforms are SpectralShift's.
+//
+// ==============================================================================
+
+#ifndef QTR_WIGNEROPERATOR_H
+#define QTR_WIGNEROPERATOR_H
+
+#include <complex>
+#include <vector>
+
+#include "SpectralShift.h"
+
+namespace QTR_NS {
+
+    class WignerOperator {
+
+    public:
+        WignerOperator();
+        ~WignerOperator();
+
+        void            init(int n, double h, double hb);
+        int             modes();     // padded length
+        int             workSize();  // modes plus the FFT scratch
+        double          Y(int k);    // y of mode k, 0 for the Nyquist mode
+
+        // Two rows share one complex FFT: x[0, n) holds a + i b on entry and
+        // Theta a + i Theta b on return; x has workSize() entries. dVa[k] is
+        // V(x + Y(k)/2) - V(x - Y(k)/2) on the row of a; dVb may be NULL when
+        // there is no b.
+        void            Apply2(std::complex<double> *x, const double *dVa, const double *dVb);
+
+    private:
+        int             n;
+        int             M;
+        double          hb;
+        std::vector<double> Yk;
+        SpectralShift   fft;
+    };
+}
+
+#endif /* QTR_WIGNEROPERATOR_H */